@@ -13,6 +13,7 @@ printf "\n\nCleaning enviroment\n\n"
 
 sudo rmmod TAGMOD
 sudo rmmod SCTH
+sudo rmmod UTILSPERF
 
 cd syscall-table-disc
 
@@ -22,7 +23,11 @@ cd ../tag-module
 
 make clean
 
-cd ../test
+cd ../utils/kunit
+
+make clean
+
+cd ../../test
 
 make clean
 
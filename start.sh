@@ -4,6 +4,8 @@
 export TEST_FUNC=0          # set 1 to run functionality test on some utilities used in the modules, 0 otherwise
 export TEST_SYSCALL=0       # set 1 to test the System Call Installer module without the Tag Module and run basic functionality test, 0 otherwise
 export MOD_DEBUG=1          # set 1 to enable debug/extra printing on kernel-level log buffer, 0 otherwise
+export MOD_PROFILE=0        # set 1 to time each phase of tag_send/tag_receive (read with "test_char_dev.o -p"), 0 otherwise
+export TEST_PERF=0          # set 1 to run the KUnit performance suite of the utilities (needs a kernel with CONFIG_KUNIT), 0 otherwise
 
 
 current_dir=${PWD##*/} 
@@ -30,6 +32,24 @@ then
     
     make clean
 
+elif [[ $TEST_PERF -eq 1 ]]
+then
+    printf "\n\nRunning utilities performance suite\n\n"
+
+    sudo dmesg -C
+
+    cd ./utils/kunit
+
+    # Compile and load the suite (the test cases run on insmod, results on the kernel log buffer)
+    make all
+    sudo insmod UTILSPERF.ko
+    dmesg | grep PERF
+    sudo rmmod UTILSPERF
+
+    make clean
+
+    cd ..
+
 else
     
     printf "\n\nMounting modules\n\n"
@@ -13,6 +13,7 @@
 #include <linux/version.h>
 #include <linux/interrupt.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 #include <asm/page.h>
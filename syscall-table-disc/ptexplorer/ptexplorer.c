@@ -18,6 +18,52 @@
 #define H_PAGES         ((unsigned long long) 0x80ULL)                // Mask to check wether the PT entry points to another PT or a frame (1GB/2MB)                               
 
 
+#define PML4_SIZE       ((unsigned long long) 1ULL << 39)             // Memory mapped by a PML4 entry (512 GB)
+#define PDP_SIZE        ((unsigned long long) 1ULL << 30)             // Memory mapped by a PDP entry (1 GB)
+#define PDE_SIZE        ((unsigned long long) 1ULL << 21)             // Memory mapped by a PDE entry (2 MB)
+#define PTE_SIZE        ((unsigned long long) 1ULL << 12)             // Memory mapped by a PTE entry (4 KB)
+
+
+static unsigned long long pt_lookup(pgd_t* pml4, unsigned long long addr, unsigned long long* entry);
+
+
+/**
+ *  @brief  Translate addr walking the page table down to the entry that maps it (or that is not present)
+ *
+ *  @param  pml4 virtual address of the PML4
+ *  @param  addr address to translate
+ *  @param  entry set to the last entry read: a present PTE, a 2MB/1GB huge page entry or a non present entry
+ *
+ *  @return size of the memory region mapped by "entry" (PML4_SIZE, PDP_SIZE, PDE_SIZE or PTE_SIZE): every
+ *          address of the aligned region containing addr is translated the same way
+ */
+static unsigned long long pt_lookup(pgd_t* pml4, unsigned long long addr, unsigned long long* entry) {
+
+    pud_t *pdp;
+    pmd_t *pde;
+    pte_t *pte;
+
+    //Check PML4
+    *entry = pml4[PML4(addr)].pgd;
+    if(!(*entry & PRESENT_BIT)) return PML4_SIZE;
+
+    // Check PDP (1GB page if H_PAGES is set)
+    pdp = __va(*entry & PT_ADDRESS_MASK);
+    *entry = pdp[PDP(addr)].pud;
+    if(!(*entry & PRESENT_BIT) || (*entry & H_PAGES)) return PDP_SIZE;
+
+    // Check PDE (2MB page if H_PAGES is set)
+    pde = __va(*entry & PT_ADDRESS_MASK);
+    *entry = pde[PDE(addr)].pmd;
+    if(!(*entry & PRESENT_BIT) || (*entry & H_PAGES)) return PDE_SIZE;
+
+    // Check PTE
+    pte = __va(*entry & PT_ADDRESS_MASK);
+    *entry = pte[PTE(addr)].pte;
+    return PTE_SIZE;
+}
+
+
 /**
  *  @brief  Get physical frame number of a giver virtual address using
  *          the Page table
@@ -29,64 +75,60 @@
  * 
  */
 unsigned long long get_phys_frame(unsigned long long addr) {
-    
-    pgd_t *pml4;
-	pud_t *pdp;
-	pmd_t *pde;
-	pte_t *pte;
-	
-    int frame_number;
-
-    // Page table virtual address
-    pml4 = __va(get_pt_addr());
-    
-    
-    // Check entries in the page tables
-
-    //Check PML4
-    if(!((pml4[PML4(addr)].pgd) & PRESENT_BIT)) return -1;
 
+    unsigned long long entry, size;
 
+    size = pt_lookup(__va(get_pt_addr()), addr, &entry);
+    if(!(entry & PRESENT_BIT)) return -1;
 
-    // Get PDP
-    pdp = __va((pml4[PML4(addr)].pgd) & PT_ADDRESS_MASK);
+    // In a huge page entry the low bits of the address field are flags (PAT), the offset comes from addr
+    return ((entry & PT_ADDRESS_MASK & ~(size - 1)) + (addr & (size - 1))) >> 12;
+}
 
-    // Check PDP
-    if(!((pdp[PDP(addr)].pud) & PRESENT_BIT)) {
-        return -1;
-    }
-    else if((pdp[PDP(addr)].pud) & H_PAGES) {
-        return -1;
-    }
-    
 
+/**
+ *  @brief  Walk the page table over [start, end) calling "visit" once for every maximal run of contiguous
+ *          mapped memory. Non present PML4/PDP/PDE entries are skipped as a whole, and 1GB/2MB pages are
+ *          covered by a single lookup, so only the page tables really in use are read
+ *
+ *  @param  start first address of the range
+ *  @param  end address past the range
+ *  @param  visit called with the run [run_start, run_end), the walk stops if it returns non zero
+ *  @param  data passed to visit
+ *
+ *  @return the first non zero value returned by visit, 0 otherwise
+ */
+int walk_mapped_range(unsigned long long start, unsigned long long end, pt_visit_t visit, void* data) {
 
-    // Get PDE
-    pde = __va(pdp[PDP(addr)].pud & PT_ADDRESS_MASK);
+    pgd_t *pml4;
+    unsigned long long addr, next, entry, size, run_start;
+    int in_run, ret;
 
-    // Check PDE
-    if(!((pde[PDE(addr)].pmd) & PRESENT_BIT)) {
-        return -1;
-    }
-    else if((pde[PDE(addr)].pmd) & H_PAGES) {
-        
-        frame_number = (unsigned long long)((pde[PDE(addr)].pmd) & PT_ADDRESS_MASK) >> 12;
+    pml4 = __va(get_pt_addr());
+    in_run = 0;
+    run_start = 0;
 
-        return frame_number;
-    }
+    for(addr = start; addr < end; addr = next) {
 
+        size = pt_lookup(pml4, addr, &entry);
 
+        next = (addr & ~(size - 1)) + size;
+        if(next == 0 || next > end) next = end;    // Wrapped past the top of the address space, or past the range
 
-    // Get PTE
-    pte = __va((unsigned long) pde[PDE(addr)].pmd & PT_ADDRESS_MASK);
+        if(entry & PRESENT_BIT) {
+            if(!in_run) run_start = addr;
+            in_run = 1;
+            continue;
+        }
 
-    // Check PTE
-    if(!((pte[PTE(addr)].pte) & PRESENT_BIT)) {
-        return -1;
+        if(in_run) {
+            ret = visit(run_start, addr, data);
+            if(ret != 0) return ret;
+        }
+        in_run = 0;
     }
 
-    frame_number = ((unsigned long long)(pte[PTE(addr)].pte) & PT_ADDRESS_MASK) >> 12;
+    if(in_run) return visit(run_start, end, data);
 
-    return frame_number;
+    return 0;
 }
-
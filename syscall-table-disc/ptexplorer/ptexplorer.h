@@ -1,4 +1,8 @@
 #include "../module.h"
 #include "../arch-common/arch-common.h"
 
-unsigned long long get_phys_frame(unsigned long long addr);
\ No newline at end of file
+// Called by walk_mapped_range() on every run of mapped memory [run_start, run_end)
+typedef int (*pt_visit_t)(unsigned long long run_start, unsigned long long run_end, void* data);
+
+unsigned long long get_phys_frame(unsigned long long addr);
+int walk_mapped_range(unsigned long long start, unsigned long long end, pt_visit_t visit, void* data);
\ No newline at end of file
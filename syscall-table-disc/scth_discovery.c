@@ -13,119 +13,183 @@ unsigned long long* syscall_table_addr = 0;
 unsigned long long  sys_ni_address = 0;
 const unsigned long long ni_syscall[] =	
                             { 134ull, 174ull, 182ull, 183ull, 214ull, 215ull, 236ull };
-static int syscall_table_pattern(unsigned long long addr);
+static int syscall_table_pattern(unsigned long long run_start, unsigned long long run_end, void* data);
+static int syscall_table_check(unsigned long long* start_tb);
+static int syscall_table_lookup(void);
+static void syscall_table_scan(void);
+
+typedef unsigned long (*kallsyms_lookup_name_t)(const char* name);
 
 /**
- *  @brief  Find the system call table
+ *  @brief  Find the system call table: resolved with kallsyms if possible (milliseconds), scanning
+ *          the kernel address space otherwise
  *    
  */
 void find_syscall_table(void) {
 
-    unsigned long long page;
-    unsigned long long current_pg;
+    u64 start;
     int i;
 
-    for(page = START_ADDR; page < END_ADDR; page += PAGE_SIZE_DEF) {
-
-        current_pg = page;
+    start = ktime_get_ns();
 
-        // Check if "page" is mapped
-        if(get_phys_frame(current_pg) != -1ull) {
+    if(syscall_table_lookup()) {
+        PRINT
+        printk("%s: Syscall table resolved with kallsyms in %llu us\n", MODNAME, (ktime_get_ns() - start) / 1000);
+    }
+    else {
+        printk("%s: Syscall table not resolved with kallsyms, scanning memory\n", MODNAME);
+        syscall_table_scan();
+        PRINT
+        printk("%s: Memory scan done in %llu ms\n", MODNAME, (ktime_get_ns() - start) / 1000000);
+    }
 
-            
-            // If mapped, search for syscall table
-
-            if(syscall_table_pattern(current_pg)) {
-                
-                PRINT {
-                    printk("%s: Syscall table found (Page addr: %llu)\n", MODNAME, current_pg);
-                    printk("%s: Syscall address %llu\n", MODNAME, (unsigned long long) syscall_table_addr);
-                    printk("%s: Sys_ni has value %llu\n", MODNAME, sys_ni_address);
-                    
-                    for(i = 0; i < FREE_ENTRIES; i++) {
-                        printk("%s: Entry %d of ni_syscall: %llu\n", 
-                        MODNAME, i, syscall_table_addr[ni_syscall[i]]);
-                    }
-                } else {
-                    printk("%s: Syscall table found at address %llu\n", MODNAME, (unsigned long long) syscall_table_addr);
-                }
-
-                return;
-            }
+    if(syscall_table_addr == 0) {
+        printk("%s: Syscall table not found\n", MODNAME);
+        return;
+    }
 
+    PRINT {
+        printk("%s: Syscall address %llu\n", MODNAME, (unsigned long long) syscall_table_addr);
+        printk("%s: Sys_ni has value %llu\n", MODNAME, sys_ni_address);
+        
+        for(i = 0; i < FREE_ENTRIES; i++) {
+            printk("%s: Entry %d of ni_syscall: %llu\n", 
+            MODNAME, i, syscall_table_addr[ni_syscall[i]]);
         }
+    } else {
+        printk("%s: Syscall table found at address %llu\n", MODNAME, (unsigned long long) syscall_table_addr);
+    }
 
+}
+
+
+/**
+ *  @brief  Resolve sys_call_table with kallsyms_lookup_name. Since 5.7 the function is not exported anymore,
+ *          so its address is taken from a kprobe registered on it (the probe is removed right away)
+ * 
+ *  @return 1 if the table was resolved and looks like a system call table, 0 otherwise
+ *    
+ */
+static int syscall_table_lookup(void) {
+
+    struct kprobe kp = { .symbol_name = "kallsyms_lookup_name" };
+    kallsyms_lookup_name_t lookup;
+    unsigned long long* start_tb;
+    unsigned long sys_ni;
+    int i;
+
+    if(register_kprobe(&kp) < 0) {
+        PRINT
+        printk("%s: Could not register a kprobe on kallsyms_lookup_name\n", MODNAME);
+        return 0;
     }
+    lookup = (kallsyms_lookup_name_t) kp.addr;
+    unregister_kprobe(&kp);
 
-    PRINT
-    printk("%s: Done\n", MODNAME); 
+    if(lookup == 0) return 0;
+
+    start_tb = (unsigned long long *) lookup("sys_call_table");
+    if(start_tb == 0) return 0;
+
+    // When the symbol of sys_ni_syscall is available the free entries must point exactly to it,
+    // otherwise fall back to the same pattern used by the scan
+    sys_ni = lookup("__x64_sys_ni_syscall");
+    if(sys_ni == 0) sys_ni = lookup("sys_ni_syscall");
+
+    if(sys_ni != 0) {
+        for(i = 0; i < FREE_ENTRIES; i++) {
+            if(start_tb[ni_syscall[i]] != sys_ni) {
+                printk("%s: Entry %llu of sys_call_table is not sys_ni_syscall\n", MODNAME, ni_syscall[i]);
+                return 0;
+            }
+        }
+    }
+    else if(!syscall_table_check(start_tb)) return 0;
 
+    syscall_table_addr = start_tb;
+    sys_ni_address = start_tb[ni_syscall[0]];
+
+    return 1;
 }
 
 
 /**
- *  @brief  Check in a given address if there's a pattern equal to
- *          the one of the system call table
+ *  @brief  Scan the kernel address space looking for the system call table (fallback of syscall_table_lookup)
+ *          Only the mapped memory is read, one run of contiguous pages at a time (see walk_mapped_range)
+ *    
+ */
+static void syscall_table_scan(void) {
+
+    walk_mapped_range(START_ADDR, END_ADDR, syscall_table_pattern, 0);
+
+}
+
+
+/**
+ *  @brief  Check every candidate position of a run of mapped memory for a pattern equal to
+ *          the one of the system call table. The table is an array of pointers, so only
+ *          8-byte aligned positions whose entries (up to the last free one) lie in the run are tried
  * 
- *  @param  addr base address to use for pattern recognition (page aligned)
+ *  @param  run_start first address of the run (page aligned)
+ *  @param  run_end address past the run
  * 
  *  @return 0 if no system call table was found, 1 otherwise
  *    
  */
-static int syscall_table_pattern(unsigned long long addr) {
+static int syscall_table_pattern(unsigned long long run_start, unsigned long long run_end, void* data) {
 
+    unsigned long long offs, span;
 
-    unsigned long long *start_tb, offs, first_ni_syscall;
+    span = (ni_syscall[FREE_ENTRIES - 1] + 1) * ((unsigned long long) sizeof(void*));
 
-    for(offs = addr; offs < addr + PAGE_SIZE_DEF; offs += 1ull) {
-        
-        unsigned long long next_page = 
-                offs + ni_syscall[FREE_ENTRIES - 1] * ((unsigned long long) sizeof(void*));
-        
-        // Check if the last ni_syscall entry is on the subsequent page
-        if(((offs & PAGE_BITMASK) + PAGE_SIZE_DEF) == (next_page & PAGE_BITMASK)) 
-            if(get_phys_frame(next_page) == -1) return 0;
+    for(offs = run_start; offs + span <= run_end; offs += sizeof(void*)) {
 
+        if(syscall_table_check((unsigned long long *) offs)) {
+            syscall_table_addr = (unsigned long long *) offs;
+            sys_ni_address = syscall_table_addr[ni_syscall[0]];
 
-        start_tb = (unsigned long long *) offs;
-        first_ni_syscall = start_tb[ni_syscall[0]];
-        
-        //Check if first_ni_syscall is a good fit as sys_ni function pointer
-        if(((first_ni_syscall & 0x3) == 0) &&
-            (first_ni_syscall != 0x0)      &&
-            (first_ni_syscall > START_ADDR)) {
-                
-                //Used to check conditions
-                int condition_check = 0;
-                
-                // Pattern check
-                int i;
-                for(i = 1; i < FREE_ENTRIES; i++){
-                    unsigned long long entry = start_tb[ni_syscall[i]];
-                    if(entry != first_ni_syscall) condition_check = 1;
-                }
-                if(condition_check) continue;
-
-                // Check if the area before first_ni_syscall points to ni_syscall
-                int j;
-                
-                for(j = 1; j < (int)ni_syscall[0]; j++)  {
-                    if( start_tb[j] == start_tb[ni_syscall[0]]) condition_check = 1;
-                }
-                if(condition_check) continue; 
-
-                syscall_table_addr = (unsigned long long*) offs;
-                sys_ni_address = start_tb[ni_syscall[0]];
-
-                return 1;
-                
+            PRINT
+            printk("%s: Syscall table found (Page addr: %llu)\n", MODNAME, offs & PAGE_BITMASK);
+
+            return 1;
         }
         
     }
 
     return 0;
 
+}
+
+/**
+ *  @brief  Check if the memory at start_tb looks like the system call table: all the free entries
+ *          hold the same kernel function pointer (sys_ni) and none of the entries before them does
+ * 
+ *  @param  start_tb candidate base of the table (the entries up to the last free one must be mapped)
+ * 
+ *  @return 1 if the pattern matches, 0 otherwise
+ *    
+ */
+static int syscall_table_check(unsigned long long* start_tb) {
+
+    unsigned long long first_ni_syscall;
+    int i;
+
+    first_ni_syscall = start_tb[ni_syscall[0]];
+
+    //Check if first_ni_syscall is a good fit as sys_ni function pointer
+    if(((first_ni_syscall & 0x3) != 0) ||
+        (first_ni_syscall == 0x0)      ||
+        (first_ni_syscall <= START_ADDR)) return 0;
+
+    // Pattern check
+    for(i = 1; i < FREE_ENTRIES; i++)
+        if(start_tb[ni_syscall[i]] != first_ni_syscall) return 0;
+
+    // Check if the area before first_ni_syscall points to ni_syscall
+    for(i = 1; i < (int)ni_syscall[0]; i++)
+        if(start_tb[i] == first_ni_syscall) return 0;
 
+    return 1;
 }
 
 /**
@@ -1,5 +1,9 @@
+#ifndef _TAG_H
+#define _TAG_H
+
 #define TAG_OPEN        0
 #define TAG_CREAT       1
+#define TAG_RETAIN      0x10        // OR'ed to TAG_CREAT: every level keeps its last message (see TAG_RECV_LATEST)
 
 #define TAG_AWAKE_ALL   0
 #define TAG_DELETE      1
@@ -9,3 +13,273 @@
 
 // Error code used to comunicate that the max number of tag services has been reached
 #define EMAXTAG     132
+
+// Outcome of a tag_send(), as reported by the "tagmod:tag_send" tracepoint
+#define TAG_SEND_DELIVERED      0   // Message published and receivers woken up
+#define TAG_SEND_NO_RECEIVERS   1   // Discarded: no thread waiting on the Tag or on the level
+#define TAG_SEND_BUSY           2   // Discarded: another sender holds the level
+#define TAG_SEND_READY          3   // Discarded: the level still holds a message being received
+#define TAG_SEND_ERROR          4   // Error (see ret)
+
+
+
+// Multiplexed system call: tag_op(op, &args) runs the operation "op" with the arguments in "args" (only the
+// fields of the operation are read). It takes a single entry of the system call table, so new operations
+// don't need a free entry each; its number is the "tag_op_nr" parameter of the module
+
+#include <linux/types.h>
+
+#define TAG_OP_GET          0   // tag_get(key, command, permission)
+#define TAG_OP_SEND         1   // tag_send(tag, level, buffer, size)
+#define TAG_OP_RECEIVE      2   // tag_receive(tag, level, buffer, size)
+#define TAG_OP_CTL          3   // tag_ctl(tag, command)
+#define TAG_OP_RECEIVE_ANY  4   // tag_receive_any(tag, level_mask, buffer, size, &level)
+#define TAG_OP_WAIT_MULTI   5   // tag_wait_multi(pairs, count, buffer, size, &index)
+#define TAG_OPS             6
+
+// TAG_OP_RECEIVE command: on a TAG_RETAIN Tag, return at once the last message of the level if its sequence is
+// newer than "seq" (the last one the caller has seen), otherwise wait as usual
+#define TAG_RECV_LATEST 1
+
+// TAG_OP_WAIT_MULTI: a level of a Tag to wait on, at most TAG_WAIT_MAX distinct pairs (also of different Tags) per call.
+// A Tag can't be deleted while a thread waits on one of its pairs
+#define TAG_WAIT_MAX    1024
+
+struct tag_wait_pair {
+    __s32 tag;                      // Tag descriptor
+    __s32 level;                    // Level
+};
+
+struct tag_args {
+    __s32 tag;                      // Tag descriptor
+    __s32 level;                    // Level
+    __s32 key;                      // Key of the Tag (TAG_OP_GET)
+    __s32 command;                  // TAG_OPEN/TAG_CREAT (TAG_OP_GET), TAG_AWAKE_ALL/TAG_DELETE (TAG_OP_CTL) or TAG_RECV_LATEST
+    __s32 permission;               // TAG_PERM_ALL or TAG_PERM_USR (TAG_OP_GET)
+    __u32 spin_ns;                  // Busy-poll the level up to spin_ns before sleeping (TAG_OP_RECEIVE, 0 to sleep at once)
+    __u64 buffer;                   // User pointer to the message
+    __u64 size;                     // Size of the message (or of the buffer)
+    __u64 seq;                      // Last sequence seen (TAG_RECV_LATEST), set to the one of the message received
+    __u32 level_mask;               // Levels to wait on, bit i for level i (TAG_OP_RECEIVE_ANY, which sets "level"
+                                    // to the one the message came from)
+    __u32 count;                    // Number of pairs (TAG_OP_WAIT_MULTI)
+    __u64 pairs;                    // User pointer to an array of struct tag_wait_pair (TAG_OP_WAIT_MULTI)
+    __s32 index;                    // Set to the position of the pair that woke the thread up (TAG_OP_WAIT_MULTI, -1 if none)
+    __u32 pad;
+};
+
+
+
+// Binary snapshot of the Tag services, read with ioctl(fd, TAG_INFO_SNAPSHOT, &req) on /dev/tag_info
+
+#include <linux/ioctl.h>
+
+#define TAG_INFO_LEVELS 32          // Levels of a Tag service (LEVELS in the module)
+#define TAG_INFO_TAGS   256         // Maximum number of Tag services (MAX_TAGS in the module)
+#define TAG_INFO_MSG    4096        // Maximum size of a message (BUFFER_SIZE in the module)
+
+// Single level of a Tag in the snapshot
+struct tag_info_level {
+    __s32 waiting;                  // Number of threads waiting on the level
+    __s32 epoch;                    // Level epoch
+    __u8  ready;                    // 1 while a tag_send() is delivering on the level
+} __attribute__((packed));
+
+// Single Tag in the snapshot
+struct tag_info {
+    __s32 tag;                      // Tag descriptor
+    __s32 key;                      // Key used to create the Tag (IPC_PRIVATE included)
+    __u32 euid;                     // EUID of the creator
+    __s32 permission;               // TAG_PERM_ALL or TAG_PERM_USR
+    __u8  ready;                    // 1 while a TAG_AWAKE_ALL is in progress
+    __u32 levels;                   // Bitmask of the existing levels (other entries of "level" are zeroed)
+    struct tag_info_level level[TAG_INFO_LEVELS];
+} __attribute__((packed));
+
+// Request of a snapshot: fills up to "count" entries of "buf" with the existing Tags
+// whose descriptor is >= "start". On return "count" holds the entries filled and "start"
+// the cursor to pass in the next call (it's past the last descriptor once done)
+struct tag_info_req {
+    __u32 start;
+    __u32 count;
+    __u64 buf;                      // User pointer to an array of struct tag_info
+} __attribute__((packed));
+
+#define TAG_INFO_SNAPSHOT   _IOWR('T', 1, struct tag_info_req)
+
+
+
+// Statistics page, mapped read-only with mmap(0, TAG_STATS_SIZE, PROT_READ, MAP_SHARED, fd, 0) on /dev/tag_info
+// The module refreshes it periodically from its per-CPU counters, only while the page is mapped (the first refresh
+// runs right after the mmap(), "refreshes" tells when it's done). Counters are cumulative for the life of a Tag
+// and reset when the Tag gets deleted. Each entry is read with the seqcount protocol:
+//      do { s = seq (acquire); copy the entry; } while((s & 1) || seq (after an acquire fence) != s);
+
+struct tag_stats_level {
+    __u64 sends;                    // Messages delivered by tag_send()
+    __u64 dropped;                  // tag_send() discarded (no receiver, level contended or occupied)
+    __u64 receives;                 // tag_receive() that got a message
+    __u64 wakeups;                  // Receivers woken up by tag_send() or TAG_AWAKE_ALL
+    __u64 bytes;                    // Bytes copied from senders and to receivers
+    __u64 rollovers;                // New level epochs created
+};
+
+struct tag_stats_entry {
+    __u32 seq;                      // Odd while the entry is being refreshed
+    __s32 tag;                      // Tag descriptor, -1 if the Tag does not exist
+    __u64 awake_alls;               // TAG_AWAKE_ALL delivered
+    struct tag_stats_level level[TAG_INFO_LEVELS];
+};
+
+struct tag_stats_page {
+    __u64 refreshes;                // Number of refreshes done by the module
+    __u64 period_us;                // Refresh period (while mapped)
+    struct tag_stats_entry tag[TAG_INFO_TAGS];
+};
+
+#define TAG_STATS_SIZE  ((sizeof(struct tag_stats_page) + 4095) & ~4095UL)
+
+
+
+// Status page, mapped read-only with mmap(0, TAG_STATUS_SIZE, PROT_READ, MAP_SHARED, fd, TAG_STATUS_OFFSET) on /dev/tag_info
+// Unlike the statistics page it's updated by the system calls themselves, so it's always current. A sender can read it
+// to skip a tag_send() that would be discarded: if the Tag exists, is TAG_PERM_ALL and nobody waits on the level (or
+// on the Tag), the system call would return 0 (the waiting counts are raised before a receiver starts waiting and
+// lowered after it's done, so a 0 is never stale in the unsafe direction, racing receivers aside as in tag_send())
+// A receiver can also spin on level_seq to see a delivery without a system call (see spin_ns in struct tag_args)
+
+struct tag_status_entry {
+    __u32 exists;                           // 1 while the Tag exists
+    __s32 permission;                       // TAG_PERM_ALL or TAG_PERM_USR
+    __u32 waiting;                          // Threads waiting on the Tag (any level)
+    __u32 ready;                            // 1 while a TAG_AWAKE_ALL is in progress
+    __u32 retain;                           // 1 if created with TAG_RETAIN (every tag_send() is kept)
+    __u32 level_waiting[TAG_INFO_LEVELS];   // Threads waiting on each level (all the epochs of the level)
+    __u8  level_ready[TAG_INFO_LEVELS];     // 1 while the latest epoch of the level holds a message being received
+    __u32 level_seq[TAG_INFO_LEVELS];       // Messages delivered (or retained) on each level, raised once the message is in the buffer and the level ready
+} __attribute__((aligned(64)));
+
+struct tag_status_page {
+    struct tag_status_entry tag[TAG_INFO_TAGS];
+};
+
+#define TAG_STATUS_SIZE     ((sizeof(struct tag_status_page) + 4095) & ~4095UL)
+#define TAG_STATUS_OFFSET   TAG_STATS_SIZE  // mmap() offset of the status page
+
+
+
+// Latency histograms of every level of a Tag, read with ioctl(fd, TAG_INFO_LATENCY, &lat) setting lat.tag
+// Buckets are log2 of nanoseconds: bucket 0 counts < 256 ns, bucket i counts [2^(i+7), 2^(i+8)) ns,
+// the last one everything above. TAG_INFO_LATENCY_RESET zeroes the histograms of a Tag (or of all of them with -1)
+// Samples are recorded only while the module parameter latency_hist is 1 (echo 1 > /sys/module/TAGMOD/parameters/latency_hist),
+// the histograms of a Tag that recorded nothing read as zeroes
+
+#define TAG_LAT_BUCKETS 24
+
+struct tag_latency_level {
+    __u64 wake[TAG_LAT_BUCKETS];    // From the message publication in tag_send() to the receiver running again
+    __u64 blocked[TAG_LAT_BUCKETS]; // Time a receiver spent waiting (whatever woke it up)
+};
+
+struct tag_latency {
+    __s32 tag;                      // Tag descriptor (in)
+    __u32 pad;
+    struct tag_latency_level level[TAG_INFO_LEVELS];
+};
+
+#define TAG_INFO_LATENCY        _IOWR('T', 2, struct tag_latency)
+#define TAG_INFO_LATENCY_RESET  _IO('T', 3)
+
+
+
+// Cycles spent in each phase of tag_send() and tag_receive(), summed over all CPUs (maximum of the CPU maxima).
+// Read with ioctl(fd, TAG_INFO_PROFILE, &prof), zeroed with TAG_INFO_PROFILE_RESET.
+// Only available when the module is built with MOD_PROFILE=1 (otherwise the ioctls fail with EOPNOTSUPP)
+
+#define TAG_PROF_SEND_TOTAL         0   // Whole tag_send()
+#define TAG_PROF_SEND_TAG_LOCK      1   // Waiting for tag_lock
+#define TAG_PROF_SEND_LEVEL_LOCK    2   // Waiting for level_lock
+#define TAG_PROF_SEND_RCU_LOCK      3   // Waiting for the level rcu_lock
+#define TAG_PROF_SEND_W_MUTEX       4   // Taking w_mutex (trylock)
+#define TAG_PROF_SEND_COPY          5   // copy_from_user()
+#define TAG_PROF_SEND_WAKE          6   // wake_up_all()
+#define TAG_PROF_RECV_TOTAL         7   // Whole tag_receive() (wait included)
+#define TAG_PROF_RECV_TAG_LOCK      8   // Waiting for tag_lock
+#define TAG_PROF_RECV_LEVEL_LOCK    9   // Waiting for level_lock
+#define TAG_PROF_RECV_RCU_LOCK      10  // Waiting for the level rcu_lock
+#define TAG_PROF_RECV_EPOCH         11  // Moving to a new level epoch (level_lock write included)
+#define TAG_PROF_RECV_WAIT          12  // Blocked waiting for the message
+#define TAG_PROF_RECV_COPY          13  // copy_to_user()
+#define TAG_PROF_RECV_RELEASE_LOCK  14  // Last receiver waiting for the level rcu_lock in write
+#define TAG_PROF_PHASES             15
+
+struct tag_prof_phase {
+    __u64 count;                    // Times the phase has been completed
+    __u64 cycles;                   // Total cycles
+    __u64 max;                      // Maximum cycles of a single occurrence
+};
+
+struct tag_profile {
+    struct tag_prof_phase phase[TAG_PROF_PHASES];
+};
+
+#define TAG_INFO_PROFILE        _IOR('T', 4, struct tag_profile)
+#define TAG_INFO_PROFILE_RESET  _IO('T', 5)
+
+
+
+// Memory held by the module, read with ioctl(fd, TAG_INFO_MEMORY, &mem).
+// Sizes are the ones requested to the allocators (slab rounding excluded), the per-CPU statistics are
+// counted for every possible CPU. A count of epoch levels growing while no receiver is waiting is a leak
+
+struct tag_info_memory {
+    __u64 tags;                     // Live Tags (struct tag_t)
+    __u64 levels;                   // Live levels, every epoch included
+    __u64 epoch_levels;             // Live levels with epoch > 0 (created because the previous epoch was still being received)
+    __u64 tag_bytes;                // Tags with their array of level pointers, per-CPU statistics and latency histograms
+    __u64 level_bytes;              // Level structs
+    __u64 buffer_bytes;             // Message buffers of the levels
+    __u64 retained_bytes;           // Buffers of the retained messages (TAG_RETAIN)
+};
+
+#define TAG_INFO_MEMORY         _IOR('T', 6, struct tag_info_memory)
+
+
+
+// In-kernel periodic publisher: a kernel thread (SCHED_FIFO) sleeps on an absolute hrtimer deadline every
+// "period_ns" and sends a struct tag_publish_msg to a level of a Tag, through the same path of tag_send().
+// Receivers compare the stamps with clock_gettime(CLOCK_MONOTONIC) to get the wake up latency of the module
+// without the scheduling noise of a userspace sender. Started with ioctl(fd, TAG_INFO_PUBLISH_START, &pub)
+// (root only, one publisher at a time) and stopped with ioctl(fd, TAG_INFO_PUBLISH_STOP, &pub_stats),
+// which returns the counters of the run. The publisher stops by itself after "count" messages (0 = no limit)
+// or if the Tag is deleted
+
+struct tag_publisher {
+    __s32 tag;                      // Tag descriptor
+    __s32 level;                    // Level to publish on
+    __u64 period_ns;                // Publication period (at least 10 us)
+    __u64 count;                    // Messages to publish, 0 until stopped
+    __s32 cpu;                      // CPU the publisher is bound to, -1 for any
+    __u32 pad;
+};
+
+struct tag_publish_msg {
+    __u64 seq;                      // Sequence number of the tick (starting from 0, counts the discarded ones)
+    __u64 expected_ns;              // Deadline of the tick (CLOCK_MONOTONIC)
+    __u64 publish_ns;               // Time the message was handed to the send path (CLOCK_MONOTONIC)
+};
+
+struct tag_publisher_stats {
+    __u64 ticks;                    // Deadlines served
+    __u64 delivered;                // Messages delivered
+    __u64 dropped;                  // Discarded (TAG_SEND_NO_RECEIVERS/BUSY/READY)
+    __u64 overruns;                 // Deadlines skipped because the previous tick ran past them
+    __u64 timer_max_ns;             // Maximum delay between a deadline and the publisher running
+    __s32 error;                    // Error that stopped the publisher (0 if none)
+    __u32 pad;
+};
+
+#define TAG_INFO_PUBLISH_START  _IOW('T', 7, struct tag_publisher)
+#define TAG_INFO_PUBLISH_STOP   _IOR('T', 8, struct tag_publisher_stats)
+
+#endif
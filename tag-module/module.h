@@ -1,3 +1,6 @@
+#ifdef TEST_FUNC
+#include "tag-shim.h"
+#else
 #define EXPORT_SYMTAB
 #include <linux/module.h>
 #include <linux/kernel.h>
@@ -24,17 +27,22 @@
 #include <linux/init.h>
 #include <linux/workqueue.h>
 #include <linux/delay.h>
+#include <linux/nospec.h>
+#include <linux/sched/signal.h>
+#include <linux/sort.h>
 #include <linux/version.h>
 
-
 #include "../syscall-table-disc/include/syscall-handle.h"
-#include "../utils/include/bitmask.h"
-#include "../utils/include/hashmap.h"
-#include "tag-struct.h"
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 17, 0)
 #error "Kernel must be at least version 4.17.x"
 #endif
+#endif
+
+
+#include "../utils/include/bitmask.h"
+#include "../utils/include/hashmap.h"
+#include "tag-struct.h"
 
 
 #ifdef AUDIT
@@ -62,7 +70,121 @@ extern int tag_get_nr;
 extern int tag_send_nr;
 extern int tag_receive_nr;
 extern int tag_ctl_nr;
+extern int tag_op_nr;
 
 
 int install_syscalls(void);
+long tag_op(unsigned int op, struct tag_args* args);
 void clear_tag_level(tag_level_t** tag_level);
+void clear_tag_retained(tag_retained_t* retained);
+
+#ifndef TEST_FUNC
+// Statistics (tag-stats.c)
+int  tag_stats_init(void);
+void tag_stats_exit(void);
+int  tag_stats_mmap(struct file* filp, struct vm_area_struct* vma);
+#endif
+
+// Status page (tag-stats.c), updated by the system calls (see struct tag_status_entry)
+extern struct tag_status_page* tag_status;
+
+#define TAG_STATUS(t)                       (&(tag_status -> tag[(t)]))
+#define TAG_STATUS_INC(field)               atomic_inc((atomic_t *) &(field))
+#define TAG_STATUS_DEC(field)               atomic_dec((atomic_t *) &(field))
+#define TAG_STATUS_NEXT(field)              ((u32) atomic_inc_return((atomic_t *) &(field)))
+
+// Update a counter of the Tag on the local CPU (no lock, no shared cache line)
+#define TAG_STAT_ADD(tag_entry, field, val) this_cpu_add((tag_entry) -> stats -> field, (val))
+#define TAG_STAT_INC(tag_entry, field)      this_cpu_inc((tag_entry) -> stats -> field)
+
+// Per-phase cycle accounting (MOD_PROFILE=1), the phases are the TAG_PROF_* of include/tag.h
+// A phase is timed with PROF_START(var) ... PROF_END(var, phase), "var" being declared with PROF_DECLARE(var)
+#ifdef PROFILE
+
+DECLARE_PER_CPU(struct tag_profile, tag_prof);
+
+unsigned long long rdtsc_fenced(void);
+
+static __always_inline void tag_prof_add(int phase, u64 cycles) {
+    struct tag_prof_phase* p;
+    p = &(get_cpu_ptr(&tag_prof) -> phase[phase]);
+    p -> count++;
+    p -> cycles += cycles;
+    if(cycles > p -> max) p -> max = cycles;
+    put_cpu_ptr(&tag_prof);
+}
+
+#define PROF_DECLARE(var)       unsigned long long var
+#define PROF_START(var)         (var) = rdtsc_fenced()
+#define PROF_END(var, phase)    tag_prof_add((phase), rdtsc_fenced() - (var))
+
+#else
+
+#define PROF_DECLARE(var)
+#define PROF_START(var)         do { } while(0)
+#define PROF_END(var, phase)    do { } while(0)
+
+#endif
+
+#ifndef TEST_FUNC
+// wait_event_interruptible() on "n" wait queues at once ("wq" array of queue pointers, "entries" array of n wait
+// entries of the caller, so the queues can be many): 0 once "condition" holds, -ERESTARTSYS on a signal
+#define wait_event_interruptible_multi(wq, n, entries, condition)                       \
+({                                                                                      \
+    int __i, __ret = 0;                                                                 \
+    for(__i = 0; __i < (n); __i++) init_wait(&((entries)[__i]));                        \
+    for(;;) {                                                                           \
+        for(__i = 0; __i < (n); __i++)                                                  \
+            prepare_to_wait((wq)[__i], &((entries)[__i]), TASK_INTERRUPTIBLE);          \
+        if(condition) break;                                                            \
+        if(signal_pending(current)) {                                                   \
+            __ret = -ERESTARTSYS;                                                       \
+            break;                                                                      \
+        }                                                                               \
+        schedule();                                                                     \
+    }                                                                                   \
+    for(__i = 0; __i < (n); __i++) finish_wait((wq)[__i], &((entries)[__i]));           \
+    __ret;                                                                              \
+})
+#endif
+
+long tag_prof_read(struct tag_profile __user *buf);
+long tag_prof_reset(void);
+
+// Memory accounting (tag-stats.c), updated where Tags and levels are allocated and freed
+extern atomic_long_t tag_mem_tags;
+extern atomic_long_t tag_mem_levels;
+extern atomic_long_t tag_mem_epoch_levels;
+extern atomic_long_t tag_mem_retained;
+extern atomic_long_t tag_mem_latency;
+
+long tag_memory_read(struct tag_info_memory __user *buf);
+
+// Send from kernel memory (tag-syscall.c) and periodic publisher (tag-publisher.c)
+int  tag_send_kernel(int tag, int level, const char* buffer, size_t size, int* outcome);
+#ifndef TEST_FUNC
+long tag_publisher_start(struct tag_publisher __user *buf);
+long tag_publisher_stop(struct tag_publisher_stats __user *buf);
+void tag_publisher_exit(void);
+#endif
+
+// Bucket of a latency histogram (log2 buckets of ns, see TAG_LAT_BUCKETS)
+static __always_inline int tag_latency_bucket(u64 ns) {
+    int bucket;
+    bucket = ns < 256 ? 0 : ilog2(ns) - 7;
+    if(bucket >= TAG_LAT_BUCKETS) bucket = TAG_LAT_BUCKETS - 1;
+    return bucket;
+}
+
+extern int latency_hist;
+tag_latency_t __percpu *tag_latency_alloc(tag_t* tag_entry);
+
+// Add a sample to the histogram "hist" (wake or blocked) of a level on the local CPU, so the receivers woken up
+// together by a send don't contend on the same bucket. The histograms of a Tag are allocated by its first sample
+// taken while latency_hist is set, until then nothing is recorded
+#define TAG_LAT_ADD(tag_entry, level, hist, ns) do {                                           \
+    tag_latency_t __percpu *__lat;                                                              \
+    __lat = READ_ONCE((tag_entry) -> latency);                                                  \
+    if(unlikely(__lat == 0) && READ_ONCE(latency_hist)) __lat = tag_latency_alloc(tag_entry);   \
+    if(__lat != 0) this_cpu_inc(__lat -> level[(level)].hist[tag_latency_bucket(ns)]);         \
+} while(0)
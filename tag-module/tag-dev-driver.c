@@ -5,24 +5,34 @@ static struct class *char_dev_class = NULL;
 static int major;
 
 static int      dev_open    (struct inode* inode, struct file* filp);
-static int      dev_release (struct inode* inode, struct file* filp);
 static ssize_t  dev_write   (struct file* filp, const char* buf, size_t size, loff_t *off);
-static ssize_t  dev_read    (struct file* filp, char* buf, size_t size, loff_t *off);
 static long     dev_ioctl   (struct file* filp, unsigned int command, unsigned long param);
-static loff_t   dev_llseek(struct file *filp, loff_t off, int whence);
 
-static char* append_buffer(char* dest, char* source, int* nbytes, int* curr_block);
+static void*    info_start  (struct seq_file* m, loff_t* pos);
+static void*    info_next   (struct seq_file* m, void* v, loff_t* pos);
+static void     info_stop   (struct seq_file* m, void* v);
+static int      info_show   (struct seq_file* m, void* v);
 
 
+// Divider between tags, built once in register_chardev
+static char divider[LINE_SIZE + 2];
+
+static const struct seq_operations info_ops = {
+    .start  = info_start,
+    .next   = info_next,
+    .stop   = info_stop,
+    .show   = info_show,
+};
 
 static struct file_operations fops = {
     .owner          = THIS_MODULE,
     .open           = dev_open,
     .write          = dev_write,
-    .read           = dev_read,
-    .release        = dev_release,
+    .read           = seq_read,
+    .release        = seq_release,
     .unlocked_ioctl = dev_ioctl,
-    .llseek         = dev_llseek,
+    .llseek         = seq_lseek,
+    .mmap           = tag_stats_mmap,
 };
 
 void register_chardev(void) {
@@ -36,6 +46,11 @@ void register_chardev(void) {
 
     major = MAJOR(dev);
 
+    memset(divider, '-', LINE_SIZE);
+    divider[0] = '+';
+    divider[LINE_SIZE - 1] = '+';
+    divider[LINE_SIZE] = '\n';
+
     char_dev_class = class_create(THIS_MODULE, DEV_NAME);
     if(char_dev_class == 0) {
         printk("%s: Error in a Char Device class\n", MODNAME);
@@ -81,333 +96,266 @@ void unregister_chardev(void) {
 }
 
 
-// Dev open and Dev release are no-op
 static int dev_open(struct inode* inode, struct file* filp) {
-    return 0;
-
-}
-static int dev_release(struct inode* inode, struct file* filp) {
-    return 0;
+    return seq_open(filp, &info_ops);
 }
 
-static ssize_t dev_read(struct file* filp, char* buf, size_t size, loff_t *off) {
-
-    // Retreive Tag info
-    
-    int i, j;
-    int tag_key, euid;
-    int nbytes, curr_block;
-    loff_t relative_off;
-    char __attribute__((aligned(PAGE_SIZE))) *buffer;
-    
-    // Since header and divider are always used, there's no point in allocating and filling them every read
-    // Instead, it's better to create them on "open" or even better, on "register_chardev"
-    char* header;
-    char* divider;
-
-    curr_block = 1;
-    nbytes = 0;
-    
-    // This one cannot be done because the size of the "file" is not constant, in fact only
-    // created tags will be displayed. If the size was fixed, this initialization of i
-    // would seriosly decrease the time to make the read
-    //i = (*off) / TAG_SIZE;
-    i = 0;
-    // Input check
-    if(size <= 0) return 0;
-    if(buf == 0 || (*off) < 0)  return -1;  
-    
-    relative_off = *off;
-
-    // Allocate buffer used to store the output
-    // + 1 is \0
-    buffer = vzalloc(sizeof(char) * (CHAR_BLOCK * curr_block + 1));
-    if(unlikely(buffer == 0)) {
-        PRINT
-        printk("%s: Could not allocate Buffer for dev_read.\n", MODNAME);
-        return -1;
-    }
 
-    // Allocate and create an header
-    // Possibly a single line will not go past 64 chars    
-    header = kzalloc(sizeof(char) * 64, GFP_KERNEL);
-    if(header == 0) {
-        PRINT
-        printk("%s: Could not allocate a temporal buffer\n", MODNAME);
-        vfree(buffer);
-        return -1;
-    }
-    sprintf(header, "| %10s | %10s | %10s | %10s |\n", "KEY", "EUID", "LEVEL", "WAIT");
-    int header_size;
-    header_size = strlen(header);
-
-    // Append the header at the begginning
-    buffer = strncat(buffer, header, header_size);
-    
-    // Free the header (no more necessary)
-    kfree(header);
-
-    // Allocate and create an divider
-    // Possibly a single line will not go past 64 chars    
-    divider = kzalloc(sizeof(char) * 64, GFP_KERNEL);
-    if(divider == 0) {
-        PRINT
-        printk("%s: Could not allocate a temporal buffer\n", MODNAME);
-        vfree(buffer);
-        return -1;
-    }
 
-    memset(divider, '-', LINE_SIZE);
-    divider[0] = '+';
-    divider[LINE_SIZE - 1] = '+';
-    divider[LINE_SIZE] = '\n';
+// The file position indexes records instead of bytes: position 0 is the header,
+// then tag "i" takes TAG_RECORDS positions starting at TAG_POS(i), one for each level
+// line and one for the closing divider. A read resumes straight from the (tag, level)
+// of the position, and seq_file formats the records directly in the user-visible buffer
 
-    buffer = strcat(buffer, divider);
+// Move to the first record of an existing tag at or after *pos. Returns 0 after the last tag
+static void* info_seek(loff_t* pos) {
 
-    
+    int i;
 
+    if(*pos == 0) return SEQ_START_TOKEN;
 
+    for(i = POS_TAG(*pos); i < MAX_TAGS; i++) {
+        // Only a hint, info_show() reads the tag again under RCU
+        if(READ_ONCE(tags[i]) != 0) {
+            if(i != POS_TAG(*pos)) *pos = TAG_POS(i);
+            return pos;
+        }
+    }
 
+    *pos = TAG_POS(MAX_TAGS);
+    return 0;
+}
 
-    // For each tag...
-    for(; i < MAX_TAGS; i++) {
-        
-        // Take the lock (so it's not possible to delete it while reading from it)
-        if(unlikely(down_read_interruptible(&(tag_lock[i])) == -EINTR)) {                
-            PRINT
-            printk("%s: RW Lock was interrupted.\n", MODNAME);
-            continue;
-        }
+static void* info_start(struct seq_file* m, loff_t* pos) {
+    return info_seek(pos);
+}
 
-        tag_t* tag_entry;
-        tag_entry = tags[i];
+static void* info_next(struct seq_file* m, void* v, loff_t* pos) {
+    (*pos)++;
+    return info_seek(pos);
+}
 
-        // Non existing tag (in case the tag is not existing, go to the next iteration)
-        if(tag_entry == 0) {
-            up_read(&(tag_lock[i]));
-            continue;
-        }
+static void info_stop(struct seq_file* m, void* v) {
+}
 
-        // If the offset is greater than the Tag size, there's no point in reading this
-        if(relative_off > TAG_SIZE) {
-            relative_off -= TAG_SIZE;
-            up_read(&(tag_lock[i]));
-            continue;
-        }
+static int info_show(struct seq_file* m, void* v) {
 
-        // Store the KEY and the EUID
-        tag_key = tag_entry -> key;
-        euid = tag_entry -> euid;
+    int tag, level;
+    tag_t* tag_entry;
+    tag_level_t* tag_level;
 
-        // For each level
-        for(j = 0; j < LEVELS; j++) {
-            tag_level_t* tag_level;
+    if(v == SEQ_START_TOKEN) {
+        seq_printf(m, "| %10s | %10s | %10s | %10s |\n", "KEY", "EUID", "LEVEL", "WAIT");
+        seq_puts(m, divider);
+        return 0;
+    }
 
-            
-            // Lock the level-accessing structure
-            if(unlikely(down_read_interruptible(&(tag_entry -> level_lock[j])) == -EINTR)) {                
-                PRINT
-                printk("%s: RW Lock was interrupted.\n", MODNAME);
-                continue;
-            }
+    tag = POS_TAG(*((loff_t *) v));
+    level = POS_LEVEL(*((loff_t *) v));
 
-            tag_level = (tag_entry -> tag_level)[j];
+    if(level == LEVELS) {
+        seq_puts(m, divider);
+        return 0;
+    }
 
-            if(tag_level == 0) {
-                up_read(&(tag_entry -> level_lock[j]));
-                continue;
-            }
+    // No sleeping lock: Tags and levels are freed only after an RCU grace period, so the monitoring
+    // never makes a TAG_DELETE or a new level epoch fail or wait. The values are a snapshot of the moment
+    rcu_read_lock();
 
-            if(unlikely(down_read_interruptible(&(tag_level -> rcu_lock)) == -EINTR)) {                
-                PRINT
-                printk("%s: RW Lock was interrupted.\n", MODNAME);
-                up_read(&(tag_entry -> level_lock[j]));
-                continue;
-                
-            }
+    tag_entry = rcu_dereference(tags[tag]);
 
-            // RCU instance of the "j" level accessed
+    // Tag removed after info_seek()
+    if(tag_entry == 0) {
+        rcu_read_unlock();
+        return 0;
+    }
 
-            up_read(&(tag_entry -> level_lock[j]));
+    tag_level = rcu_dereference((tag_entry -> tag_level)[level]);
 
-            // Allocate a temporary buffer to store single level info
-            // Possibly a single line will not go past 64 chars
-            char* temp;
-            temp = kzalloc(sizeof(char) * 64, GFP_KERNEL);
-            if(temp == 0) {
-                PRINT
-                printk("%s: Could not allocate a temporal buffer\n", MODNAME);
-                up_read(&(tag_level -> rcu_lock));
-                continue;
-            }
+    if(tag_level != 0)
+        seq_printf(m, "| %10d | %10d | %10d | %10d |\n", tag_entry -> key, tag_entry -> euid, level, atomic_read(&(tag_level -> waiting)));
 
-            // Fill the temporary buffer
-            sprintf(temp, "| %10d | %10d | %10d | %10d |\n", tag_key, euid, j, atomic_read(&(tag_level -> waiting)));
-            
-            buffer = append_buffer(buffer, temp, &nbytes, &curr_block);
-            if(unlikely(buffer == 0)) {
-                PRINT
-                printk("%s: Could not allocate Buffer for dev_read.\n", MODNAME);
-                up_read(&(tag_level -> rcu_lock));
-                up_read(&(tag_lock[i]));
-                kfree(temp);
-                kfree(divider);
-                return -1;
-            }
+    rcu_read_unlock();
 
-            kfree(temp);
+    return 0;
+}
 
-            up_read(&(tag_level -> rcu_lock));
 
-            // If reached the maximum bytes to be read, stop and send the message
-            // to the user buffer
-            if(nbytes > size + relative_off) { //*off) {
-                up_read(&(tag_lock[i]));
-                goto exit;
-            }
 
-        }
+static ssize_t dev_write(struct file* filp, const char* buf, size_t size, loff_t *off) {
+    PRINT
+    printk("%s: Write not permitted (Read-Only)\n", MODNAME);
+    return -1;
+}
 
-        // Append a divider between levels
-        buffer = append_buffer(buffer, divider, &nbytes, &curr_block);
-        if(unlikely(buffer == 0)) {
-            PRINT
-            printk("%s: Could not allocate Buffer for dev_read.\n", MODNAME);
-            up_read(&(tag_lock[i]));
-            kfree(divider);
-            return -1;
-        }
+// TAG_INFO_LATENCY: copy the latency histograms of a Tag (see struct tag_latency)
+static long latency_read(unsigned long param) {
+
+    struct tag_latency* lat;
+    tag_latency_t __percpu *latency;
+    tag_t* tag_entry;
+    int tag, i, j, cpu;
 
+    if(unlikely(get_user(tag, (int __user *) param) != 0)) return -EFAULT;
+    if(tag < 0 || tag >= MAX_TAGS) return -EINVAL;
 
-        up_read(&(tag_lock[i]));
+    lat = kzalloc(sizeof(struct tag_latency), GFP_KERNEL);
+    if(unlikely(lat == 0)) return -ENOMEM;
 
+    rcu_read_lock();
 
+    tag_entry = rcu_dereference(tags[tag]);
+    if(tag_entry == 0) {
+        rcu_read_unlock();
+        kfree(lat);
+        return -ENODATA;
     }
-    
-    exit: nop();
 
-    // Compute actual buffer interval to be delivered
+    // Per-CPU histograms summed as in stats_refresh(), all zeroes if the Tag has none yet (see latency_hist)
+    lat -> tag = tag;
+    latency = READ_ONCE(tag_entry -> latency);
+    if(latency != 0) {
+        for_each_possible_cpu(cpu) {
+            tag_latency_t* hist;
+            hist = per_cpu_ptr(latency, cpu);
+
+            for(i = 0; i < LEVELS; i++) {
+                for(j = 0; j < TAG_LAT_BUCKETS; j++) {
+                    lat -> level[i].wake[j] += READ_ONCE(hist -> level[i].wake[j]);
+                    lat -> level[i].blocked[j] += READ_ONCE(hist -> level[i].blocked[j]);
+                }
+            }
+        }
+    }
 
-    int tot_size;
-    tot_size = strlen(buffer);
+    rcu_read_unlock();
 
-    
-    
-    // In case the offset is greater than the total size, must return 0
-    if(tot_size <= relative_off) { //(*off)) {
-        kfree(divider);
-        vfree(buffer);
-        return 0;
+    if(unlikely(copy_to_user((void __user *) param, lat, sizeof(struct tag_latency)) != 0)) {
+        kfree(lat);
+        return -EFAULT;
     }
 
+    kfree(lat);
+    return 0;
+}
 
-    if(size > tot_size - relative_off) //(*off))
-        size = tot_size - relative_off; //(*off);    
+// TAG_INFO_LATENCY_RESET: zero the latency histograms of the Tag "param", or of all Tags if -1
+// (a sample added on another CPU while resetting may survive the reset)
+static long latency_reset(int tag) {
 
+    tag_latency_t __percpu *latency;
+    tag_t* tag_entry;
+    int i, cpu;
 
-    char* cpy_buffer;
-    cpy_buffer = buffer + relative_off; //(*off);
+    if(tag < -1 || tag >= MAX_TAGS) return -EINVAL;
 
-    if(unlikely(copy_to_user(buf, cpy_buffer, size) != 0)) {
-        PRINT
-        printk("%s: Error in copy_to_user()\n", MODNAME);
-        kfree(divider);
-        vfree(buffer);
-        return -1;
-    }
+    rcu_read_lock();
 
-    *off += size;
+    for(i = (tag == -1 ? 0 : tag); i < (tag == -1 ? MAX_TAGS : tag + 1); i++) {
+        tag_entry = rcu_dereference(tags[i]);
+        if(tag_entry == 0) continue;
 
-    kfree(divider);
-    vfree(buffer);
-    return size;
-}
+        latency = READ_ONCE(tag_entry -> latency);
+        if(latency == 0) continue;
 
+        for_each_possible_cpu(cpu) memset(per_cpu_ptr(latency, cpu), 0, sizeof(tag_latency_t));
+    }
 
+    rcu_read_unlock();
 
+    return 0;
+}
 
-static loff_t dev_llseek(struct file *filp, loff_t off, int whence)
-{
-  
-  loff_t newpos;
+// TAG_INFO_SNAPSHOT: copy a binary snapshot of the existing Tags in the user array (see tag_info_req)
+// Returns the number of entries filled, or a negative error code
+static long dev_ioctl(struct file* filp, unsigned int command, unsigned long param) {
 
-  switch(whence) {
-   case 0: /* SEEK_SET */ 
-    // This operation is needed to avoid re-opening the file to start reading from the beggining
-    newpos = off;
-    break;
+    struct tag_info_req req;
+    struct tag_info* info;
+    struct tag_info __user *buf;
+    unsigned int i;
+    int j, filled;
+
+    if(command == TAG_INFO_LATENCY) return latency_read(param);
+    if(command == TAG_INFO_LATENCY_RESET) return latency_reset((int) param);
+    if(command == TAG_INFO_PROFILE) return tag_prof_read((struct tag_profile __user *) param);
+    if(command == TAG_INFO_PROFILE_RESET) return tag_prof_reset();
+    if(command == TAG_INFO_MEMORY) return tag_memory_read((struct tag_info_memory __user *) param);
+    if(command == TAG_INFO_PUBLISH_START) return tag_publisher_start((struct tag_publisher __user *) param);
+    if(command == TAG_INFO_PUBLISH_STOP) return tag_publisher_stop((struct tag_publisher_stats __user *) param);
+
+    if(command != TAG_INFO_SNAPSHOT) {
+        PRINT
+        printk("%s: CTL command %u not permitted\n", MODNAME, command);
+        return -ENOTTY;
+    }
 
-   case 1: /* SEEK_CUR */
-    // The CUR should be made here instead of increasing the offset at every dev_read() 
-    break;
+    if(unlikely(copy_from_user(&req, (void __user *) param, sizeof(req)) != 0)) return -EFAULT;
 
-   case 2: /* SEEK_END */
-    // This operation should not be called
-    
-    return off;
-    break;
+    // A cursor past the last descriptor (a finished walk) fills nothing and stays where it is
+    if(req.start >= MAX_TAGS) {
+        req.count = 0;
+        if(unlikely(copy_to_user((void __user *) param, &req, sizeof(req)) != 0)) return -EFAULT;
+        return 0;
+    }
 
-   default: /* can't happen */
-    return -EINVAL;
-  }
-  if (newpos < 0) return -EINVAL;
-  filp->f_pos = newpos;
-  return newpos;
-}
+    buf = (struct tag_info __user *) (uintptr_t) req.buf;
+    filled = 0;
 
+    // A single entry is filled under RCU and then copied (copy_to_user may sleep on a fault)
+    info = kmalloc(sizeof(struct tag_info), GFP_KERNEL);
+    if(unlikely(info == 0)) {
+        PRINT
+        printk("%s: Could not allocate a temporal buffer\n", MODNAME);
+        return -ENOMEM;
+    }
 
+    for(i = req.start; i < MAX_TAGS && filled < req.count; i++) {
 
-static ssize_t dev_write(struct file* filp, const char* buf, size_t size, loff_t *off) {
-    PRINT
-    printk("%s: Write not permitted (Read-Only)\n", MODNAME);
-    return -1;
-}
+        tag_t* tag_entry;
 
-static long dev_ioctl(struct file* filp, unsigned int command, unsigned long param) {
-    PRINT
-    printk("%s: CTL not permitted\n", MODNAME);
-    return -1;
-}
+        // Read under RCU (see info_show), no lock shared with the system calls
+        rcu_read_lock();
+
+        tag_entry = rcu_dereference(tags[i]);
+        if(tag_entry == 0) {
+            rcu_read_unlock();
+            continue;
+        }
 
+        memset(info, 0, sizeof(struct tag_info));
+        info -> tag = i;
+        info -> key = tag_entry -> key;
+        info -> euid = tag_entry -> euid;
+        info -> permission = tag_entry -> permission;
+        info -> ready = READ_ONCE(tag_entry -> ready);
 
+        for(j = 0; j < LEVELS; j++) {
+            tag_level_t* tag_level;
 
-// Append the source to dest and free the source
-// If dest is not big enough, it will allocate a new buffer for dest and return it
-// It returns 0 in case the buffer could not be allocated
-static char* append_buffer(char* dest, char* source, int* nbytes, int* curr_block) {
-    
-    int temp_size;
-    temp_size = strlen(source);
-    
-    (*nbytes) += temp_size;
-
-    // If the resulting size is greater than the allocated one, allocate a new buffer
-    if(*nbytes > CHAR_BLOCK * (*curr_block)) {
-        // Inrease the current needed CHAR_BLOCK
-        (*curr_block)++;
-        
-        // Allocate a new Temp buffer
-        char __attribute__((aligned(PAGE_SIZE))) *temp_buff;
-        temp_buff = vzalloc(sizeof(char) * (CHAR_BLOCK * (*curr_block) + 1));
-        if(unlikely(temp_buff == 0)) {
-            vfree(dest);
-            return 0;
+            tag_level = rcu_dereference((tag_entry -> tag_level)[j]);
+            if(tag_level != 0) {
+                info -> levels |= 1U << j;
+                info -> level[j].waiting = atomic_read(&(tag_level -> waiting));
+                info -> level[j].epoch = READ_ONCE(tag_level -> epoch);
+                info -> level[j].ready = READ_ONCE(tag_level -> ready);
+            }
         }
 
-        // Coopy the content to the new Temporary buffer and free the other
-        strcpy(temp_buff, dest);
-        vfree(dest);
+        rcu_read_unlock();
 
-        // Make the old buffer point to the new, allocated level
-        dest = temp_buff;
+        if(unlikely(copy_to_user(buf + filled, info, sizeof(struct tag_info)) != 0)) {
+            kfree(info);
+            return -EFAULT;
+        }
+        filled++;
     }
 
-    // Append the new level information
-    dest = strncat(dest, source, temp_size);
-
-    
+    kfree(info);
 
-    return dest;
+    req.start = i;
+    req.count = filled;
+    if(unlikely(copy_to_user((void __user *) param, &req, sizeof(req)) != 0)) return -EFAULT;
 
+    return filled;
 }
-
@@ -1,9 +1,14 @@
 #include "module.h"
 
 
-#define CHAR_BLOCK  PAGE_SIZE                       // Size of the buffer used to read from the char device
+#include <linux/seq_file.h>
+
+
 #define LINE_SIZE 53                                // Size of a line in Char Device 
-#define TAG_SIZE ((LINE_SIZE + 1) * (LEVELS + 1))   // Size of a a complete Tag in Char Device
+#define TAG_RECORDS (LEVELS + 1)                    // Records (file positions) of a Tag in Char Device: levels + divider
+#define TAG_POS(tag) ((loff_t)(tag) * TAG_RECORDS + 1)  // Position of the first record of a Tag (0 is the header)
+#define POS_TAG(pos) ((int)(((pos) - 1) / TAG_RECORDS)) // Tag of a position
+#define POS_LEVEL(pos) ((int)(((pos) - 1) % TAG_RECORDS)) // Level of a position (LEVELS is the divider)
 
 void register_chardev(void);
 
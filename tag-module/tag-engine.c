@@ -0,0 +1,136 @@
+/**
+ *  @file   tag-engine.c
+ *  @brief  Userspace entry point of the Tag services (TEST_FUNC build, see tag-engine.h): same globals and
+ *          initialization of tag-module.c, without the system call installation, the char device and the statistics
+ *  @author Andrea Paci
+ */
+
+
+#include "module.h"
+#include "tag-engine.h"
+
+
+hashmap_t*           tag_table;
+bitmask_t*           tag_bitmask;
+tag_t**              tags;
+struct rw_semaphore  common_lock;
+struct rw_semaphore  tag_lock[MAX_TAGS];
+struct tag_status_page* tag_status;
+
+atomic_long_t tag_mem_tags            = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_levels          = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_epoch_levels    = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_retained        = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_latency         = ATOMIC_LONG_INIT(0);
+
+int latency_hist = 0;
+
+
+static int tag_compare(const void* a, const void* b, void* udata) {
+    return ((tag_table_entry_t *) a) -> key - ((tag_table_entry_t *) b) -> key;
+}
+
+static uint64_t tag_hash(const void *item, uint64_t seed0, uint64_t seed1 ) {
+    const tag_table_entry_t* entry = item;
+    return hashmap_sip( &(entry -> key), sizeof(int), seed0, seed1);
+}
+
+
+/**
+ *  @brief  Allocate the Tag table, the bitmask, the Tag pointers and the status page (as initialize() in tag-module.c)
+ *
+ *  @return 0 on success, -1 otherwise
+ */
+int tag_engine_init(void) {
+
+    int i;
+
+    tag_table = hashmap_new_with_flags(
+        0, 0, 0, sizeof(tag_table_entry_t),
+        HASHMAP_CAP, SEED0, SEED1,
+        tag_hash, tag_compare, 0, HASHMAP_FIXED_CAP);
+    if(tag_table == 0) return -1;
+
+    tag_bitmask = initialize_bitmask(MAX_TAGS);
+    if(tag_bitmask == 0) {
+        hashmap_free(tag_table);
+        tag_table = 0;
+        return -1;
+    }
+
+    tags = kzalloc(sizeof(tag_t*) * MAX_TAGS, GFP_KERNEL);
+    if(tags == 0) {
+        hashmap_free(tag_table);
+        tag_table = 0;
+        free_bitmask(tag_bitmask);
+        tag_bitmask = 0;
+        return -1;
+    }
+
+    tag_status = kzalloc(sizeof(struct tag_status_page), GFP_KERNEL);
+    if(tag_status == 0) {
+        hashmap_free(tag_table);
+        tag_table = 0;
+        free_bitmask(tag_bitmask);
+        tag_bitmask = 0;
+        kfree(tags);
+        tags = 0;
+        return -1;
+    }
+
+    init_rwsem(&common_lock);
+    for(i = 0; i < MAX_TAGS; i++)
+        init_rwsem(&(tag_lock[i]));
+
+    return 0;
+}
+
+/**
+ *  @brief  Free every Tag still existing and the common structures. No thread must be using the Tags
+ */
+void tag_engine_exit(void) {
+
+    int i;
+
+    if(tags != 0) {
+        for(i = 0; i < MAX_TAGS; i++) {
+            if(tags[i] != 0) {
+                clear_tag_level(tags[i] -> tag_level);
+                kfree(tags[i] -> tag_level);
+                clear_tag_retained(tags[i] -> retained);
+                free_percpu(tags[i] -> stats);
+                if(tags[i] -> latency != 0) {
+                    free_percpu(tags[i] -> latency);
+                    atomic_long_dec(&tag_mem_latency);
+                }
+                kfree(tags[i]);
+                atomic_long_dec(&tag_mem_tags);
+            }
+        }
+        kfree(tags);
+        tags = 0;
+    }
+
+    kfree(tag_status);
+    tag_status = 0;
+
+    if(tag_bitmask != 0) free_bitmask(tag_bitmask);
+    if(tag_table != 0) hashmap_free(tag_table);
+    tag_bitmask = 0;
+    tag_table = 0;
+}
+
+/**
+ *  @brief  Memory held by the Tags (as the TAG_INFO_MEMORY ioctl, per-CPU statistics counted once)
+ */
+void tag_engine_memory(struct tag_info_memory* mem) {
+
+    mem -> tags           = atomic_long_read(&tag_mem_tags);
+    mem -> levels         = atomic_long_read(&tag_mem_levels);
+    mem -> epoch_levels   = atomic_long_read(&tag_mem_epoch_levels);
+    mem -> tag_bytes      = mem -> tags * (sizeof(tag_t) + sizeof(tag_level_t*) * LEVELS + sizeof(tag_stats_t));
+    mem -> tag_bytes     += atomic_long_read(&tag_mem_latency) * sizeof(tag_latency_t);
+    mem -> level_bytes    = mem -> levels * sizeof(tag_level_t);
+    mem -> buffer_bytes   = mem -> levels * BUFFER_SIZE;
+    mem -> retained_bytes = atomic_long_read(&tag_mem_retained) * BUFFER_SIZE;
+}
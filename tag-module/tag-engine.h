@@ -0,0 +1,28 @@
+/**
+ *  @file   tag-engine.h
+ *  @brief  Userspace build of the Tag services (TEST_FUNC): tag-syscall.c compiled against tag-shim.h, plus the
+ *          initialization of tag-engine.c. The functions behave as the system calls, minus the copy from/to
+ *          userspace, so they can be benchmarked, profiled and fuzzed without loading the module
+ *  @author Andrea Paci
+ */
+
+#ifndef _TAG_ENGINE_H
+#define _TAG_ENGINE_H
+
+#include <stddef.h>
+#include "include/tag.h"
+
+int  tag_engine_init(void);
+void tag_engine_exit(void);
+void tag_engine_memory(struct tag_info_memory* mem);
+
+// Status page (as mapped from /dev/tag_info), updated by the functions below
+extern struct tag_status_page* tag_status;
+
+int tag_get(int key, int command, int permission);
+int tag_send(int tag, int level, char* buffer, size_t size, int* outcome);
+int tag_receive(int tag, int level, char* buffer, size_t size, int* epoch);
+int tag_ctl(int tag, int command);
+long tag_op(unsigned int op, struct tag_args* args);
+
+#endif
@@ -22,6 +22,7 @@ int tag_get_nr;
 int tag_send_nr;
 int tag_receive_nr;
 int tag_ctl_nr;
+int tag_op_nr;
 
 
 static int initialize(void);
@@ -38,16 +39,18 @@ uint64_t tag_hash(const void *item, uint64_t seed0, uint64_t seed1 ) {
 
 
 // params used to dynamically inject in the userspace header the
-// 4 system calls displacement value in the SC Table
+// system calls displacement value in the SC Table
 module_param(tag_get_nr,     int, S_IRUGO);
 module_param(tag_send_nr,    int, S_IRUGO);
 module_param(tag_receive_nr, int, S_IRUGO);
 module_param(tag_ctl_nr,     int, S_IRUGO);
+module_param(tag_op_nr,      int, S_IRUGO);
 
 MODULE_PARM_DESC(tag_get_nr,     "tag_get() system call number");
 MODULE_PARM_DESC(tag_send_nr,    "tag_send() system call number");
 MODULE_PARM_DESC(tag_receive_nr, "tag_receive() system call number");
 MODULE_PARM_DESC(tag_ctl_nr,     "tag_ctl() system call number");
+MODULE_PARM_DESC(tag_op_nr,      "tag_op() system call number (multiplexed entry of every operation)");
 
 
 int init_module(void) {
@@ -65,9 +68,26 @@ int init_module(void) {
         return -1;
     }
 
+    if(tag_stats_init() != 0) {
+        printk("%s: Error in initializing statistics\n", MODNAME);
+
+        kfree(tags);
+        tags = 0;
+
+        hashmap_free(tag_table);
+        tag_table = 0;
+
+        free_bitmask(tag_bitmask);
+        tag_bitmask = 0;
+
+        return -1;
+    }
+
     if(install_syscalls() == 0) {
         printk("%s: Error in installing system calls\n", MODNAME);
 
+        tag_stats_exit();
+
         kfree(tags);
         tags = 0;
 
@@ -91,10 +111,12 @@ int init_module(void) {
 static int initialize(void) {
 
     // Initialize TAG Table which maps "key" with "Tag Key" and the relative buffer
-    tag_table = hashmap_new_with_allocator(
+    // The table is fixed capacity: all the memory is allocated here, so no allocation
+    // ever happens while holding common_lock in tag_get/tag_ctl
+    tag_table = hashmap_new_with_flags(
         0, 0, 0, sizeof(tag_table_entry_t), 
         HASHMAP_CAP, SEED0, SEED1, 
-        tag_hash, tag_compare, 0);
+        tag_hash, tag_compare, 0, HASHMAP_FIXED_CAP);
     if(tag_table == 0) {
          printk("%s: Error in creating TAG table\n", MODNAME);
          return -1;
@@ -155,6 +177,12 @@ void cleanup_module(void) {
     printk("%s: Unmounting.\n", MODNAME);
     
     unregister_chardev();
+
+    // The publisher sends on the Tags, stop it before freeing them
+    tag_publisher_exit();
+
+    // The statistics refresh reads the Tags, stop it before freeing them
+    tag_stats_exit();
     
     // Check if address memory of the subsequent variable is avaliable to be freed or not
     // (Using kfree() on an unitialized address will result in not being able to unload the module)
@@ -170,6 +198,9 @@ void cleanup_module(void) {
             if(tags[i] != 0) {
                 clear_tag_level(tags[i] -> tag_level);
                 kfree(tags[i] -> tag_level);
+                clear_tag_retained(tags[i] -> retained);
+                free_percpu(tags[i] -> stats);
+                free_percpu(tags[i] -> latency);
                 kfree(tags[i]);
             }
         }
@@ -177,5 +208,7 @@ void cleanup_module(void) {
         kfree(tags);
     }
 
+    // Wait for the Tags and levels still queued for an RCU free (the callbacks are in this module)
+    rcu_barrier();
     
 }
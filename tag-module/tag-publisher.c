@@ -0,0 +1,201 @@
+/**
+ *  @file   tag-publisher.c
+ *  @brief  In-kernel periodic publisher (cyclictest alike): a SCHED_FIFO kernel thread sleeps on an absolute hrtimer
+ *          deadline and sends a struct tag_publish_msg through tag_send_kernel(), so that the latency measured by
+ *          the receivers doesn't include the scheduling of a userspace sender (see TAG_INFO_PUBLISH_START in include/tag.h)
+ *  @author Andrea Paci
+ */
+
+
+#include "module.h"
+
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
+#include <uapi/linux/sched/types.h>
+#endif
+
+
+#define PUBLISH_MIN_PERIOD_NS   10000
+
+
+static DEFINE_MUTEX(publisher_mutex);           // Serialize start and stop
+static struct task_struct* publisher_task;      // Running publisher (0 if none)
+static struct tag_publisher publisher_conf;
+static struct tag_publisher_stats publisher_stats;  // Written only by the publisher, read once it's stopped
+
+
+static int publisher_thread(void* data);
+
+
+/**
+ *  @brief  Start the publisher (TAG_INFO_PUBLISH_START)
+ *
+ *  @return 0 on success, -EBUSY if a publisher is already running, negative error codes otherwise
+ */
+long tag_publisher_start(struct tag_publisher __user *buf) {
+
+    struct tag_publisher conf;
+    struct task_struct* task;
+
+    if(current_euid().val != 0) return -EPERM;
+
+    if(unlikely(copy_from_user(&conf, buf, sizeof(conf)) != 0)) return -EFAULT;
+
+    if(conf.tag < 0 || conf.tag >= MAX_TAGS || conf.level < 0 || conf.level >= LEVELS ||
+       conf.period_ns < PUBLISH_MIN_PERIOD_NS || conf.cpu < -1 || conf.cpu >= (int) nr_cpu_ids ||
+       (conf.cpu >= 0 && !cpu_online(conf.cpu))) {
+        PRINT
+        printk("%s: PUBLISH: Wrong parameter usage\n", MODNAME);
+        return -EINVAL;
+    }
+
+    mutex_lock(&publisher_mutex);
+
+    if(publisher_task != 0) {
+        mutex_unlock(&publisher_mutex);
+        return -EBUSY;
+    }
+
+    publisher_conf = conf;
+    memset(&publisher_stats, 0, sizeof(publisher_stats));
+
+    task = kthread_create(publisher_thread, 0, "tag_publisher");
+    if(IS_ERR(task)) {
+        mutex_unlock(&publisher_mutex);
+        printk("%s: Error in creating the publisher thread\n", MODNAME);
+        return PTR_ERR(task);
+    }
+
+    if(conf.cpu >= 0) kthread_bind(task, conf.cpu);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    sched_set_fifo(task);
+#else
+    {
+        struct sched_param param = { .sched_priority = MAX_RT_PRIO / 2 };
+        sched_setscheduler_nocheck(task, SCHED_FIFO, &param);
+    }
+#endif
+
+    publisher_task = task;
+    wake_up_process(task);
+
+    mutex_unlock(&publisher_mutex);
+
+    PRINT
+    printk("%s: Publisher started on Tag %d level %d every %llu ns\n", MODNAME, conf.tag, conf.level, conf.period_ns);
+
+    return 0;
+}
+
+/**
+ *  @brief  Stop the publisher (TAG_INFO_PUBLISH_STOP) and copy the counters of the run in "buf" (if not NULL)
+ *
+ *  @return 0 on success, -ESRCH if no publisher was started, negative error codes otherwise
+ */
+long tag_publisher_stop(struct tag_publisher_stats __user *buf) {
+
+    struct tag_publisher_stats stats;
+
+    if(current_euid().val != 0) return -EPERM;
+
+    mutex_lock(&publisher_mutex);
+
+    if(publisher_task == 0) {
+        mutex_unlock(&publisher_mutex);
+        return -ESRCH;
+    }
+
+    kthread_stop(publisher_task);
+    publisher_task = 0;
+    stats = publisher_stats;
+
+    mutex_unlock(&publisher_mutex);
+
+    if(buf != 0 && unlikely(copy_to_user(buf, &stats, sizeof(stats)) != 0)) return -EFAULT;
+
+    return 0;
+}
+
+/**
+ *  @brief  Stop the publisher, if any. Must be called before freeing the Tags
+ */
+void tag_publisher_exit(void) {
+
+    mutex_lock(&publisher_mutex);
+
+    if(publisher_task != 0) kthread_stop(publisher_task);
+    publisher_task = 0;
+
+    mutex_unlock(&publisher_mutex);
+}
+
+
+/**
+ *  @brief  Body of the publisher: one message per deadline. Deadlines already passed when a tick ends are skipped
+ *          (counted as overruns, the sequence number still advances) instead of being published late in a burst
+ */
+static int publisher_thread(void* data) {
+
+    struct tag_publish_msg msg;
+    ktime_t deadline;
+    u64 period, now, missed;
+    int ret, outcome;
+
+    period = publisher_conf.period_ns;
+    msg.seq = 0;
+    deadline = ktime_add_ns(ktime_get(), period);
+
+    while(!kthread_should_stop()) {
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        schedule_hrtimeout_range(&deadline, 0, HRTIMER_MODE_ABS);
+        if(kthread_should_stop()) break;
+
+        now = ktime_get_ns();
+        if(now < ktime_to_ns(deadline)) continue;
+
+        if(now - ktime_to_ns(deadline) > publisher_stats.timer_max_ns)
+            publisher_stats.timer_max_ns = now - ktime_to_ns(deadline);
+
+        msg.expected_ns = ktime_to_ns(deadline);
+        msg.publish_ns = ktime_get_ns();
+        ret = tag_send_kernel(publisher_conf.tag, publisher_conf.level, (const char *) &msg, sizeof(msg), &outcome);
+
+        publisher_stats.ticks++;
+        if(ret == 1) publisher_stats.delivered++;
+        else if(ret == 0) publisher_stats.dropped++;
+        else {
+            PRINT
+            printk("%s: Publisher stopped, tag_send returned %d\n", MODNAME, ret);
+            publisher_stats.error = ret;
+            break;
+        }
+
+        if(publisher_conf.count != 0 && publisher_stats.ticks >= publisher_conf.count) break;
+
+        msg.seq++;
+        deadline = ktime_add_ns(deadline, period);
+
+        now = ktime_get_ns();
+        if(now > ktime_to_ns(deadline)) {
+            missed = div64_u64(now - ktime_to_ns(deadline), period) + 1;
+            publisher_stats.overruns += missed;
+            msg.seq += missed;
+            deadline = ktime_add_ns(deadline, missed * period);
+        }
+    }
+
+    // Done by itself: the thread must still be alive for kthread_stop()
+    set_current_state(TASK_INTERRUPTIBLE);
+    while(!kthread_should_stop()) {
+        schedule();
+        set_current_state(TASK_INTERRUPTIBLE);
+    }
+    __set_current_state(TASK_RUNNING);
+
+    return 0;
+}
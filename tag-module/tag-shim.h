@@ -0,0 +1,222 @@
+/**
+ *  @file   tag-shim.h
+ *  @brief  Userspace replacement of the kernel API used by the Tag services, included by module.h in the TEST_FUNC build
+ *          so that tag-syscall.c runs as a plain process (see tag-engine.c):
+ *              - rw_semaphore -> pthread_rwlock, mutex -> pthread_mutex
+ *              - wait queues  -> futex on a sequence number bumped by every wake up
+ *              - kzalloc      -> calloc, per-CPU data -> a single copy updated with atomics
+ *              - copy_*_user  -> memcpy
+ *          The RCU frees run immediately since the only RCU readers (char device and statistics) are not part of this build
+ *  @author Andrea Paci
+ */
+
+#ifndef _TAG_SHIM_H
+#define _TAG_SHIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+#define likely(x)       __builtin_expect(!!(x), 1)
+#define unlikely(x)     __builtin_expect(!!(x), 0)
+
+#define __user
+#define __percpu
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
+
+#define printk(...)     printf(__VA_ARGS__)
+
+#define min(a, b)       ((a) < (b) ? (a) : (b))
+#define ilog2(n)        (63 - __builtin_clzll(n))
+
+#define container_of(ptr, type, member) ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+
+
+// Memory
+
+#define GFP_KERNEL 0
+
+static inline void* kzalloc(size_t size, int flags) { return calloc(1, size); }
+static inline void kfree(const void* obj) { free((void *) obj); }
+#define kvzalloc(size, flags)       kzalloc((size), (flags))
+#define kvfree(obj)                 kfree(obj)
+
+#define copy_from_user(to, from, n) (memcpy((to), (from), (n)), 0)
+#define copy_to_user(to, from, n)   (memcpy((to), (from), (n)), 0)
+
+// A single copy shared by all the threads
+#define alloc_percpu(type)          ((type *) calloc(1, sizeof(type)))
+#define free_percpu(ptr)            free(ptr)
+#define this_cpu_add(var, val)      __atomic_fetch_add(&(var), (val), __ATOMIC_RELAXED)
+#define this_cpu_inc(var)           this_cpu_add(var, 1)
+
+
+
+// Atomics
+
+typedef struct { int counter; } atomic_t;
+typedef struct { long counter; } atomic_long_t;
+
+#define ATOMIC_LONG_INIT(i) { (i) }
+
+static inline int  atomic_read(atomic_t* v) { return __atomic_load_n(&(v -> counter), __ATOMIC_SEQ_CST); }
+static inline void atomic_set(atomic_t* v, int i) { __atomic_store_n(&(v -> counter), i, __ATOMIC_SEQ_CST); }
+static inline void atomic_inc(atomic_t* v) { __atomic_fetch_add(&(v -> counter), 1, __ATOMIC_SEQ_CST); }
+static inline void atomic_dec(atomic_t* v) { __atomic_fetch_sub(&(v -> counter), 1, __ATOMIC_SEQ_CST); }
+static inline int  atomic_inc_return(atomic_t* v) { return __atomic_add_fetch(&(v -> counter), 1, __ATOMIC_SEQ_CST); }
+static inline int  atomic_dec_and_test(atomic_t* v) { return __atomic_sub_fetch(&(v -> counter), 1, __ATOMIC_SEQ_CST) == 0; }
+
+
+static inline long atomic_long_read(atomic_long_t* v) { return __atomic_load_n(&(v -> counter), __ATOMIC_RELAXED); }
+static inline void atomic_long_inc(atomic_long_t* v) { __atomic_fetch_add(&(v -> counter), 1, __ATOMIC_RELAXED); }
+static inline void atomic_long_dec(atomic_long_t* v) { __atomic_fetch_sub(&(v -> counter), 1, __ATOMIC_RELAXED); }
+
+
+
+// Locks (a userspace thread can't be killed or interrupted while waiting, so the _killable/_interruptible never fail)
+
+struct rw_semaphore { pthread_rwlock_t lock; };
+struct mutex { pthread_mutex_t lock; };
+
+#define init_rwsem(sem)                 pthread_rwlock_init(&((sem) -> lock), 0)
+#define down_read(sem)                  pthread_rwlock_rdlock(&((sem) -> lock))
+#define down_read_interruptible(sem)    (pthread_rwlock_rdlock(&((sem) -> lock)), 0)
+#define down_write_killable(sem)        (pthread_rwlock_wrlock(&((sem) -> lock)), 0)
+#define down_write_trylock(sem)         (pthread_rwlock_trywrlock(&((sem) -> lock)) == 0)
+#define up_read(sem)                    pthread_rwlock_unlock(&((sem) -> lock))
+#define up_write(sem)                   pthread_rwlock_unlock(&((sem) -> lock))
+
+#define mutex_init(m)                   pthread_mutex_init(&((m) -> lock), 0)
+#define mutex_trylock(m)                (pthread_mutex_trylock(&((m) -> lock)) == 0)
+#define mutex_unlock(m)                 pthread_mutex_unlock(&((m) -> lock))
+
+#define schedule()                      sched_yield()
+
+// Lockdep is not part of this build
+struct lock_class_key { int unused; };
+#define lockdep_set_class(lock, key)    ((void) (key))
+
+// Busy-polling: a userspace thread is preempted by itself and is never signalled while in a Tag function
+#define cpu_relax()                     __builtin_ia32_pause()
+#define need_resched()                  0
+#define signal_pending(task)            0
+#define current                         0
+
+
+
+// Wait queues: waiters sleep on the sequence number read before checking the condition, so a wake up
+// happening in between makes the futex wait return immediately. Waiters on several queues sleep on a
+// sequence number bumped by the wake up of any queue
+
+typedef struct { u32 seq; } wait_queue_head_t;
+struct wait_queue_entry { int unused; };
+
+static u32 wait_multi_seq;
+static u32 wait_multi_waiters;
+
+#define init_waitqueue_head(wq)         ((wq) -> seq = 0)
+
+static inline void wake_up_all(wait_queue_head_t* wq) {
+    __atomic_add_fetch(&(wq -> seq), 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &(wq -> seq), FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+    __atomic_add_fetch(&wait_multi_seq, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&wait_multi_waiters, __ATOMIC_SEQ_CST) != 0)
+        syscall(SYS_futex, &wait_multi_seq, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+}
+
+#define wait_event_interruptible(wq, condition)                                         \
+({                                                                                      \
+    u32 __seq;                                                                          \
+    for(;;) {                                                                           \
+        __seq = __atomic_load_n(&((wq).seq), __ATOMIC_SEQ_CST);                         \
+        if(condition) break;                                                            \
+        syscall(SYS_futex, &((wq).seq), FUTEX_WAIT_PRIVATE, __seq, 0, 0, 0);            \
+    }                                                                                   \
+    0;                                                                                  \
+})
+
+#define wait_event_interruptible_multi(wq, n, entries, condition)                       \
+({                                                                                      \
+    u32 __seq;                                                                          \
+    (void) (wq)[(n) - 1]; /* The queues share wait_multi_seq */                         \
+    (void) (entries);                                                                   \
+    __atomic_add_fetch(&wait_multi_waiters, 1, __ATOMIC_SEQ_CST);                       \
+    for(;;) {                                                                           \
+        __seq = __atomic_load_n(&wait_multi_seq, __ATOMIC_SEQ_CST);                     \
+        if(condition) break;                                                            \
+        syscall(SYS_futex, &wait_multi_seq, FUTEX_WAIT_PRIVATE, __seq, 0, 0, 0);        \
+    }                                                                                   \
+    __atomic_sub_fetch(&wait_multi_waiters, 1, __ATOMIC_SEQ_CST);                       \
+    0;                                                                                  \
+})
+
+
+
+// RCU
+
+struct rcu_head {
+    struct rcu_head* next;
+    void (*func)(struct rcu_head* head);
+};
+
+#define WRITE_ONCE(x, val)              __atomic_store_n(&(x), (val), __ATOMIC_RELAXED)
+#define READ_ONCE(x)                    __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define smp_wmb()                       __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_store_release(p, v)         __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define cmpxchg(ptr, old, new)          __sync_val_compare_and_swap((ptr), (old), (new))
+
+#define rcu_assign_pointer(p, v)        __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcu_dereference(p)              __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_read_lock()                 do { } while(0)
+#define rcu_read_unlock()               do { } while(0)
+#define call_rcu(head, func)            (func)(head)
+
+
+
+// Misc
+
+typedef struct { uid_t val; } kuid_t;
+
+#define current_euid()                  ((kuid_t){ .val = geteuid() })
+
+static inline u64 ktime_get_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Tracepoints are not compiled in (the arguments are still evaluated, as they are used only by the tracepoint)
+static inline void trace_none(int unused, ...) { }
+
+#define trace_tag_get(...)              trace_none(0, __VA_ARGS__)
+#define trace_tag_send(...)             trace_none(0, __VA_ARGS__)
+#define trace_tag_receive_enter(...)    trace_none(0, __VA_ARGS__)
+#define trace_tag_receive_wake(...)     trace_none(0, __VA_ARGS__)
+#define trace_tag_receive_exit(...)     trace_none(0, __VA_ARGS__)
+#define trace_tag_ctl(...)              trace_none(0, __VA_ARGS__)
+
+#define array_index_nospec(index, size) (index)
+
+#define sort(base, num, size, cmp, swap) qsort((base), (num), (size), (cmp))
+
+#endif
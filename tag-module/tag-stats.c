@@ -0,0 +1,297 @@
+/**
+ *  @file   tag-stats.c
+ *  @brief  Source code for the statistics of the Tag services: the system calls update per-CPU counters
+ *          (see TAG_STAT_ADD), and a periodic work sums them in a page (struct tag_stats_page in include/tag.h)
+ *          that userspace maps read-only from the char device. The work runs only while the page is mapped,
+ *          since summing every Tag on every CPU is costly and pulls the counters away from the CPUs updating
+ *          them. It also holds the status page (struct tag_status_page), which the system calls update directly
+ *  @author Andrea Paci
+ */
+
+
+#include "module.h"
+
+
+atomic_long_t tag_mem_tags            = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_levels          = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_epoch_levels    = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_retained        = ATOMIC_LONG_INIT(0);
+atomic_long_t tag_mem_latency         = ATOMIC_LONG_INIT(0);
+
+// Latency histograms cost sizeof(tag_latency_t) per CPU on each Tag, so they're allocated only while enabled
+int latency_hist = 0;
+module_param(latency_hist, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(latency_hist, "Record the latency histograms of TAG_INFO_LATENCY (1) or not (0)");
+
+struct tag_status_page* tag_status;
+
+static struct tag_stats_page* stats_page;
+static struct delayed_work stats_work;
+static atomic_t stats_mappings = ATOMIC_INIT(0);
+
+static unsigned int stats_period_ms = 100;
+module_param(stats_period_ms, uint, S_IRUGO);
+MODULE_PARM_DESC(stats_period_ms, "Refresh period of the statistics page while mapped (ms)");
+
+
+static void stats_refresh(struct work_struct* work);
+
+
+// Seqcount on an entry of the shared page. The refresh work is the only writer
+static __always_inline void stats_write_begin(struct tag_stats_entry* entry) {
+    WRITE_ONCE(entry -> seq, entry -> seq + 1);
+    smp_wmb();
+}
+
+static __always_inline void stats_write_end(struct tag_stats_entry* entry) {
+    smp_wmb();
+    WRITE_ONCE(entry -> seq, entry -> seq + 1);
+}
+
+
+/**
+ *  @brief  Allocate the statistics page and start the refresh work
+ *
+ *  @return 0 on success, -ENOMEM otherwise
+ */
+int tag_stats_init(void) {
+
+    int i;
+
+    if(stats_period_ms == 0) stats_period_ms = 1;
+
+    stats_page = vmalloc_user(TAG_STATS_SIZE);
+    if(unlikely(stats_page == 0)) {
+        printk("%s: Error in allocating the statistics page\n", MODNAME);
+        return -ENOMEM;
+    }
+
+    tag_status = vmalloc_user(TAG_STATUS_SIZE);
+    if(unlikely(tag_status == 0)) {
+        printk("%s: Error in allocating the status page\n", MODNAME);
+        vfree(stats_page);
+        stats_page = 0;
+        return -ENOMEM;
+    }
+
+    stats_page -> period_us = stats_period_ms * 1000;
+    for(i = 0; i < MAX_TAGS; i++) stats_page -> tag[i].tag = -1;
+
+    INIT_DELAYED_WORK(&stats_work, stats_refresh);
+
+    return 0;
+}
+
+/**
+ *  @brief  Stop the refresh work and free the statistics page. Must be called before freeing the Tags
+ *          (the device, and so any mapping of the page, is already gone)
+ */
+void tag_stats_exit(void) {
+
+    if(stats_page == 0) return;
+
+    cancel_delayed_work_sync(&stats_work);
+    vfree(stats_page);
+    stats_page = 0;
+    vfree(tag_status);
+    tag_status = 0;
+}
+
+// Mappings of the statistics page (also the copies made by fork() and by splitting a mapping), the first one
+// starts the refresh work at once, which stops by itself after the last one is gone
+static void stats_vma_open(struct vm_area_struct* vma) {
+    if(atomic_inc_return(&stats_mappings) == 1) mod_delayed_work(system_wq, &stats_work, 0);
+}
+
+static void stats_vma_close(struct vm_area_struct* vma) {
+    atomic_dec(&stats_mappings);
+}
+
+static const struct vm_operations_struct stats_vm_ops = {
+    .open   = stats_vma_open,
+    .close  = stats_vma_close,
+};
+
+/**
+ *  @brief  Map the statistics page or, at offset TAG_STATUS_OFFSET, the status page (read-only)
+ */
+int tag_stats_mmap(struct file* filp, struct vm_area_struct* vma) {
+
+    int ret;
+
+    if(vma -> vm_flags & VM_WRITE) return -EPERM;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma -> vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    if(vma -> vm_pgoff >= (TAG_STATUS_OFFSET >> PAGE_SHIFT))
+        return remap_vmalloc_range(vma, tag_status, vma -> vm_pgoff - (TAG_STATUS_OFFSET >> PAGE_SHIFT));
+
+    ret = remap_vmalloc_range(vma, stats_page, vma -> vm_pgoff);
+    if(ret != 0) return ret;
+
+    // .open is not called for the mapping being created
+    vma -> vm_ops = &stats_vm_ops;
+    stats_vma_open(vma);
+
+    return 0;
+}
+
+
+/**
+ *  @brief  Sum the per-CPU counters of every Tag in the statistics page
+ *          The Tags are read under RCU, so the refresh never contends with the system calls
+ *          Runs again after stats_period_ms while the page is mapped
+ */
+static void stats_refresh(struct work_struct* work) {
+
+    int i, j, cpu;
+
+    for(i = 0; i < MAX_TAGS; i++) {
+
+        struct tag_stats_entry* entry;
+        tag_t* tag_entry;
+
+        entry = &(stats_page -> tag[i]);
+
+        rcu_read_lock();
+        tag_entry = rcu_dereference(tags[i]);
+
+        if(tag_entry == 0) {
+            rcu_read_unlock();
+            // Deleted Tag: reset its counters
+            if(entry -> tag != -1) {
+                stats_write_begin(entry);
+                entry -> tag = -1;
+                entry -> awake_alls = 0;
+                memset(entry -> level, 0, sizeof(entry -> level));
+                stats_write_end(entry);
+            }
+            continue;
+        }
+
+        stats_write_begin(entry);
+
+        entry -> tag = i;
+        entry -> awake_alls = 0;
+        memset(entry -> level, 0, sizeof(entry -> level));
+
+        for_each_possible_cpu(cpu) {
+            tag_stats_t* stats;
+            stats = per_cpu_ptr(tag_entry -> stats, cpu);
+
+            entry -> awake_alls += READ_ONCE(stats -> awake_alls);
+            for(j = 0; j < LEVELS; j++) {
+                entry -> level[j].sends     += READ_ONCE(stats -> level[j].sends);
+                entry -> level[j].dropped   += READ_ONCE(stats -> level[j].dropped);
+                entry -> level[j].receives  += READ_ONCE(stats -> level[j].receives);
+                entry -> level[j].wakeups   += READ_ONCE(stats -> level[j].wakeups);
+                entry -> level[j].bytes     += READ_ONCE(stats -> level[j].bytes);
+                entry -> level[j].rollovers += READ_ONCE(stats -> level[j].rollovers);
+            }
+        }
+
+        stats_write_end(entry);
+
+        rcu_read_unlock();
+    }
+
+    WRITE_ONCE(stats_page -> refreshes, stats_page -> refreshes + 1);
+
+    // A mapping made from now on queues the work again (see stats_vma_open)
+    if(atomic_read(&stats_mappings) > 0) schedule_delayed_work(&stats_work, msecs_to_jiffies(stats_period_ms));
+}
+
+
+/**
+ *  @brief  Copy the memory held by the Tags to the user (see struct tag_info_memory)
+ *
+ *  @return 0 on success, -EFAULT otherwise
+ */
+long tag_memory_read(struct tag_info_memory __user *buf) {
+
+    struct tag_info_memory mem;
+    u64 tag_size;
+
+    mem.tags            = atomic_long_read(&tag_mem_tags);
+    mem.levels          = atomic_long_read(&tag_mem_levels);
+    mem.epoch_levels    = atomic_long_read(&tag_mem_epoch_levels);
+
+    tag_size = sizeof(tag_t) + sizeof(tag_level_t*) * LEVELS + sizeof(tag_stats_t) * num_possible_cpus();
+    mem.tag_bytes       = mem.tags * tag_size;
+    mem.tag_bytes      += atomic_long_read(&tag_mem_latency) * sizeof(tag_latency_t) * num_possible_cpus();
+    mem.level_bytes     = mem.levels * sizeof(tag_level_t);
+    mem.buffer_bytes    = mem.levels * BUFFER_SIZE;
+    mem.retained_bytes  = atomic_long_read(&tag_mem_retained) * BUFFER_SIZE;
+
+    if(unlikely(copy_to_user(buf, &mem, sizeof(mem)) != 0)) return -EFAULT;
+
+    return 0;
+}
+
+
+
+#ifdef PROFILE
+
+DEFINE_PER_CPU(struct tag_profile, tag_prof);
+
+/**
+ *  @brief  Copy the per-phase cycles (summed over the CPUs) to the user
+ *
+ *  @return 0 on success, -ENOMEM or -EFAULT otherwise
+ */
+long tag_prof_read(struct tag_profile __user *buf) {
+
+    struct tag_profile* prof;
+    int cpu, i;
+
+    prof = kzalloc(sizeof(struct tag_profile), GFP_KERNEL);
+    if(unlikely(prof == 0)) return -ENOMEM;
+
+    for_each_possible_cpu(cpu) {
+        struct tag_profile* cpu_prof;
+        cpu_prof = per_cpu_ptr(&tag_prof, cpu);
+
+        for(i = 0; i < TAG_PROF_PHASES; i++) {
+            prof -> phase[i].count  += READ_ONCE(cpu_prof -> phase[i].count);
+            prof -> phase[i].cycles += READ_ONCE(cpu_prof -> phase[i].cycles);
+            prof -> phase[i].max     = max(prof -> phase[i].max, READ_ONCE(cpu_prof -> phase[i].max));
+        }
+    }
+
+    if(unlikely(copy_to_user(buf, prof, sizeof(struct tag_profile)) != 0)) {
+        kfree(prof);
+        return -EFAULT;
+    }
+
+    kfree(prof);
+    return 0;
+}
+
+/**
+ *  @brief  Zero the per-phase cycles (a syscall running meanwhile may add a sample to the old values)
+ */
+long tag_prof_reset(void) {
+
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(&tag_prof, cpu), 0, sizeof(struct tag_profile));
+
+    return 0;
+}
+
+#else
+
+long tag_prof_read(struct tag_profile __user *buf) {
+    return -EOPNOTSUPP;
+}
+
+long tag_prof_reset(void) {
+    return -EOPNOTSUPP;
+}
+
+#endif
@@ -5,16 +5,20 @@
  */ 
 
 
+#ifndef TEST_FUNC
 #include <linux/rwsem.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#endif
 #include "include/tag.h"
 
 #define SEED0 401861
 #define SEED1 879023
-#define HASHMAP_CAP MAX_TAGS * 2
+#define HASHMAP_CAP MAX_TAGS      // Fixed capacity of the Tag table (allocated for a 50% load)
 
-#define BUFFER_SIZE 4096
-#define LEVELS      32
-#define MAX_TAGS    256
+#define BUFFER_SIZE TAG_INFO_MSG
+#define LEVELS      TAG_INFO_LEVELS
+#define MAX_TAGS    TAG_INFO_TAGS
 
 #define CHECKPERM(tag_entry) (tag_entry -> permission == TAG_PERM_USR && current_euid().val != 0 && tag_entry -> euid != current_euid().val)
 
@@ -30,6 +34,8 @@ typedef struct tag_level_struct {
     size_t size;            // Size of the message
     int ready;              // Signal wether the tag level is occupied in a Tag Send (1) or not (0)
     int epoch;              // Level Epoch (RCU alike)
+    u64 publish_ns;         // Time the last message got published (ready set to 1)
+    u32 seq;                // Sequence of the message (level_seq of the status page)
     atomic_t waiting __attribute__((aligned (64)));       // Number of waiting receiving thread on this level
     wait_queue_head_t       /* Wait Queue for receiving thread waiting for the message delivery */
             local_wq;
@@ -38,9 +44,33 @@ typedef struct tag_level_struct {
     struct mutex w_mutex;   // Mutex used to block concurrent send   
     // Buffer for message exchange
     char __attribute__((aligned(PAGE_SIZE))) *buffer;                   
+    struct rcu_head rcu;    // Used to free the level after the monitoring readers (RCU) are done with it
     
 } tag_level_t;
 
+// Latency histograms of every level of a Tag on a CPU (see struct tag_latency_level). The buckets are 32 bit
+// to halve the per-CPU footprint, TAG_INFO_LATENCY sums them in 64 bit counters
+typedef struct tag_latency_struct {
+    struct {
+        u32 wake[TAG_LAT_BUCKETS];
+        u32 blocked[TAG_LAT_BUCKETS];
+    } level[LEVELS];
+} tag_latency_t;
+
+// Per-CPU counters of a Tag Service (summed in the statistics page, see tag-stats.c)
+typedef struct tag_stats_struct {
+    u64 awake_alls;
+    struct tag_stats_level level[LEVELS];
+} tag_stats_t;
+
+// Last message of a level of a TAG_RETAIN Tag
+typedef struct tag_retained_struct {
+    struct rw_semaphore lock;   // Taken in write by the senders, in read by the receivers copying the message
+    u32 seq;                    // Sequence of the message (0 if none)
+    size_t size;                // Size of the message
+    char* buffer;               // Allocated by the first message
+} tag_retained_t;
+
 // Struct used to describe a single Tag Service entry
 typedef struct tag_struct {
     int key;                    // Key used to create the Tag               
@@ -49,6 +79,10 @@ typedef struct tag_struct {
     int permission;             // Indicates if the Tag can be accessed by all user or only by the user who created the tag
     uid_t euid;                 // Effective User ID related to the task calling the system call
     tag_level_t** tag_level;    // List of pointers to the various levels
+    tag_stats_t __percpu *stats;    // Per-CPU counters
+    tag_latency_t __percpu *latency;    // Per-CPU latency histograms, 0 until the first sample with latency_hist set
+    tag_retained_t* retained;   // Last message of each level (TAG_RETAIN), 0 otherwise
+    struct rcu_head rcu;        // Used to free the Tag after the monitoring readers (RCU) are done with it
     atomic_t waiting __attribute__((aligned (64)));           // Number of Receiving thread on this Tag
     struct rw_semaphore         /* RW Semaphore to syncronize access to the pointer list of levels */
         level_lock[LEVELS]; 
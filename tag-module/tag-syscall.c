@@ -7,18 +7,112 @@
 
 #include "module.h"
 
+#ifndef TEST_FUNC
+#define CREATE_TRACE_POINTS
+#include "tag-trace.h"
+#endif
+
+#ifdef PROFILE
+#include "../utils/include/common.h"
+#endif
+
 static int  add_tag_level(tag_level_t** tag_level);
 static tag_level_t* create_level(int i, int epoch);
 static int clear_tag_common(int key, int tag_key);
+static int tag_send_common(int tag, int level, char* buffer, size_t size, int kernel, int* outcome);
+static int tag_receive_common(struct tag_args* args, int* epoch);
+static int receive_enter(int tag, tag_t* tag_entry, int level, tag_level_t** entered);
+static int receive_exit(int tag, tag_t* tag_entry, int level, tag_level_t* tag_level);
+static int receive_leave(int tag, tag_t* tag_entry, int level, tag_level_t* tag_level);
+static int tag_receive_any(struct tag_args* args, int* epoch);
+static int tag_wait_multi(struct tag_args* args, int* epoch);
+static long retain_store(int tag, tag_t* tag_entry, int level, char* buffer, size_t size, int kernel);
+static int retain_fetch(tag_t* tag_entry, int level, char* buffer, size_t size, __u64* seq);
 __always_inline static void free_level(tag_level_t* tag_level);
-static void print_tag(void);
-static void print_level(tag_level_t* tag_level, int tag);
+static void free_level_rcu(struct rcu_head* head);
+static void free_tag_rcu(struct rcu_head* head);
+
+// Lockdep class of the rcu_lock of each level: tag_receive_any() holds the rcu_lock of up to LEVELS levels of a Tag
+// (taken in increasing level order), which with a single class would be reported as recursive locking
+static struct lock_class_key rcu_lock_key[LEVELS];
+
+
+// Waiting counters of a Tag and of a level, mirrored in the status page: the mirror is raised before
+// the counter and lowered after it, so a reader of the page never sees 0 while the counter is not
+static __always_inline void tag_waiting_inc(tag_t* tag_entry) {
+    TAG_STATUS_INC(TAG_STATUS(tag_entry -> tag_key) -> waiting);
+    atomic_inc(&(tag_entry -> waiting));
+}
+
+static __always_inline void tag_waiting_dec(tag_t* tag_entry) {
+    if(atomic_dec_and_test(&(tag_entry -> waiting))) {
+        tag_entry -> ready = 0;
+        WRITE_ONCE(TAG_STATUS(tag_entry -> tag_key) -> ready, 0);
+    }
+    TAG_STATUS_DEC(TAG_STATUS(tag_entry -> tag_key) -> waiting);
+}
+
+static __always_inline void level_waiting_inc(tag_t* tag_entry, tag_level_t* tag_level) {
+    TAG_STATUS_INC(TAG_STATUS(tag_entry -> tag_key) -> level_waiting[tag_level -> level]);
+    atomic_inc(&(tag_level -> waiting));
+}
+
+static __always_inline int level_waiting_dec_and_test(tag_t* tag_entry, tag_level_t* tag_level) {
+    int last;
+    last = atomic_dec_and_test(&(tag_level -> waiting));
+    TAG_STATUS_DEC(TAG_STATUS(tag_entry -> tag_key) -> level_waiting[tag_level -> level]);
+    return last;
+}
+
+// Index of the first of "n" levels holding a message, -1 if none
+static __always_inline int first_ready(tag_level_t** levels, int n) {
+    int i;
+    for(i = 0; i < n; i++)
+        if(READ_ONCE(levels[i] -> ready)) return i;
+    return -1;
+}
+
+// Busy-poll the levels the thread is already waiting on, until a message (or an Awake All) arrives or "deadline" (ns)
+// passes. Gives the CPU up as soon as someone else needs it, the caller then sleeps as usual
+static void receive_spin(tag_t* tag_entry, tag_level_t** levels, int n, u64 deadline) {
+    while(first_ready(levels, n) < 0 && !READ_ONCE(tag_entry -> ready)) {
+        if(need_resched() || signal_pending(current) || ktime_get_ns() >= deadline) return;
+        cpu_relax();
+    }
+}
+
+// A pair of tag_wait_multi(), the pairs being sorted by Tag and level so the ones of a Tag are entered together
+struct wait_slot {
+    int tag;
+    int level;
+    int index;                      // Position of the pair in the array of the caller
+    tag_t* tag_entry;
+    tag_level_t* entered;           // Level (epoch) the thread waits on, kept by its waiting counter
+};
+
+static int wait_slot_cmp(const void* a, const void* b) {
+    const struct wait_slot* x = a;
+    const struct wait_slot* y = b;
+    if(x -> tag != y -> tag) return x -> tag < y -> tag ? -1 : 1;
+    if(x -> level != y -> level) return x -> level < y -> level ? -1 : 1;
+    return x -> index - y -> index;
+}
+
+// Slot of the first pair (in the order of the caller) whose level holds a message or whose Tag has an Awake All, -1 if none
+static __always_inline int first_fired(struct wait_slot* slots, int n) {
+    int i, fired;
+    fired = -1;
+    for(i = 0; i < n; i++)
+        if((READ_ONCE(slots[i].entered -> ready) || READ_ONCE(slots[i].tag_entry -> ready)) &&
+           (fired < 0 || slots[i].index < slots[fired].index)) fired = i;
+    return fired;
+}
 
 /**
  *  @brief  Create or open a new Tag
  *  
  *  @param  key used for identify the Tag
- *  @param  command used to determine if is a "open" or a "create"
+ *  @param  command used to determine if is a "open" or a "create" (TAG_CREAT | TAG_RETAIN to keep the last message of each level)
  *  @param  permission to enable the tag to be used by all threads 
  *          or only by the one of the same user who created the TAG
  * 
@@ -26,30 +120,22 @@ static void print_level(tag_level_t* tag_level, int tag);
  */
 int tag_get(int key, int command, int permission) {
 
-    PRINT {
-        
-        char* command_str;
-        char* perm_str;
-        
-        if(command == TAG_OPEN)         command_str = "TAG_OPEN";
-        else if(command == TAG_CREAT)   command_str = "TAG_CREAT";
-        else                            command_str = "UNDEFINED";
-
-        if(permission == TAG_PERM_USR)      perm_str = "TAG_PERM_USR";
-        else if(permission == TAG_PERM_ALL) perm_str = "TAG_PERM_ALL";
-        else                                perm_str = "UNDEFINED";
+    int retain;
 
-        printk("%s: TAG_GET called. TID: %d, key %d, command %s, perm: %s\n", 
-            MODNAME, current->pid, key, command_str, perm_str);
-    }
-    
-    
     if(key < 0) {
         PRINT
         printk("%s: Key is invalid (< 0)\n", MODNAME);
         return -EINVAL; 
     }
 
+    retain = command & TAG_RETAIN;
+    command &= ~TAG_RETAIN;
+    if(retain && command != TAG_CREAT) {
+        PRINT
+        printk("%s: TAG_RETAIN is valid only with TAG_CREAT\n", MODNAME);
+        return -EINVAL;
+    }
+
 
     // Create new Tag service
     if(command == TAG_CREAT) {
@@ -64,7 +150,7 @@ int tag_get(int key, int command, int permission) {
         // Access common lock in write mode. This is necessary because common data structure will be accessed
         //  - Hashamp (containing the mapping [key -> tag descriptor])
         //  - Bitmask (for retriving the first avaliable tag descriptor value)
-        // Those structs are not safe to use in parallel, in particular the Hashmap because of the bucket resizing (memory allocation/deallocation)
+        // Those structs are not safe to use in parallel (the Hashmap is fixed capacity, so at least no allocation happens under this lock)
         // The bitmask could theoretically be accessed in concurrency using the "atmomic" operation on bits, but since the only access to it
         // is next to the one made for the hashmap (even for deleting a tag), there's no real performance boost in enabling concurrent
         // access (also considering the access to the bitmask is fast enough)
@@ -83,9 +169,16 @@ int tag_get(int key, int command, int permission) {
         }
 
         // Get available Tag descriptor number
+        // (IPC_PRIVATE Tags are not in the hashmap, so a full bitmask is the other way to reach the maximum)
         int tag_key; 
         tag_key = get_avail_number(tag_bitmask);
-        if(unlikely(tag_key < 0 || tag_key >= MAX_TAGS)) {
+        if(tag_key < 0) {
+            PRINT
+            printk("%s: Maximum Tag services reached (%d)\n", MODNAME, MAX_TAGS);
+            up_write(&common_lock);
+            return -EMAXTAG;
+        }
+        if(unlikely(tag_key >= MAX_TAGS)) {
             PRINT
             printk("%s: No tag_key avaliable\n", MODNAME);
             up_write(&common_lock);
@@ -164,7 +257,36 @@ int tag_get(int key, int command, int permission) {
             return -ENOMEM;
         }
 
+        tag_entry -> stats = alloc_percpu(tag_stats_t);
+        if(unlikely(tag_entry -> stats == 0)) {
+            PRINT
+            printk("%s: Could not allocate statistics for Tag Service entry.\n", MODNAME);
+
+            kfree(tag_entry);
+            clear_tag_level(tag_level);
+            kfree(tag_level);
+            if(unlikely(clear_tag_common(key, tag_key) != 0)) return -EINTR;
+            return -ENOMEM;
+        }
+
         int i;
+
+        // The buffers of the retained messages are allocated by the first tag_send() on each level
+        if(retain) {
+            tag_entry -> retained = kzalloc(sizeof(tag_retained_t) * LEVELS, GFP_KERNEL);
+            if(unlikely(tag_entry -> retained == 0)) {
+                PRINT
+                printk("%s: Could not allocate memory for the retained messages.\n", MODNAME);
+
+                free_percpu(tag_entry -> stats);
+                kfree(tag_entry);
+                clear_tag_level(tag_level);
+                kfree(tag_level);
+                if(unlikely(clear_tag_common(key, tag_key) != 0)) return -EINTR;
+                return -ENOMEM;
+            }
+            for(i = 0; i < LEVELS; i++) init_rwsem(&(tag_entry -> retained[i].lock));
+        }
         
         // Initalize values for tag entry
         tag_entry -> key        = key;
@@ -175,15 +297,21 @@ int tag_get(int key, int command, int permission) {
         tag_entry -> tag_level  = tag_level;
         atomic_set(&(tag_entry -> waiting), 0);
         for(i = 0; i < LEVELS; i++) init_rwsem(&(tag_entry -> level_lock[i]));
+
+        // Status page entry filled before the Tag can be reached
+        memset(TAG_STATUS(tag_key), 0, sizeof(struct tag_status_entry));
+        TAG_STATUS(tag_key) -> permission = permission;
+        TAG_STATUS(tag_key) -> retain = retain != 0;
+        smp_wmb();
+        WRITE_ONCE(TAG_STATUS(tag_key) -> exists, 1);
         
         // It's not necessary to lock this access because of the locking mechanism before:
         //      it's not possible to use an already taken tag descriptor (tag_key)
         //      Moreover, if a concurrent TAG CTL with DELETE gets called, it will have no effect until
         //      it will find the tag_entry in tags[tag_key], so no need to serialize this piece of code
-        tags[tag_key] = tag_entry;
-
-        PRINT
-        print_tag();
+        // Published with rcu_assign_pointer since the monitoring paths read it without locks
+        rcu_assign_pointer(tags[tag_key], tag_entry);
+        atomic_long_inc(&tag_mem_tags);
 
         return tag_key;
 
@@ -224,9 +352,6 @@ int tag_get(int key, int command, int permission) {
 
         up_read(&common_lock); 
 
-        PRINT
-        print_tag();
-
         return tag_key;
     }
     
@@ -244,14 +369,32 @@ int tag_get(int key, int command, int permission) {
  *  @param  level of the Tag send message to (0 to LEVELS - 1)
  *  @param  buffer containing the message to deliver 
  *  @param  size size of the message to deliver
+ *  @param  outcome set to the TAG_SEND_* outcome (see tag-trace.h)
  * 
  *  @return 1 on success, 0 on discarded message (no receiver waiting or occupied), negative error codes otherwise
  */
-int tag_send(int tag, int level, char* buffer, size_t size) { 
+int tag_send(int tag, int level, char* buffer, size_t size, int* outcome) { 
+    return tag_send_common(tag, level, buffer, size, 0, outcome);
+}
+
+/**
+ *  @brief  Send a message held in kernel memory to a Tag (used by the periodic publisher, see tag-publisher.c)
+ *          Same semantic of tag_send(), must be called from process context
+ */
+int tag_send_kernel(int tag, int level, const char* buffer, size_t size, int* outcome) {
+    return tag_send_common(tag, level, (char *) buffer, size, 1, outcome);
+}
+
+/**
+ *  @brief  Body of tag_send() and tag_send_kernel(), "kernel" tells if the buffer is a kernel address
+ */
+static int tag_send_common(int tag, int level, char* buffer, size_t size, int kernel, int* outcome) { 
 
+    long seq;
+    PROF_DECLARE(t);
 
-    PRINT
-    printk("%s: TAG_SEND called. TID: %d, tag %d, level %d, buffer: %s, size: %ld\n", MODNAME, current->pid, tag, level, buffer, size);
+    *outcome = TAG_SEND_ERROR;
+    seq = 0;
 
     // Input check (buffer == 0 is permitted if the thread just want to wake up reaceiving thread)
     if(tag < 0 || tag >= MAX_TAGS || level < 0 || level >= LEVELS || size < 0 || size > BUFFER_SIZE){
@@ -264,11 +407,13 @@ int tag_send(int tag, int level, char* buffer, size_t size) {
 
 
     // Get lock to access the (used to avoid removal while accessing the TAG)
+    PROF_START(t);
     if(unlikely(down_read_interruptible(&(tag_lock[tag])) == -EINTR)) {  
         PRINT              
         printk("%s: RW Lock was interrupted.\n", MODNAME);
         return -EINTR;
     }
+    PROF_END(t, TAG_PROF_SEND_TAG_LOCK);
 
     tag_t* tag_entry;
     tag_entry = tags[tag];
@@ -287,20 +432,33 @@ int tag_send(int tag, int level, char* buffer, size_t size) {
         up_read(&(tag_lock[tag]));
         return -EPERM;
     }
+
+    // A retained Tag keeps the message even if nobody is there to receive it
+    if(tag_entry -> retained != 0) {
+        seq = retain_store(tag, tag_entry, level, buffer, size, kernel);
+        if(unlikely(seq < 0)) {
+            up_read(&(tag_lock[tag]));
+            return seq;
+        }
+    }
     
     if(atomic_read(&(tag_entry -> waiting)) == 0) {
         PRINT
         printk("%s: Tag %d has no reader.\b", MODNAME, tag);
+        TAG_STAT_INC(tag_entry, level[level].dropped);
+        *outcome = TAG_SEND_NO_RECEIVERS;
         up_read(&(tag_lock[tag]));
         return 0;
     }
 
+    PROF_START(t);
     if(unlikely(down_read_interruptible(&(tag_entry -> level_lock[level])) == -EINTR)) {                
         PRINT
         printk("%s: RW Lock was interrupted.\n", MODNAME);
         up_read(&(tag_lock[tag]));
         return -EINTR;
     }
+    PROF_END(t, TAG_PROF_SEND_LEVEL_LOCK);
 
     tag_level_t* tag_level;
     tag_level = (tag_entry -> tag_level)[level];
@@ -314,29 +472,37 @@ int tag_send(int tag, int level, char* buffer, size_t size) {
     }
 
 
+    PROF_START(t);
     if(unlikely(down_read_interruptible(&(tag_level -> rcu_lock)) == -EINTR)) {                
         printk("%s: RW Lock was interrupted.\n", MODNAME);
         up_read(&(tag_entry -> level_lock[level]));
         up_read(&(tag_lock[tag]));
         return -EINTR;
     }
+    PROF_END(t, TAG_PROF_SEND_RCU_LOCK);
 
     up_read(&(tag_entry -> level_lock[level]));
     
     // Try to acquire mutex (if fails, it means some else is writing)
+    PROF_START(t);
     if(!mutex_trylock(&(tag_level -> w_mutex))) {
         PRINT
         printk("%s: Tag %d on level %d is contended/occupied.\b", MODNAME, tag, level);
+        TAG_STAT_INC(tag_entry, level[level].dropped);
+        *outcome = TAG_SEND_BUSY;
         up_read(&(tag_level -> rcu_lock));
         up_read(&(tag_lock[tag]));
         return 0;
     }
+    PROF_END(t, TAG_PROF_SEND_W_MUTEX);
 
 
     //Those next two "if" are separted to print distinguished info for the two cases
     if((tag_level -> ready) == 1) {
         PRINT
         printk("%s: Tag %d on level %d is occupied.\b", MODNAME, tag, level);
+        TAG_STAT_INC(tag_entry, level[level].dropped);
+        *outcome = TAG_SEND_READY;
         mutex_unlock(&(tag_level -> w_mutex));
         up_read(&(tag_level -> rcu_lock));
         up_read(&(tag_lock[tag]));
@@ -346,6 +512,8 @@ int tag_send(int tag, int level, char* buffer, size_t size) {
     if(atomic_read(&(tag_level -> waiting)) == 0) {
         PRINT
         printk("%s: Tag %d on level %d has no reader.\b", MODNAME, tag, level);
+        TAG_STAT_INC(tag_entry, level[level].dropped);
+        *outcome = TAG_SEND_NO_RECEIVERS;
         mutex_unlock(&(tag_level -> w_mutex));
         up_read(&(tag_level -> rcu_lock));
         up_read(&(tag_lock[tag]));
@@ -356,7 +524,9 @@ int tag_send(int tag, int level, char* buffer, size_t size) {
     // Only if size is > 0 the copy goes on, otherwise, just wake up
     if(size > 0) {
         // Copy of the buffer
-        if(unlikely(copy_from_user(tag_level -> buffer, buffer, size) != 0)) {
+        PROF_START(t);
+        if(kernel) memcpy(tag_level -> buffer, buffer, size);
+        else if(unlikely(copy_from_user(tag_level -> buffer, buffer, size) != 0)) {
             PRINT
             printk("%s: Error in copying message from userspace\n", MODNAME);
             up_read(&(tag_level -> rcu_lock));
@@ -364,26 +534,39 @@ int tag_send(int tag, int level, char* buffer, size_t size) {
             mutex_unlock(&(tag_level -> w_mutex));
             return -EFAULT;
         }
+        PROF_END(t, TAG_PROF_SEND_COPY);
     }
 
     tag_level -> size = size;
+    tag_level -> publish_ns = ktime_get_ns();
+    // On a retained Tag the sequence was taken (and published) by retain_store(), otherwise the senders of the
+    // level are serialized by w_mutex, so the next one is computed here and published once the level is ready
+    if(tag_entry -> retained == 0) seq = READ_ONCE(TAG_STATUS(tag) -> level_seq[level]) + 1;
+    tag_level -> seq = seq;
     asm volatile("mfence" ::: "memory");
-
-    PRINT
-    print_level(tag_level, tag);
     
+    WRITE_ONCE(TAG_STATUS(tag) -> level_ready[level], 1);
+
     // This will also prevent other senders to overwirte the buffer
     tag_level -> ready = 1;
+
+    // A receiver seeing the new sequence also sees the level ready
+    if(tag_entry -> retained == 0) smp_store_release(&(TAG_STATUS(tag) -> level_seq[level]), (u32) seq);
     
     mutex_unlock(&(tag_level -> w_mutex));
+
+    TAG_STAT_INC(tag_entry, level[level].sends);
+    TAG_STAT_ADD(tag_entry, level[level].bytes, size);
+    TAG_STAT_ADD(tag_entry, level[level].wakeups, atomic_read(&(tag_level -> waiting)));
     
+    PROF_START(t);
     wake_up_all(&(tag_level -> local_wq));
+    PROF_END(t, TAG_PROF_SEND_WAKE);
 
     up_read(&(tag_level -> rcu_lock));
     up_read(&(tag_lock[tag]));
 
-    PRINT
-    printk("%s: TAG_SEND done. TID: %d, tag %d, level %d\n", MODNAME, current->pid, tag, level);
+    *outcome = TAG_SEND_DELIVERED;
     
     return 1;
 }
@@ -403,15 +586,32 @@ int tag_send(int tag, int level, char* buffer, size_t size) {
  *  @param  level of the Tag send message to (0 to LEVELS - 1)
  *  @param  buffer memory position to store the message 
  *  @param  size size of the buffer
+ *  @param  epoch set to the epoch of the level the thread waited on (-1 if it returned before waiting)
  * 
  *  @return 1 on success, 0 if interrupted while waiting or Awake_All, negative error codes otherwise
  */
-int tag_receive(int tag, int level, char* buffer, size_t size) { 
+int tag_receive(int tag, int level, char* buffer, size_t size, int* epoch) { 
+    struct tag_args args = { .tag = tag, .level = level, .buffer = (uintptr_t) buffer, .size = size };
+    return tag_receive_common(&args, epoch);
+}
 
-    PRINT
-    printk("%s: TAG_RECEIVE called. TID: %d, tag %d, level %d, size: %ld\n", MODNAME, current->pid, tag, level, size);
+/**
+ *  @brief  Body of tag_receive() and of TAG_OP_RECEIVE, which can also busy-poll the level ("spin_ns") and return
+ *          the retained message (TAG_RECV_LATEST). The sequence of the message received is stored in args -> seq
+ */
+static int tag_receive_common(struct tag_args* args, int* epoch) { 
+
+    int tag, level, return_code, fetched;
+    char* buffer;
+    size_t size;
+    PROF_DECLARE(t);
+
+    tag     = args -> tag;
+    level   = args -> level;
+    buffer  = (char *) (uintptr_t) args -> buffer;
+    size    = args -> size;
 
-    int return_code;
+    *epoch = -1;
 
     // Input check (buffer == NULL is allowed in case a thread just want to be woken up)
     if(tag < 0 || tag >= MAX_TAGS || level < 0 || level >= LEVELS || size < 0 || size > BUFFER_SIZE){
@@ -423,11 +623,13 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
     if(buffer == 0) size = 0;
 
 
+    PROF_START(t);
     if(unlikely(down_read_interruptible(&(tag_lock[tag])) == -EINTR)) {                
             PRINT
             printk("%s: RW Lock was interrupted.\n", MODNAME);
             return -EINTR;
     }
+    PROF_END(t, TAG_PROF_RECV_TAG_LOCK);
 
     tag_t* tag_entry;
     tag_entry = tags[tag];
@@ -447,12 +649,474 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
         return -EPERM;
     }
     
-    if(unlikely(down_read_interruptible(&(tag_entry -> level_lock[level])) == -EINTR)) {                
+    tag_waiting_inc(tag_entry);
+
+    tag_level_t* tag_level;
+    return_code = receive_enter(tag, tag_entry, level, &tag_level);
+    if(unlikely(return_code < 0)) {
+        tag_waiting_dec(tag_entry);
+        up_read(&(tag_lock[tag]));
+        return return_code;
+    }
+
+    // TAG_RECV_LATEST: checked once counted as waiting, so a message sent meanwhile is either retained or delivered
+    fetched = 0;
+    if(args -> command == TAG_RECV_LATEST && tag_entry -> retained != 0)
+        fetched = retain_fetch(tag_entry, level, buffer, size, &(args -> seq));
+
+    if(fetched != 0) {
+        return_code = fetched;
+        if(fetched == 1) TAG_STAT_INC(tag_entry, level[level].receives);
+    }
+    else {
+        u64 wait_start;
+        wait_start = ktime_get_ns();
+
+        PROF_START(t);
+        // Already counted as waiting, so a sender delivers while the thread spins and the wake up costs no scheduling
+        if(args -> spin_ns > 0) receive_spin(tag_entry, &tag_level, 1, wait_start + args -> spin_ns);
+        return_code = wait_event_interruptible(tag_level -> local_wq, tag_level -> ready || tag_entry -> ready);
+        PROF_END(t, TAG_PROF_RECV_WAIT);
+
+        u64 wait_end;
+        wait_end = ktime_get_ns();
+
+        *epoch = tag_level -> epoch;
+        trace_tag_receive_wake(tag, level, tag_level -> epoch, tag_level -> ready, tag_entry -> ready, return_code);
+
+        // When return_code == 0 it means it has been woken up, otherwise it was an interrupt
+        if(return_code == 0) {
+            if(tag_entry -> ready) return_code = 0;
+            else if(tag_level -> ready) return_code = 1;
+        }
+        else return_code = 0;
+
+        TAG_LAT_ADD(tag_entry, level, blocked, wait_end - wait_start);
+        if(return_code == 1)
+            TAG_LAT_ADD(tag_entry, level, wake, wait_end - tag_level -> publish_ns);
+
+        // If the return code is 1 it means it has been woken up by a "wake_up" call, and if tag_level -> ready == 1 it means there's
+        // something to read in the buffer. Otherwise, the next steps are just skipped
+        if(return_code == 1 && tag_level -> ready) {
+            int current_size;
+            current_size = min(size, tag_level -> size);
+            // If current_size is 0, it won't copy anything, it will just wake up and go on
+            if(current_size > 0 && buffer != 0) {
+                PROF_START(t);
+                if(unlikely(copy_to_user(buffer, tag_level -> buffer, current_size)) != 0) {
+                    PRINT
+                    printk("%s: Could not copy the message to the User.\n", MODNAME);
+                    return_code = -EFAULT; 
+                }
+                PROF_END(t, TAG_PROF_RECV_COPY);
+            }
+
+            if(return_code == 1) {
+                args -> seq = tag_level -> seq;
+                TAG_STAT_INC(tag_entry, level[level].receives);
+                if(buffer != 0) TAG_STAT_ADD(tag_entry, level[level].bytes, current_size);
+            }
+        }
+    }
+
+    if(unlikely(receive_exit(tag, tag_entry, level, tag_level) != 0)) return_code = -EPROTO;
+   
+    tag_waiting_dec(tag_entry);
+    
+    up_read(&(tag_lock[tag]));
+
+    return return_code;
+}
+
+/**
+ *  @brief  Receive from several levels of a Tag at once (TAG_OP_RECEIVE_ANY): the thread waits on every level in
+ *          the mask as tag_receive() does on one, and returns the message of the first level to get one (the lowest
+ *          if more are ready when it wakes up, the others count it as a receiver but it doesn't copy them)
+ *  
+ *  @param  args tag, level_mask (bit i for level i), buffer, size and spin_ns as in TAG_OP_RECEIVE; on success
+ *          "level" and "seq" are set to the level the message came from and to its sequence
+ *  @param  epoch set to the epoch of the level the message came from (-1 if none)
+ * 
+ *  @return 1 on success, 0 if interrupted while waiting or Awake_All, negative error codes otherwise
+ */
+static int tag_receive_any(struct tag_args* args, int* epoch) {
+
+    tag_level_t* entered[LEVELS];
+    wait_queue_head_t* wq[LEVELS];
+    struct wait_queue_entry wait[LEVELS];     // One per level, about 40 bytes each
+    int levels[LEVELS];
+    int tag, level, n, i, fired, return_code;
+    char* buffer;
+    size_t size;
+    u32 mask;
+    u64 wait_start, wait_end;
+    PROF_DECLARE(t);
+
+    tag     = args -> tag;
+    mask    = args -> level_mask;
+    buffer  = (char *) (uintptr_t) args -> buffer;
+    size    = args -> size;
+
+    *epoch = -1;
+
+    if(tag < 0 || tag >= MAX_TAGS || mask == 0 || size > BUFFER_SIZE) {
+        PRINT
+        printk("%s: TAG_RECEIVE_ANY Wrong parameter usage\n", MODNAME);
+        return -EINVAL;
+    }
+
+    if(buffer == 0) size = 0;
+
+    n = 0;
+    for(i = 0; i < LEVELS; i++)
+        if(mask & (1U << i)) levels[n++] = i;
+
+    PROF_START(t);
+    if(unlikely(down_read_interruptible(&(tag_lock[tag])) == -EINTR)) {
         PRINT
         printk("%s: RW Lock was interrupted.\n", MODNAME);
+        return -EINTR;
+    }
+    PROF_END(t, TAG_PROF_RECV_TAG_LOCK);
+
+    tag_t* tag_entry;
+    tag_entry = tags[tag];
+
+    if(tag_entry == 0 || CHECKPERM(tag_entry)) {
+        PRINT
+        printk("%s: Could not access the Tag service %d\n", MODNAME, tag);
         up_read(&(tag_lock[tag]));
+        return tag_entry == 0 ? -ENODATA : -EPERM;
+    }
+
+    tag_waiting_inc(tag_entry);
+
+    // Levels always entered in increasing order, so two threads entering the same levels can't deadlock
+    for(i = 0; i < n; i++) {
+        return_code = receive_enter(tag, tag_entry, levels[i], &(entered[i]));
+        if(unlikely(return_code < 0)) {
+            while(--i >= 0) receive_exit(tag, tag_entry, levels[i], entered[i]);
+            tag_waiting_dec(tag_entry);
+            up_read(&(tag_lock[tag]));
+            return return_code;
+        }
+        wq[i] = &(entered[i] -> local_wq);
+    }
+
+    wait_start = ktime_get_ns();
+
+    PROF_START(t);
+    if(args -> spin_ns > 0) receive_spin(tag_entry, entered, n, wait_start + args -> spin_ns);
+    return_code = wait_event_interruptible_multi(wq, n, wait, first_ready(entered, n) >= 0 || tag_entry -> ready);
+    PROF_END(t, TAG_PROF_RECV_WAIT);
+
+    wait_end = ktime_get_ns();
+
+    // As in tag_receive(): an Awake All or an interrupt return 0
+    fired = first_ready(entered, n);
+    if(return_code == 0 && !tag_entry -> ready && fired >= 0) return_code = 1;
+    else return_code = 0;
+
+    if(return_code == 1) {
+        tag_level_t* tag_level;
+        int current_size;
+
+        tag_level = entered[fired];
+        level = levels[fired];
+
+        *epoch = tag_level -> epoch;
+        trace_tag_receive_wake(tag, level, tag_level -> epoch, tag_level -> ready, tag_entry -> ready, return_code);
+
+        TAG_LAT_ADD(tag_entry, level, blocked, wait_end - wait_start);
+        TAG_LAT_ADD(tag_entry, level, wake, wait_end - tag_level -> publish_ns);
+
+        current_size = min(size, tag_level -> size);
+        if(current_size > 0 && buffer != 0) {
+            PROF_START(t);
+            if(unlikely(copy_to_user(buffer, tag_level -> buffer, current_size)) != 0) {
+                PRINT
+                printk("%s: Could not copy the message to the User.\n", MODNAME);
+                return_code = -EFAULT;
+            }
+            PROF_END(t, TAG_PROF_RECV_COPY);
+        }
+
+        if(return_code == 1) {
+            args -> level = level;
+            args -> seq = tag_level -> seq;
+            TAG_STAT_INC(tag_entry, level[level].receives);
+            if(buffer != 0) TAG_STAT_ADD(tag_entry, level[level].bytes, current_size);
+        }
+    }
+
+    for(i = 0; i < n; i++)
+        if(unlikely(receive_exit(tag, tag_entry, levels[i], entered[i]) != 0)) return_code = -EPROTO;
+
+    tag_waiting_dec(tag_entry);
+
+    up_read(&(tag_lock[tag]));
+
+    return return_code;
+}
+
+/**
+ *  @brief  Enter the slots of a Tag for tag_wait_multi(): the thread is counted as waiting on the Tag and on each level,
+ *          and those counters alone keep the Tag and the levels alive while it sleeps (no lock is held on return)
+ *  
+ *  @param  slots sorted slots, all of the same Tag
+ *  @param  n number of slots
+ * 
+ *  @return 0 on success, negative error codes otherwise (nothing entered)
+ */
+static int wait_multi_enter(struct wait_slot* slots, int n) {
+
+    tag_t* tag_entry;
+    int tag, i, return_code;
+    PROF_DECLARE(t);
+
+    tag = slots[0].tag;
+
+    PROF_START(t);
+    if(unlikely(down_read_interruptible(&(tag_lock[tag])) == -EINTR)) {
+        PRINT
+        printk("%s: RW Lock was interrupted.\n", MODNAME);
+        return -EINTR;
+    }
+    PROF_END(t, TAG_PROF_RECV_TAG_LOCK);
+
+    tag_entry = tags[tag];
+
+    if(tag_entry == 0 || CHECKPERM(tag_entry)) {
+        PRINT
+        printk("%s: Could not access the Tag service %d\n", MODNAME, tag);
+        up_read(&(tag_lock[tag]));
+        return tag_entry == 0 ? -ENODATA : -EPERM;
+    }
+
+    // TAG_DELETE fails while the Tag has waiting threads, even if they don't hold its tag_lock
+    tag_waiting_inc(tag_entry);
+
+    for(i = 0; i < n; i++) {
+        slots[i].tag_entry = tag_entry;
+
+        return_code = receive_enter(tag, tag_entry, slots[i].level, &(slots[i].entered));
+        if(unlikely(return_code < 0)) {
+            while(--i >= 0) receive_leave(tag, tag_entry, slots[i].level, slots[i].entered);
+            tag_waiting_dec(tag_entry);
+            up_read(&(tag_lock[tag]));
+            return return_code;
+        }
+
+        // A waiting level is never freed nor reset (see receive_leave()), so its rcu_lock isn't needed while sleeping
+        up_read(&(slots[i].entered -> rcu_lock));
+    }
+
+    up_read(&(tag_lock[tag]));
+
+    return 0;
+}
+
+/**
+ *  @brief  Leave the first "n" slots entered by tag_wait_multi(), taking again the tag_lock of each Tag so that
+ *          it can't be deleted before the thread stops touching it
+ *  
+ *  @param  slots sorted slots, all entered
+ *  @param  n number of slots
+ * 
+ *  @return 0 on success, -EPROTO if a level can't be found anymore
+ */
+static int wait_multi_exit(struct wait_slot* slots, int n) {
+
+    int first, i, return_code;
+
+    return_code = 0;
+
+    for(first = 0; first < n; first = i) {
+        // Not interruptible, the thread must leave anyway
+        down_read(&(tag_lock[slots[first].tag]));
+
+        for(i = first; i < n && slots[i].tag == slots[first].tag; i++)
+            if(unlikely(receive_leave(slots[i].tag, slots[i].tag_entry, slots[i].level, slots[i].entered) != 0))
+                return_code = -EPROTO;
+
+        tag_waiting_dec(slots[first].tag_entry);
+        up_read(&(tag_lock[slots[first].tag]));
+    }
+
+    return return_code;
+}
+
+/**
+ *  @brief  Wait on several (tag, level) pairs at once, also of different Tags (TAG_OP_WAIT_MULTI): the thread waits on
+ *          every pair as tag_receive() does on one, and returns the message of the first pair to get one (the first in
+ *          the array if more are ready when it wakes up, the others count it as a receiver but it doesn't copy them)
+ *  
+ *  @param  args pairs (user pointer to "count" struct tag_wait_pair), buffer and size as in TAG_OP_RECEIVE; "index" is
+ *          set to the position of the pair that woke the thread up (-1 if none), "seq" to the sequence of the message
+ *  @param  epoch set to the epoch of the level the message came from (-1 if none)
+ * 
+ *  @return 1 on success, 0 if interrupted while waiting or Awake_All of the Tag of a pair, negative error codes otherwise
+ */
+static int tag_wait_multi(struct tag_args* args, int* epoch) {
+
+    struct tag_wait_pair* pairs;
+    struct wait_slot* slots;
+    wait_queue_head_t** wq;
+    struct wait_queue_entry* wait;
+    tag_t* tag_entry;
+    int n, i, first, fired, return_code;
+    char* buffer;
+    size_t size;
+    u64 wait_start, wait_end;
+    PROF_DECLARE(t);
+
+    buffer  = (char *) (uintptr_t) args -> buffer;
+    size    = args -> size;
+
+    *epoch = -1;
+    args -> index = -1;
+
+    if(args -> count == 0 || args -> count > TAG_WAIT_MAX || args -> pairs == 0 || size > BUFFER_SIZE) {
+        PRINT
+        printk("%s: TAG_WAIT_MULTI Wrong parameter usage\n", MODNAME);
+        return -EINVAL;
+    }
+
+    if(buffer == 0) size = 0;
+
+    n = args -> count;
+
+    // Slots, wait queues, wait queue entries and the copy of the pairs in a single allocation (too big for the stack)
+    slots = kvzalloc((sizeof(*slots) + sizeof(*wq) + sizeof(*wait) + sizeof(*pairs)) * n, GFP_KERNEL);
+    if(unlikely(slots == 0)) return -ENOMEM;
+    wq      = (wait_queue_head_t **) (slots + n);
+    wait    = (struct wait_queue_entry *) (wq + n);
+    pairs   = (struct tag_wait_pair *) (wait + n);
+
+    if(unlikely(copy_from_user(pairs, (struct tag_wait_pair __user *) (uintptr_t) args -> pairs, sizeof(*pairs) * n) != 0)) {
+        PRINT
+        printk("%s: Error in copying the pairs from userspace\n", MODNAME);
+        kvfree(slots);
+        return -EFAULT;
+    }
+
+    for(i = 0; i < n; i++) {
+        if(pairs[i].tag < 0 || pairs[i].tag >= MAX_TAGS || pairs[i].level < 0 || pairs[i].level >= LEVELS) {
+            PRINT
+            printk("%s: TAG_WAIT_MULTI Wrong pair %d (Tag %d, level %d)\n", MODNAME, i, pairs[i].tag, pairs[i].level);
+            kvfree(slots);
+            return -EINVAL;
+        }
+        slots[i].tag    = pairs[i].tag;
+        slots[i].level  = pairs[i].level;
+        slots[i].index  = i;
+    }
+
+    // Sorted to find the repeated pairs and to enter the levels of a Tag under a single tag_lock
+    sort(slots, n, sizeof(*slots), wait_slot_cmp, 0);
+
+    // A pair entered twice would be counted twice as waiting
+    for(i = 1; i < n; i++) {
+        if(slots[i].tag == slots[i - 1].tag && slots[i].level == slots[i - 1].level) {
+            PRINT
+            printk("%s: TAG_WAIT_MULTI Pair (Tag %d, level %d) repeated\n", MODNAME, slots[i].tag, slots[i].level);
+            kvfree(slots);
+            return -EINVAL;
+        }
+    }
+
+    // One Tag at a time: no lock is held across Tags, so there's no bound on how many Tags the pairs cover
+    for(first = 0; first < n; first = i) {
+        for(i = first + 1; i < n && slots[i].tag == slots[first].tag; i++);
+
+        return_code = wait_multi_enter(slots + first, i - first);
+        if(unlikely(return_code < 0)) {
+            wait_multi_exit(slots, first);
+            kvfree(slots);
+            return return_code;
+        }
+    }
+
+    for(i = 0; i < n; i++) wq[i] = &(slots[i].entered -> local_wq);
+
+    wait_start = ktime_get_ns();
+
+    PROF_START(t);
+    return_code = wait_event_interruptible_multi(wq, n, wait, first_fired(slots, n) >= 0);
+    PROF_END(t, TAG_PROF_RECV_WAIT);
+
+    wait_end = ktime_get_ns();
+
+    // As in tag_receive(): an Awake All or an interrupt return 0
+    fired = first_fired(slots, n);
+    if(return_code == 0 && fired >= 0) {
+        args -> index = slots[fired].index;
+        return_code = slots[fired].tag_entry -> ready ? 0 : 1;
+    }
+    else return_code = 0;
+
+    if(return_code == 1) {
+        tag_level_t* tag_level;
+        int tag, level, current_size;
+
+        tag_entry = slots[fired].tag_entry;
+        tag_level = slots[fired].entered;
+        tag = slots[fired].tag;
+        level = slots[fired].level;
+
+        *epoch = tag_level -> epoch;
+        trace_tag_receive_wake(tag, level, tag_level -> epoch, tag_level -> ready, tag_entry -> ready, return_code);
+
+        TAG_LAT_ADD(tag_entry, level, blocked, wait_end - wait_start);
+        TAG_LAT_ADD(tag_entry, level, wake, wait_end - tag_level -> publish_ns);
+
+        current_size = min(size, tag_level -> size);
+        if(current_size > 0 && buffer != 0) {
+            PROF_START(t);
+            if(unlikely(copy_to_user(buffer, tag_level -> buffer, current_size)) != 0) {
+                PRINT
+                printk("%s: Could not copy the message to the User.\n", MODNAME);
+                return_code = -EFAULT;
+            }
+            PROF_END(t, TAG_PROF_RECV_COPY);
+        }
+
+        if(return_code == 1) {
+            args -> seq = tag_level -> seq;
+            TAG_STAT_INC(tag_entry, level[level].receives);
+            if(buffer != 0) TAG_STAT_ADD(tag_entry, level[level].bytes, current_size);
+        }
+    }
+
+    if(unlikely(wait_multi_exit(slots, n) != 0)) return_code = -EPROTO;
+
+    kvfree(slots);
+
+    return return_code;
+}
+
+/**
+ *  @brief  Register the thread as waiting on a level (tag_lock held in read, Tag waiting counter already raised):
+ *          moves to a new epoch of the level if the current one holds a message being received
+ *  
+ *  @param  tag Tag descriptor of the Tag
+ *  @param  tag_entry the Tag
+ *  @param  level to wait on
+ *  @param  entered set to the level (epoch) the thread is waiting on, with its rcu_lock held in read
+ * 
+ *  @return 0 on success, negative error codes otherwise (nothing held)
+ */
+static int receive_enter(int tag, tag_t* tag_entry, int level, tag_level_t** entered) {
+
+    PROF_DECLARE(t);
+
+    PROF_START(t);
+    if(unlikely(down_read_interruptible(&(tag_entry -> level_lock[level])) == -EINTR)) {                
+        PRINT
+        printk("%s: RW Lock was interrupted.\n", MODNAME);
         return -EINTR;
     }
+    PROF_END(t, TAG_PROF_RECV_LEVEL_LOCK);
 
 
     tag_level_t* tag_level;
@@ -463,22 +1127,18 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
         PRINT
         printk("%s: Tag %d with level %d is not existing.\n", MODNAME, tag, level);
         up_read(&(tag_entry -> level_lock[level]));
-        up_read(&(tag_lock[tag]));
         return -EINVAL;
     }
 
-    atomic_inc(&(tag_entry -> waiting));
-
+    PROF_START(t);
     if(unlikely(down_read_interruptible(&(tag_level -> rcu_lock)) == -EINTR)) {                
         PRINT
         printk("%s: RW Lock was interrupted.\n", MODNAME);
 
-        if(atomic_dec_and_test(&(tag_entry -> waiting))) 
-            tag_entry -> ready = 0;
         up_read(&(tag_entry -> level_lock[level]));
-        up_read(&(tag_lock[tag]));
         return -EINTR;
     }
+    PROF_END(t, TAG_PROF_RECV_RCU_LOCK);
 
     up_read(&(tag_entry -> level_lock[level]));
     
@@ -489,6 +1149,7 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
 
     // If the specified tag level has a send already, create a new epoch level and register on that one
     if(tag_level -> ready == 1) {
+        PROF_START(t);
         PRINT
         printk("%s: Creating new Level Epoch (Tag: %d, Level: %d)\n", MODNAME, tag, level);
 
@@ -501,10 +1162,7 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
             PRINT
             printk("%s: RW Lock was interrupted.\n", MODNAME);
             
-            if(atomic_dec_and_test(&(tag_entry -> waiting))) 
-                tag_entry -> ready = 0;
             up_read(&(tag_level -> rcu_lock));
-            up_read(&(tag_lock[tag]));
             
             return -EINTR;
         }
@@ -530,10 +1188,7 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
             printk("%s: Tag %d with level %d is not existing.\n", MODNAME, tag, level);
             
             up_write(&(tag_entry -> level_lock[level]));
-            if(atomic_dec_and_test(&(tag_entry -> waiting))) 
-                tag_entry -> ready = 0;
             up_read(temp_sem);
-            up_read(&(tag_lock[tag]));            
             return -EINVAL;
         }
 
@@ -549,17 +1204,17 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
                         MODNAME, tag, level, tag_level -> epoch, tag_level -> epoch + 1);
                 
                 up_write(&(tag_entry -> level_lock[level]));
-                if(atomic_dec_and_test(&(tag_entry -> waiting))) 
-                    tag_entry -> ready = 0;
                 up_read(temp_sem);
-                up_read(&(tag_lock[tag]));           
                 return -ENOMEM;
             }
 
 
             //Overwrite the corresponding entry with the new level address
-            tag_entry -> tag_level[level] = new_tag_level;
+            rcu_assign_pointer(tag_entry -> tag_level[level], new_tag_level);
             asm volatile ("mfence" ::: "memory");
+            WRITE_ONCE(TAG_STATUS(tag) -> level_ready[level], 0);
+
+            TAG_STAT_INC(tag_entry, level[level].rollovers);
 
             tag_level = new_tag_level;
         }
@@ -571,20 +1226,17 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
             PRINT
             printk("%s: RW Lock was interrupted.\n", MODNAME);
             
-            tag_entry -> tag_level[level] = old_level;
+            rcu_assign_pointer(tag_entry -> tag_level[level], old_level);
+            WRITE_ONCE(TAG_STATUS(tag) -> level_ready[level], old_level -> ready);
 
             up_write(&(tag_entry -> level_lock[level]));
-            if(atomic_dec_and_test(&(tag_entry -> waiting))) 
-                tag_entry -> ready = 0;
-            up_read(&(tag_lock[tag]));
             
             return -EINTR;
         }
 
         up_write(&(tag_entry -> level_lock[level]));
 
-        
-        
+        PROF_END(t, TAG_PROF_RECV_EPOCH);
     }
     
    
@@ -594,44 +1246,53 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
     // when the thread does "wait_event", it will trigger a "might_sleep()", which will check the ready condition and will
     // immediately wake it up
     
-    atomic_inc(&(tag_level -> waiting));
-    
+    level_waiting_inc(tag_entry, tag_level);
 
-    return_code = wait_event_interruptible(tag_level -> local_wq, tag_level -> ready || tag_entry -> ready);
-    
-    PRINT
-    print_level(tag_level, tag);
-
-    // When return_code == 0 it means it has been woken up, otherwise it was an interrupt
-    if(return_code == 0) {
-        if(tag_entry -> ready) return_code = 0;
-        else if(tag_level -> ready) return_code = 1;
-    }
-    else return_code = 0;
+    *entered = tag_level;
 
-    // If the return code is 1 it means it has been woken up by a "wake_up" call, and if tag_level -> ready == 1 it means there's
-    // something to read in the buffer. Otherwise, the next steps are just skipped
-    if(return_code == 1 && tag_level -> ready) {
-        int current_size;
-        current_size = min(size, tag_level -> size);
-        // If current_size is 0, it won't copy anything, it will just wake up and go on
-        if(current_size > 0 && buffer != 0)
-            if(unlikely(copy_to_user(buffer, tag_level -> buffer, current_size)) != 0) {
-                PRINT
-                printk("%s: Could not copy the message to the User.\n", MODNAME);
-                return_code = -EFAULT; 
-            }
-    }
+    return 0;
+}
 
+/**
+ *  @brief  Unregister the thread from a level entered with receive_enter(), releasing its rcu_lock (see receive_leave())
+ *  
+ *  @param  tag Tag descriptor of the Tag
+ *  @param  tag_entry the Tag
+ *  @param  level the thread waited on
+ *  @param  tag_level the level (epoch) the thread waited on
+ * 
+ *  @return 0 on success, -EPROTO if the level can't be found anymore
+ */
+static int receive_exit(int tag, tag_t* tag_entry, int level, tag_level_t* tag_level) {
     up_read(&(tag_level -> rcu_lock));
+    return receive_leave(tag, tag_entry, level, tag_level);
+}
+
+/**
+ *  @brief  Unregister the thread from a level it's counted as waiting on, with its rcu_lock already released: the
+ *          last thread leaving frees the level if a newer epoch exists, otherwise makes it ready for the next message.
+ *          Until then the level is neither freed nor reset, so a waiting thread can read it without the rcu_lock
+ *  
+ *  @param  tag Tag descriptor of the Tag
+ *  @param  tag_entry the Tag
+ *  @param  level the thread waited on
+ *  @param  tag_level the level (epoch) the thread waited on
+ * 
+ *  @return 0 on success, -EPROTO if the level can't be found anymore
+ */
+static int receive_leave(int tag, tag_t* tag_entry, int level, tag_level_t* tag_level) {
+
+    PROF_DECLARE(t);
 
 
     //If the thread is the last one reading from the level
-    if(atomic_dec_and_test(&(tag_level -> waiting))) {
+    if(level_waiting_dec_and_test(tag_entry, tag_level)) {
 
+        PROF_START(t);
         while(!down_write_trylock(&(tag_level -> rcu_lock))) {
             schedule();
         } 
+        PROF_END(t, TAG_PROF_RECV_RELEASE_LOCK);
         
 
         tag_level_t* new_tag_level;
@@ -641,10 +1302,7 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
             PRINT
             printk("%s: Fatal Error: Could not access new level for tag %d at level %d \n", MODNAME, tag, level);
             
-            if(atomic_dec_and_test(&(tag_entry -> waiting))) 
-                tag_entry -> ready = 0;
             up_write(&(tag_level -> rcu_lock));
-            up_read(&(tag_lock[tag]));
             return -EPROTO;
         }
 
@@ -653,20 +1311,20 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
         if(new_tag_level -> epoch > tag_level -> epoch) {
             PRINT {
                 printk("%s: Deleting Tag %d Level %d of epoch %d\n", MODNAME, tag, level, tag_level -> epoch);
-                //print_level(tag_level, tag);
             }
             up_write(&(tag_level -> rcu_lock));
-            free_level(tag_level);
+            // A monitoring reader may still be looking at the old epoch
+            call_rcu(&(tag_level -> rcu), free_level_rcu);
             
         
         } else { 
             // ... otherwise, the level gets re-initialized, 0-ing the values for the next send/receive
             PRINT {
                 printk("%s: Clearing Tag %d Level %d of epoch %d\n", MODNAME, tag, level, tag_level -> epoch);
-                //print_level(tag_level, tag);
             }
             //If a new tag level epoch doesn't exists set level_ready to 0 (the level is not used anymore)
             tag_level -> ready = 0;
+            WRITE_ONCE(TAG_STATUS(tag) -> level_ready[level], 0);
             
             // Those two operation are not necessary since the next send will overwritre those value 
             // (beside the buffer which should be set to 0 for consistency purposes)
@@ -682,16 +1340,110 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
 
        
     }
-   
-    if(atomic_dec_and_test(&(tag_entry -> waiting))) 
-        tag_entry -> ready = 0;
-    
-    up_read(&(tag_lock[tag]));
 
-    PRINT
-    printk("%s: TAG_RECEIVE done. TID: %d, tag %d, level %d, buffer: %s, size: %ld\n", MODNAME, current->pid, tag, level, buffer, size);
+    return 0;
+}
 
-    return return_code;
+
+/**
+ *  @brief  Keep a message as the last one of a level of a TAG_RETAIN Tag
+ *  
+ *  @param  tag Tag descriptor of the Tag
+ *  @param  tag_entry the Tag (tag_lock held in read)
+ *  @param  level of the message
+ *  @param  buffer containing the message, "kernel" tells if it's a kernel address
+ *  @param  size size of the message
+ * 
+ *  @return the sequence given to the message, negative error codes otherwise
+ */
+static long retain_store(int tag, tag_t* tag_entry, int level, char* buffer, size_t size, int kernel) {
+
+    tag_retained_t* retained;
+    long seq;
+
+    retained = &(tag_entry -> retained[level]);
+
+    if(unlikely(down_write_killable(&(retained -> lock)) == -EINTR)) {
+        PRINT
+        printk("%s: RW Lock was interrupted.\n", MODNAME);
+        return -EINTR;
+    }
+
+    if(retained -> buffer == 0) {
+        retained -> buffer = kzalloc(sizeof(char) * BUFFER_SIZE, GFP_KERNEL);
+        if(unlikely(retained -> buffer == 0)) {
+            PRINT
+            printk("%s: Could not allocate the retained message of Tag %d level %d\n", MODNAME, tag, level);
+            up_write(&(retained -> lock));
+            return -ENOMEM;
+        }
+        atomic_long_inc(&tag_mem_retained);
+    }
+
+    if(size > 0) {
+        if(kernel) memcpy(retained -> buffer, buffer, size);
+        else if(unlikely(copy_from_user(retained -> buffer, buffer, size) != 0)) {
+            PRINT
+            printk("%s: Error in copying message from userspace\n", MODNAME);
+            // The old message is partially overwritten, so there's no retained message anymore
+            retained -> seq = 0;
+            up_write(&(retained -> lock));
+            return -EFAULT;
+        }
+    }
+
+    retained -> size = size;
+    seq = TAG_STATUS_NEXT(TAG_STATUS(tag) -> level_seq[level]);
+    retained -> seq = seq;
+
+    up_write(&(retained -> lock));
+
+    return seq;
+}
+
+/**
+ *  @brief  Copy the retained message of a level if it's newer than the sequence "seq" (TAG_RECV_LATEST)
+ *  
+ *  @param  tag_entry the Tag (created with TAG_RETAIN, tag_lock held in read)
+ *  @param  level of the message
+ *  @param  buffer memory position to store the message 
+ *  @param  size size of the buffer
+ *  @param  seq last sequence seen by the caller, set to the one of the message copied
+ * 
+ *  @return 1 if the message was copied, 0 if there's no newer message, negative error codes otherwise
+ */
+static int retain_fetch(tag_t* tag_entry, int level, char* buffer, size_t size, __u64* seq) {
+
+    tag_retained_t* retained;
+    size_t current_size;
+    int ret;
+
+    retained = &(tag_entry -> retained[level]);
+    ret = 0;
+
+    if(unlikely(down_read_interruptible(&(retained -> lock)) == -EINTR)) {
+        PRINT
+        printk("%s: RW Lock was interrupted.\n", MODNAME);
+        return -EINTR;
+    }
+
+    // Sequences compared as in time_after(), so a wrap around of the counter is not an issue
+    if(retained -> seq != 0 && (int) (retained -> seq - (u32) *seq) > 0) {
+        current_size = min(size, retained -> size);
+        if(current_size > 0 && buffer != 0 && unlikely(copy_to_user(buffer, retained -> buffer, current_size) != 0)) {
+            PRINT
+            printk("%s: Could not copy the message to the User.\n", MODNAME);
+            ret = -EFAULT;
+        }
+        else {
+            *seq = retained -> seq;
+            ret = 1;
+        }
+    }
+
+    up_read(&(retained -> lock));
+
+    return ret;
 }
 
 
@@ -712,14 +1464,6 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
  */
 int tag_ctl(int tag, int command) {
 
-    PRINT {
-        char* command_str;
-        if(command == TAG_AWAKE_ALL)    command_str = "TAG_AWAKE_ALL";
-        else if(command == TAG_DELETE)  command_str = "TAG_DELETE";
-        else                            command_str = "UNDEFINED";
-        printk("%s: TAG_CTL called. TID: %d, tag: %d, command %s\n", MODNAME, current -> pid, tag, command_str);
-    }
- 
     // Input check
     if(tag < 0 || tag >= MAX_TAGS){
         PRINT
@@ -771,6 +1515,9 @@ int tag_ctl(int tag, int command) {
 
         
         tag_entry -> ready = 1;
+        WRITE_ONCE(TAG_STATUS(tag) -> ready, 1);
+
+        TAG_STAT_INC(tag_entry, awake_alls);
 
         tag_level_t* tag_level;
         int i;
@@ -797,8 +1544,10 @@ int tag_ctl(int tag, int command) {
                     return -EINTR;
                 }
 
-                if(atomic_read(&(tag_level -> waiting)) > 0)    
+                if(atomic_read(&(tag_level -> waiting)) > 0) {
+                    TAG_STAT_ADD(tag_entry, level[i].wakeups, atomic_read(&(tag_level -> waiting)));
                     wake_up_all(&(tag_level -> local_wq));
+                }
 
                 up_read(&(tag_level -> rcu_lock)); 
             }
@@ -860,10 +1609,19 @@ int tag_ctl(int tag, int command) {
             return -EPERM;
         }
 
+        // A thread of tag_wait_multi() sleeps without the tag_lock, only counted as waiting on the Tag
+        if(atomic_read(&(tag_entry -> waiting)) != 0) {
+            PRINT
+            printk("%s: Could not delete tag %d, occupied\n", MODNAME, tag);
+            up_write(&(tag_lock[tag]));
+            return 0;
+        }
+
         // With this instruction the tag becomes unaccesible for other thread beside the one that are still making
         // a transaction
         // tags[tag] = 0 remove references to the tag, so no other thread can start a new operation on that tag
         tags[tag] = 0;
+        WRITE_ONCE(TAG_STATUS(tag) -> exists, 0);
 
         up_write(&(tag_lock[tag]));
 
@@ -873,7 +1631,8 @@ int tag_ctl(int tag, int command) {
         if(atomic_read(&(tag_entry -> waiting)) != 0) { 
             PRINT
             printk("%s: Critical Error! CTL DELETE was called on tag %d but still pending operation are present.\n", MODNAME, tag);
-            tags[tag] = tag_entry;
+            WRITE_ONCE(TAG_STATUS(tag) -> exists, 1);
+            rcu_assign_pointer(tags[tag], tag_entry);
             return -EPROTO;
         } 
 
@@ -886,24 +1645,17 @@ int tag_ctl(int tag, int command) {
         if(unlikely(clear_tag_common(tag_entry -> key, tag_entry -> tag_key) != 0)) {
             PRINT
             printk("%s: Fatal Error! Could not deallocate BM and HM for Tag %d.\n", MODNAME, tag_entry -> tag_key);
-            tags[tag] = tag_entry;
+            WRITE_ONCE(TAG_STATUS(tag) -> exists, 1);
+            rcu_assign_pointer(tags[tag], tag_entry);
             return -EINTR;
         }
 
-        // Delete all levels
-        clear_tag_level(tag_entry -> tag_level);
-
-        if(tag_entry -> tag_level != 0) kfree(tag_entry -> tag_level);
-
-        if(tag_entry != 0) kfree(tag_entry);
+        // Delete all levels and the Tag once the monitoring readers (RCU) are done with them
+        call_rcu(&(tag_entry -> rcu), free_tag_rcu);
 
         PRINT
         printk("%s: CTL DELETE removed succesfully tag %d\n", MODNAME, tag);
 
-
-        PRINT
-        print_tag();
-
         return 1;
     }
 
@@ -979,8 +1731,12 @@ static tag_level_t* create_level(int i, int epoch) {
     atomic_set(&(level -> waiting), 0);
     init_waitqueue_head(&(level -> local_wq));
     init_rwsem(&(level -> rcu_lock));
+    lockdep_set_class(&(level -> rcu_lock), &(rcu_lock_key[i]));
     mutex_init(&(level -> w_mutex));
 
+    atomic_long_inc(&tag_mem_levels);
+    if(epoch > 0) atomic_long_inc(&tag_mem_epoch_levels);
+
     return level;
 
 }
@@ -1045,6 +1801,26 @@ void clear_tag_level(tag_level_t** tag_level) {
 
 }
 
+/**
+ *  @brief  Free the buffers of the retained messages and the array holding them
+ *  
+ *  @param  retained array of LEVELS retained messages (0 if the Tag doesn't retain)
+ *  
+ */ 
+void clear_tag_retained(tag_retained_t* retained) {
+
+    int i;
+    if(retained == 0) return;
+
+    for(i = 0; i < LEVELS; i++) {
+        if(retained[i].buffer != 0) {
+            kfree(retained[i].buffer);
+            atomic_long_dec(&tag_mem_retained);
+        }
+    }
+    kfree(retained);
+}
+
 /**
  *  @brief  Free a single level
  *  
@@ -1052,136 +1828,177 @@ void clear_tag_level(tag_level_t** tag_level) {
  *  
  */ 
 __always_inline static void free_level(tag_level_t* tag_level) {
+    atomic_long_dec(&tag_mem_levels);
+    if(tag_level -> epoch > 0) atomic_long_dec(&tag_mem_epoch_levels);
     kfree(tag_level -> buffer);
     kfree(tag_level);
 }
 
-
 /**
- *  @brief  Print the whole content of all the Tags (the one that have been created) and the hashamp
- *          containing the mapping key -> tag descriptor
- *          Note: this function is used only for debug puposes, 
- *          so no locking mechanism optimization has been developed
+ *  @brief  RCU callback freeing a single level (old epoch no more referenced)
+ *  
+ *  @param  head rcu_head of the level
  *  
  */ 
-static void print_tag(void){
-
-    int i;
-    tag_t*  tag_ptr;
-    tag_t   tag;
-    tag_table_entry_t* tag_table_entry;
-
-    printk("%s: Printing all Tags info\n", "PRINT-TAG");
-   
-    for(i = 0; i < MAX_TAGS; i++) {
-
-        if(unlikely(down_read_interruptible(&(tag_lock[i])) == -EINTR)) {                
-            PRINT
-            printk("%s: RW Lock was interrupted.\n", MODNAME);
-            continue;
-        }
-                 
-        tag_ptr = tags[i];
-        
-        if(tag_ptr != 0) {
-           
-            tag = *tag_ptr;
-
-            printk("Key %d; Tag desc %d; Perm %d; Ready %d; Counter %d\n", 
-                    tag.key, tag.tag_key, tag.permission, tag.ready, tag.waiting.counter);
-
-
-        }
-
-        up_read(&(tag_lock[i]));
-
-    }
-
-    if(unlikely(down_read_interruptible(&common_lock) == -EINTR)) {                
-        PRINT
-        printk("%s: RW Lock was interrupted.\n", MODNAME); 
-        return;
-    }
-
-
-    printk("%s: Hahsmap content: %ld items\n", "PRINT-HASH", hashmap_count(tag_table));    
-    
-
-    for(i = 0; i < MAX_TAGS; i++) {
-
-
-        if(unlikely(down_read_interruptible(&(tag_lock[i])) == -EINTR)) {                
-            PRINT
-            printk("%s: RW Lock was interrupted.\n", MODNAME);
-            up_read(&common_lock);
-            continue;
-        }
-        
-        tag_ptr = tags[i];
-        
-        if(tag_ptr != 0) {
-
-            tag = *tag_ptr;
-    
-            tag_table_entry = hashmap_get(tag_table, &(tag_table_entry_t){ .key = tag.key});
-            if(tag_table_entry != 0)
-                printk("Key %d; Tag Key %d\n", 
-                    tag_table_entry -> key, tag_table_entry -> tag_key);
-
-            
+static void free_level_rcu(struct rcu_head* head) {
+    free_level(container_of(head, tag_level_t, rcu));
+}
 
-        }
+/**
+ *  @brief  RCU callback freeing a deleted Tag with all its levels
+ *  
+ *  @param  head rcu_head of the Tag
+ *  
+ */ 
+static void free_tag_rcu(struct rcu_head* head) {
 
-        up_read(&(tag_lock[i]));
- 
+    tag_t* tag_entry;
+    tag_entry = container_of(head, tag_t, rcu);
+
+    clear_tag_level(tag_entry -> tag_level);
+    kfree(tag_entry -> tag_level);
+    clear_tag_retained(tag_entry -> retained);
+    free_percpu(tag_entry -> stats);
+    if(tag_entry -> latency != 0) {
+        free_percpu(tag_entry -> latency);
+        atomic_long_dec(&tag_mem_latency);
     }
-    
-    up_read(&common_lock);
+    kfree(tag_entry);
+    atomic_long_dec(&tag_mem_tags);
 }
 
-
 /**
- *  @brief  Print the content of the level specified (the one that have been created)
- *          Note: no lock has been introduced because the function gets called while 
- *          already having the level locked
+ *  @brief  Allocate the latency histograms of a Tag, called by the first sample taken while latency_hist is set
+ *          (see TAG_LAT_ADD). The caller holds tag_lock in read or is counted as waiting, so the Tag can't be freed meanwhile
  *  
+ *  @param  tag_entry Tag to allocate the histograms of
+ *  
+ *  @return the histograms of the Tag, 0 if they could not be allocated (the sample is lost)
  */ 
-static void print_level(tag_level_t* tag_level, int tag) {
-    
-    if(tag_level == 0) return;
-    printk("%s: (TID: %d) Tag: %d, level: %d, epoch: %d, waiting: %d (ready %d), size: %ld, buffer: %s \n", 
-        "PRINT-LEVEL", current -> pid, tag, tag_level -> level, tag_level -> epoch, atomic_read(&(tag_level -> waiting)), tag_level -> ready, 
-        tag_level -> size, tag_level -> buffer);
+tag_latency_t __percpu *tag_latency_alloc(tag_t* tag_entry) {
 
-}
+    tag_latency_t __percpu *latency;
+    tag_latency_t __percpu *old;
 
+    latency = alloc_percpu(tag_latency_t);
+    if(unlikely(latency == 0)) return 0;
 
+    // Another receiver may have allocated them meanwhile
+    old = cmpxchg(&(tag_entry -> latency), NULL, latency);
+    if(old != 0) {
+        free_percpu(latency);
+        return old;
+    }
 
+    atomic_long_inc(&tag_mem_latency);
+    return latency;
+}
 
 
+// Operations of the multiplexed system call (tag_op), each one with the tracing and profiling of its system call
 
+static long tag_op_get(struct tag_args* args) {
+        int ret_val;
+        ret_val = tag_get(args -> key, args -> command, args -> permission);
+        trace_tag_get(args -> key, args -> command, args -> permission, ret_val);
+        return ret_val;
+}
 
+static long tag_op_send(struct tag_args* args) {
+        int ret_val, outcome;
+        PROF_DECLARE(t);
+        PROF_START(t);
+        ret_val = tag_send(args -> tag, args -> level, (char *) (uintptr_t) args -> buffer, args -> size, &outcome);
+        PROF_END(t, TAG_PROF_SEND_TOTAL);
+        trace_tag_send(args -> tag, args -> level, args -> size, outcome, ret_val);
+        return ret_val;
+}
 
+static long tag_op_receive(struct tag_args* args) {
+        int ret_val, epoch;
+        PROF_DECLARE(t);
+        trace_tag_receive_enter(args -> tag, args -> level, args -> size);
+        PROF_START(t);
+        ret_val = tag_receive_common(args, &epoch);
+        PROF_END(t, TAG_PROF_RECV_TOTAL);
+        trace_tag_receive_exit(args -> tag, args -> level, epoch, ret_val);
+        return ret_val;
+}
 
+static long tag_op_receive_any(struct tag_args* args) {
+        int ret_val, epoch;
+        PROF_DECLARE(t);
+        trace_tag_receive_enter(args -> tag, -1, args -> size);
+        PROF_START(t);
+        ret_val = tag_receive_any(args, &epoch);
+        PROF_END(t, TAG_PROF_RECV_TOTAL);
+        trace_tag_receive_exit(args -> tag, ret_val == 1 ? args -> level : -1, epoch, ret_val);
+        return ret_val;
+}
 
+static long tag_op_wait_multi(struct tag_args* args) {
+        int ret_val, epoch;
+        PROF_DECLARE(t);
+        trace_tag_receive_enter(-1, -1, args -> size);
+        PROF_START(t);
+        ret_val = tag_wait_multi(args, &epoch);
+        PROF_END(t, TAG_PROF_RECV_TOTAL);
+        trace_tag_receive_exit(-1, -1, epoch, ret_val);
+        return ret_val;
+}
 
+static long tag_op_ctl(struct tag_args* args) {
+        int ret_val;
+        ret_val = tag_ctl(args -> tag, args -> command);
+        trace_tag_ctl(args -> tag, args -> command, ret_val);
+        return ret_val;
+}
 
+// Jump table of tag_op(), indexed by TAG_OP_*
+static long (* const tag_op_table[TAG_OPS])(struct tag_args* args) = {
+    [TAG_OP_GET]            = tag_op_get,
+    [TAG_OP_SEND]           = tag_op_send,
+    [TAG_OP_RECEIVE]        = tag_op_receive,
+    [TAG_OP_CTL]            = tag_op_ctl,
+    [TAG_OP_RECEIVE_ANY]    = tag_op_receive_any,
+    [TAG_OP_WAIT_MULTI]     = tag_op_wait_multi,
+};
 
+/**
+ *  @brief  Run a Tag operation (body of the multiplexed system call)
+ *  
+ *  @param  op one of TAG_OP_*
+ *  @param  args arguments of the operation (in kernel memory, the message buffer is still a user pointer)
+ * 
+ *  @return the return value of the operation, -EINVAL if op is not valid
+ */
+long tag_op(unsigned int op, struct tag_args* args) {
 
+    if(unlikely(op >= TAG_OPS)) return -EINVAL;
 
+    // Don't let a mispredicted bound check index past the table
+    return tag_op_table[array_index_nospec(op, TAG_OPS)](args);
+}
 
 
+#ifndef TEST_FUNC
 
 // Syscall define and install syscall routines
 
+// Set to 0 to install only tag_op (1 system call table entry instead of 5)
+static int legacy_syscalls = 1;
+module_param(legacy_syscalls, int, S_IRUGO);
+MODULE_PARM_DESC(legacy_syscalls, "Install tag_get/tag_send/tag_receive/tag_ctl besides tag_op (1) or not (0)");
+
 
 __SYSCALL_DEFINEx(3, _tag_get, int, key, int, command, int, permission){ 
-        int ret_val;
+        struct tag_args args = { .key = key, .command = command, .permission = permission };
+        long ret_val;
         if(!try_module_get(THIS_MODULE)) {
             printk("%s: Fatal Error: could not lock module!", MODNAME);
             return -1;
         }
-        ret_val = tag_get(key, command, permission);
+        ret_val = tag_op_get(&args);
         module_put(THIS_MODULE);
         return ret_val;
 }
@@ -1190,12 +2007,13 @@ unsigned long sys_tag_get;
 
 
 __SYSCALL_DEFINEx(4, _tag_send, int, tag, int, level, char*, buffer, size_t, size) {
-        int ret_val;
+        struct tag_args args = { .tag = tag, .level = level, .buffer = (uintptr_t) buffer, .size = size };
+        long ret_val;
         if(!try_module_get(THIS_MODULE)) {
             printk("%s: Fatal Error: could not lock module!", MODNAME);
             return -1;
         }
-        ret_val = tag_send(tag, level, buffer, size);
+        ret_val = tag_op_send(&args);
         module_put(THIS_MODULE);
         return ret_val;
 }
@@ -1204,12 +2022,13 @@ unsigned long sys_tag_send;
 
 
 __SYSCALL_DEFINEx(4, _tag_receive, int, tag, int, level, char*, buffer, size_t, size) {
-        int ret_val;
+        struct tag_args args = { .tag = tag, .level = level, .buffer = (uintptr_t) buffer, .size = size };
+        long ret_val;
         if(!try_module_get(THIS_MODULE)) {
             printk("%s: Fatal Error: could not lock module!", MODNAME);
             return -1;
         }
-        ret_val = tag_receive(tag, level, buffer, size);
+        ret_val = tag_op_receive(&args);
         module_put(THIS_MODULE);
         return ret_val;
 }
@@ -1218,12 +2037,13 @@ unsigned long sys_tag_receive;
 
 
 __SYSCALL_DEFINEx(2, _tag_ctl, int, tag, int, command) {
-        int ret_val;
+        struct tag_args args = { .tag = tag, .command = command };
+        long ret_val;
         if(!try_module_get(THIS_MODULE)) {
             printk("%s: Fatal Error: could not lock module!", MODNAME);
             return -1;
         }
-        ret_val = tag_ctl(tag, command);
+        ret_val = tag_op_ctl(&args);
         module_put(THIS_MODULE);
         return ret_val;
 }
@@ -1231,21 +2051,51 @@ __SYSCALL_DEFINEx(2, _tag_ctl, int, tag, int, command) {
 unsigned long sys_tag_ctl;    
 
 
+__SYSCALL_DEFINEx(2, _tag_op, unsigned int, op, struct tag_args __user *, uargs) {
+        struct tag_args args;
+        long ret_val;
+        if(unlikely(copy_from_user(&args, uargs, sizeof(args)) != 0)) return -EFAULT;
+        if(!try_module_get(THIS_MODULE)) {
+            printk("%s: Fatal Error: could not lock module!", MODNAME);
+            return -1;
+        }
+        ret_val = tag_op(op, &args);
+        module_put(THIS_MODULE);
+        // Sequence (and level) of the message received back to the user
+        if(op == TAG_OP_RECEIVE && ret_val == 1 && unlikely(put_user(args.seq, &(uargs -> seq)) != 0)) return -EFAULT;
+        if(op == TAG_OP_RECEIVE_ANY && ret_val == 1 &&
+           unlikely(put_user(args.seq, &(uargs -> seq)) != 0 || put_user(args.level, &(uargs -> level)) != 0)) return -EFAULT;
+        if(op == TAG_OP_WAIT_MULTI && ret_val >= 0 &&
+           unlikely(put_user(args.seq, &(uargs -> seq)) != 0 || put_user(args.index, &(uargs -> index)) != 0)) return -EFAULT;
+        return ret_val;
+}
+
+unsigned long sys_tag_op;
+
+
 int install_syscalls(void) {
     
     sys_tag_get     = (unsigned long) __x64_sys_tag_get;
     sys_tag_send    = (unsigned long) __x64_sys_tag_send;
     sys_tag_receive = (unsigned long) __x64_sys_tag_receive;
     sys_tag_ctl     = (unsigned long) __x64_sys_tag_ctl;
+    sys_tag_op      = (unsigned long) __x64_sys_tag_op;
 
     
 
     
-    tag_get_nr      = syscall_insert((unsigned long *) sys_tag_get);
-    tag_send_nr     = syscall_insert((unsigned long *) sys_tag_send);
-    tag_receive_nr  = syscall_insert((unsigned long *) sys_tag_receive);
-    tag_ctl_nr      = syscall_insert((unsigned long *) sys_tag_ctl);
+    if(legacy_syscalls) {
+        tag_get_nr      = syscall_insert((unsigned long *) sys_tag_get);
+        tag_send_nr     = syscall_insert((unsigned long *) sys_tag_send);
+        tag_receive_nr  = syscall_insert((unsigned long *) sys_tag_receive);
+        tag_ctl_nr      = syscall_insert((unsigned long *) sys_tag_ctl);
+    }
+    tag_op_nr       = syscall_insert((unsigned long *) sys_tag_op);
+
+    if(!legacy_syscalls) return tag_op_nr;
 
-    return tag_get_nr * tag_send_nr * tag_receive_nr * tag_ctl_nr;
+    return tag_get_nr * tag_send_nr * tag_receive_nr * tag_ctl_nr * tag_op_nr;
 
 }
+
+#endif
@@ -0,0 +1,191 @@
+/**
+ *  @file   tag-trace.h
+ *  @brief  Tracepoints of the Tag system calls (system "tagmod"), usable with perf, trace-cmd, bpftrace
+ *          or directly from /sys/kernel/tracing/events/tagmod. A disabled tracepoint is a static branch
+ *          that is never taken, so they are always compiled in.
+ *          CREATE_TRACE_POINTS is defined only in tag-syscall.c
+ *  @author Andrea Paci
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tagmod
+
+#if !defined(_TAG_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TAG_TRACE_H
+
+#include <linux/tracepoint.h>
+
+
+// Outcome of a tag_send(), TAG_SEND_* of include/tag.h
+#define show_send_outcome(outcome)                              \
+    __print_symbolic(outcome,                                   \
+        { TAG_SEND_DELIVERED,       "delivered" },              \
+        { TAG_SEND_NO_RECEIVERS,    "no_receivers" },           \
+        { TAG_SEND_BUSY,            "busy" },                   \
+        { TAG_SEND_READY,           "ready" },                  \
+        { TAG_SEND_ERROR,           "error" })
+
+#define show_get_command(command)                               \
+    __print_symbolic(command,                                   \
+        { TAG_OPEN,     "TAG_OPEN" },                           \
+        { TAG_CREAT,    "TAG_CREAT" })
+
+#define show_ctl_command(command)                               \
+    __print_symbolic(command,                                   \
+        { TAG_AWAKE_ALL,    "TAG_AWAKE_ALL" },                  \
+        { TAG_DELETE,       "TAG_DELETE" })
+
+
+TRACE_EVENT(tag_get,
+
+    TP_PROTO(int key, int command, int permission, int ret),
+
+    TP_ARGS(key, command, permission, ret),
+
+    TP_STRUCT__entry(
+        __field(int, key)
+        __field(int, command)
+        __field(int, permission)
+        __field(int, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->key        = key;
+        __entry->command    = command;
+        __entry->permission = permission;
+        __entry->ret        = ret;
+    ),
+
+    TP_printk("key=%d command=%s permission=%d ret=%d",
+        __entry->key, show_get_command(__entry->command), __entry->permission, __entry->ret)
+);
+
+TRACE_EVENT(tag_send,
+
+    TP_PROTO(int tag, int level, size_t size, int outcome, int ret),
+
+    TP_ARGS(tag, level, size, outcome, ret),
+
+    TP_STRUCT__entry(
+        __field(int, tag)
+        __field(int, level)
+        __field(size_t, size)
+        __field(int, outcome)
+        __field(int, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->tag        = tag;
+        __entry->level      = level;
+        __entry->size       = size;
+        __entry->outcome    = outcome;
+        __entry->ret        = ret;
+    ),
+
+    TP_printk("tag=%d level=%d size=%zu outcome=%s ret=%d",
+        __entry->tag, __entry->level, __entry->size, show_send_outcome(__entry->outcome), __entry->ret)
+);
+
+TRACE_EVENT(tag_receive_enter,
+
+    TP_PROTO(int tag, int level, size_t size),
+
+    TP_ARGS(tag, level, size),
+
+    TP_STRUCT__entry(
+        __field(int, tag)
+        __field(int, level)
+        __field(size_t, size)
+    ),
+
+    TP_fast_assign(
+        __entry->tag    = tag;
+        __entry->level  = level;
+        __entry->size   = size;
+    ),
+
+    TP_printk("tag=%d level=%d size=%zu", __entry->tag, __entry->level, __entry->size)
+);
+
+// Receiver back from the wait: woken by a send (level ready), an AWAKE_ALL (tag ready) or a signal
+TRACE_EVENT(tag_receive_wake,
+
+    TP_PROTO(int tag, int level, int epoch, int level_ready, int tag_ready, int wait_ret),
+
+    TP_ARGS(tag, level, epoch, level_ready, tag_ready, wait_ret),
+
+    TP_STRUCT__entry(
+        __field(int, tag)
+        __field(int, level)
+        __field(int, epoch)
+        __field(int, level_ready)
+        __field(int, tag_ready)
+        __field(int, wait_ret)
+    ),
+
+    TP_fast_assign(
+        __entry->tag            = tag;
+        __entry->level          = level;
+        __entry->epoch          = epoch;
+        __entry->level_ready    = level_ready;
+        __entry->tag_ready      = tag_ready;
+        __entry->wait_ret       = wait_ret;
+    ),
+
+    TP_printk("tag=%d level=%d epoch=%d level_ready=%d tag_ready=%d wait_ret=%d",
+        __entry->tag, __entry->level, __entry->epoch, __entry->level_ready, __entry->tag_ready, __entry->wait_ret)
+);
+
+// Epoch is -1 if the receiver returned before joining a level
+TRACE_EVENT(tag_receive_exit,
+
+    TP_PROTO(int tag, int level, int epoch, int ret),
+
+    TP_ARGS(tag, level, epoch, ret),
+
+    TP_STRUCT__entry(
+        __field(int, tag)
+        __field(int, level)
+        __field(int, epoch)
+        __field(int, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->tag    = tag;
+        __entry->level  = level;
+        __entry->epoch  = epoch;
+        __entry->ret    = ret;
+    ),
+
+    TP_printk("tag=%d level=%d epoch=%d ret=%d", __entry->tag, __entry->level, __entry->epoch, __entry->ret)
+);
+
+TRACE_EVENT(tag_ctl,
+
+    TP_PROTO(int tag, int command, int ret),
+
+    TP_ARGS(tag, command, ret),
+
+    TP_STRUCT__entry(
+        __field(int, tag)
+        __field(int, command)
+        __field(int, ret)
+    ),
+
+    TP_fast_assign(
+        __entry->tag        = tag;
+        __entry->command    = command;
+        __entry->ret        = ret;
+    ),
+
+    TP_printk("tag=%d command=%s ret=%d", __entry->tag, show_ctl_command(__entry->command), __entry->ret)
+);
+
+#endif /* _TAG_TRACE_H */
+
+// This part must be outside the protection
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tag-trace
+#include <trace/define_trace.h>
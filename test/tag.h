@@ -6,7 +6,9 @@
  */ 
 
 #include <sys/syscall.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include "../tag-module/include/tag.h"
 
 #ifndef TAG_GET_NR
@@ -29,11 +31,127 @@
 #define TAG_CTL_NR 183
 #endif
 
+#ifndef TAG_OP_NR
+#warning "tag_op() syscall number not defined"
+#define TAG_OP_NR 214
+#endif
+
+// Multiplexed entry of every operation (see TAG_OP_* in tag-module/include/tag.h)
+long tag_op(unsigned int op, struct tag_args* args) {
+    return syscall(TAG_OP_NR, op, args);
+}
+
+// Status page of the module (see struct tag_status_entry), 0 if not mapped
+static const volatile struct tag_status_page* tag_status;
+
+// Map the status page: from then on tag_send() returns 0 without the system call when nobody can receive
+int tag_status_map(void) {
+    void* page;
+    int fd;
+
+    fd = open("/dev/tag_info", O_RDONLY);
+    if(fd < 0) return -1;
+    page = mmap(0, TAG_STATUS_SIZE, PROT_READ, MAP_SHARED, fd, TAG_STATUS_OFFSET);
+    close(fd);
+    if(page == MAP_FAILED) return -1;
+
+    tag_status = page;
+    return 0;
+}
+
+// 1 if tag_send() would surely discard the message: only for TAG_PERM_ALL Tags (the permission check of a
+// TAG_PERM_USR Tag must still be done by the module), not TAG_RETAIN ones (which keep every message) and
+// valid arguments (so errors are still reported)
+static inline int tag_send_skip(int tag, int level, size_t size) {
+    const volatile struct tag_status_entry* entry;
+
+    if(tag_status == 0 || tag < 0 || tag >= TAG_INFO_TAGS || level < 0 || level >= TAG_INFO_LEVELS || size > TAG_INFO_MSG)
+        return 0;
+
+    entry = &(tag_status -> tag[tag]);
+    return entry -> exists && entry -> permission == TAG_PERM_ALL && !entry -> retain &&
+           (entry -> waiting == 0 || entry -> level_waiting[level] == 0);
+}
+
+// Messages delivered so far on a level, as seen in the status page (-1 if not mapped or wrong arguments)
+static inline long tag_level_seq(int tag, int level) {
+    if(tag_status == 0 || tag < 0 || tag >= TAG_INFO_TAGS || level < 0 || level >= TAG_INFO_LEVELS) return -1;
+    return tag_status -> tag[tag].level_seq[level];
+}
+
+// tag_receive() busy-polling the level up to spin_ns before sleeping (for receivers pinned to an isolated core)
+int tag_receive_spin(int tag, int level, char* buffer, size_t size, unsigned int spin_ns) {
+    struct tag_args args = { .tag = tag, .level = level, .buffer = (__u64) (unsigned long) buffer, .size = size, .spin_ns = spin_ns };
+    return tag_op(TAG_OP_RECEIVE, &args);
+}
+
+// Last message of a level of a TAG_RETAIN Tag if newer than *seq (at once), otherwise the next one (waiting as
+// tag_receive()). *seq is set to the sequence of the message received: start from 0 and pass it back each time.
+// With the status page mapped, a receiver can also spin until tag_level_seq() differs from *seq and then call this
+int tag_receive_latest(int tag, int level, char* buffer, size_t size, unsigned long long* seq) {
+    struct tag_args args = { .tag = tag, .level = level, .buffer = (__u64) (unsigned long) buffer, .size = size,
+                             .command = TAG_RECV_LATEST, .seq = *seq };
+    int ret;
+
+    ret = tag_op(TAG_OP_RECEIVE, &args);
+    if(ret == 1) *seq = args.seq;
+    return ret;
+}
+
+// Receive from the first of the levels in level_mask (bit i for level i) to get a message, *level set to it
+int tag_receive_any(int tag, unsigned int level_mask, char* buffer, size_t size, int* level) {
+    struct tag_args args = { .tag = tag, .level_mask = level_mask, .buffer = (__u64) (unsigned long) buffer, .size = size };
+    int ret;
+
+    ret = tag_op(TAG_OP_RECEIVE_ANY, &args);
+    if(ret == 1) *level = args.level;
+    return ret;
+}
+
+// Wait on "count" (tag, level) pairs, also of different Tags: the message of the first pair to get one is copied
+// to buffer, *index set to the position of the pair that woke the thread up (-1 if none)
+int tag_wait_multi(const struct tag_wait_pair* pairs, int count, char* buffer, size_t size, int* index) {
+    struct tag_args args = { .pairs = (__u64) (unsigned long) pairs, .count = count, .buffer = (__u64) (unsigned long) buffer, .size = size };
+    int ret;
+
+    ret = tag_op(TAG_OP_WAIT_MULTI, &args);
+    if(ret >= 0) *index = args.index;
+    return ret;
+}
+
+#ifdef TAG_MULTIPLEXED
+
+// The four operations through tag_op (module loaded with legacy_syscalls=0)
+
+int tag_get(int key, int command, int permission) {
+    struct tag_args args = { .key = key, .command = command, .permission = permission };
+    return tag_op(TAG_OP_GET, &args);
+}
+
+int tag_send(int tag, int level, char* buffer, size_t size) {
+    struct tag_args args = { .tag = tag, .level = level, .buffer = (__u64) (unsigned long) buffer, .size = size };
+    if(tag_send_skip(tag, level, size)) return 0;
+    return tag_op(TAG_OP_SEND, &args);
+}
+
+int tag_receive(int tag, int level, char* buffer, size_t size) {
+    struct tag_args args = { .tag = tag, .level = level, .buffer = (__u64) (unsigned long) buffer, .size = size };
+    return tag_op(TAG_OP_RECEIVE, &args);
+}
+
+int tag_ctl(int tag, int command) {
+    struct tag_args args = { .tag = tag, .command = command };
+    return tag_op(TAG_OP_CTL, &args);
+}
+
+#else
+
 int tag_get(int key, int command, int permission) {
     return syscall(TAG_GET_NR, key, command, permission);
 }
 
 int tag_send(int tag, int level, char* buffer, size_t size) {
+    if(tag_send_skip(tag, level, size)) return 0;
     return syscall(TAG_SEND_NR, tag, level, buffer, size);
 }
 
@@ -44,3 +162,5 @@ int tag_receive(int tag, int level, char* buffer, size_t size) {
 int tag_ctl(int tag, int command) {
     return syscall(TAG_CTL_NR, tag, command);
 }
+
+#endif
@@ -0,0 +1,1343 @@
+/**
+ *  @file   tag_bench.c
+ *  @brief  Benchmark of the TAG Module system calls, meant to compare runs across module versions.
+ *          Scenarios:
+ *              - pingpong : two threads bouncing a message on two levels of a Tag (half round trip latency)
+ *              - fanout   : 1 sender, N receivers on the same level (latency of every receiver and of the last one)
+ *              - fanin    : N senders, 1 receiver on the same level for a fixed time (throughput, latency and drop rate)
+ *              - churn    : N threads creating and deleting IPC_PRIVATE Tags (tag_get and tag_ctl latency)
+ *              - multitag : N Tags, each one with its own ping-pong pair running concurrently (aggregate throughput)
+ *              - matrix   : sweep of senders x receivers x levels x tags (lists given with -S -R -L -T), every cell runs
+ *                           for a fixed time and reports receive throughput, latency and drop rate (not part of "all")
+ *              - openloop : N generators sending at a fixed offered rate (-Q list, constant or Poisson arrivals with -P)
+ *                           on every level (-L) of every Tag (-T), one receiver each. The payload carries the intended
+ *                           send time, so the latency includes the time a late generator spent behind schedule, and
+ *                           every rate reports delivered vs dropped sends (not part of "all")
+ *              - memory   : for every number of Tags in -T, memory held by the module (TAG_INFO_MEMORY) and growth of
+ *                           /proc/meminfo with no receiver, with -R receivers on each of the -L levels, and with a second
+ *                           batch of receivers arriving while the first one is still receiving (epoch levels). The counters
+ *                           are read again after deleting the Tags to catch leaks (not part of "all")
+ *              - kwake    : the module's periodic publisher (TAG_INFO_PUBLISH_START, needs root) sends every -p us to N
+ *                           receivers; the latency from the kernel publication ("wake") and from the hrtimer deadline
+ *                           ("timer_wake") excludes any userspace sender jitter (not part of "all")
+ *          Timestamps are taken with clock_gettime(CLOCK_MONOTONIC) and travel in the message payload, so that
+ *          latencies between threads on different CPUs are comparable. The first "warmup" iterations are not recorded.
+ *          Results are printed as text, CSV or JSON (one record per measure, with percentiles)
+ *          The fanout scenario reads the waiting receivers with the TAG_INFO_SNAPSHOT ioctl on /dev/tag_info
+ *          Threads are pinned round robin on the CPUs given with -c, or on the CPUs of the NUMA nodes given with -N
+ *          (taken alternately from each node, so "-N 0,1" spreads the threads across two sockets)
+ *
+ *          Usage: tag_bench.o [-s scenario|all] [-n iterations] [-w warmup] [-r threads] [-m msg size]
+ *                             [-d seconds] [-c cpu,cpu,...] [-N node,node,...] [-o text|csv|json]
+ *                             [-S senders,...] [-R receivers,...] [-L levels,...] [-T tags,...]
+ *                             [-Q rate,...] [-P constant|poisson] [-p period us]
+ *  @author Andrea Paci
+ */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/ipc.h>
+#include "tag.h"
+
+
+#define MAX_THREADS 256
+#define MAX_CPUS    256
+
+#define MATRIX_WARMUP_MS    200         // Time every matrix cell runs before measuring
+#define MATRIX_SAMPLES      (1 << 16)   // Latency samples kept by each receiver of a cell (the latest ones)
+
+// Header of every message, the rest of the payload is padding up to the message size
+typedef struct payload {
+    uint64_t timestamp;     // Send time (ns)
+    uint64_t round;         // Iteration the message belongs to
+} payload_t;
+
+// A single measure: latency samples (ns) plus throughput and drop counters
+typedef struct result {
+    const char* scenario;
+    const char* measure;
+    int threads;
+    int senders, receivers, levels, tags;   // Cell of the matrix scenario (0 otherwise)
+    double rate;                            // Offered load of the openloop scenario (msgs/s, 0 otherwise)
+    size_t size;
+    uint64_t* samples;
+    long count;
+    long ops;               // Operations done in "seconds" if not all of them have a sample (0: count)
+    double seconds;         // Wall time of the measure, for the throughput
+    long attempts;          // Sends tried (fanin) or operations failed (churn)
+    long delivered;
+} result_t;
+
+
+// Options
+static int iterations   = 10000;
+static int warmup       = 1000;
+static int threads      = 4;
+static size_t msg_size  = 64;
+static int duration     = 2;
+static int cpus[MAX_CPUS];
+static int ncpus        = 0;
+static enum { OUT_TEXT, OUT_CSV, OUT_JSON } output = OUT_TEXT;
+
+// Axes of the matrix scenario
+static int senders_list[MAX_CPUS]   = { 1, 2, 4 };
+static int receivers_list[MAX_CPUS] = { 1, 2, 4 };
+static int levels_list[MAX_CPUS]    = { 1 };
+static int tags_list[MAX_CPUS]      = { 1 };
+static int senders_n = 3, receivers_n = 3, levels_n = 1, tags_n = 1;
+
+// Offered loads of the openloop scenario
+static double rates_list[MAX_CPUS]  = { 1000, 10000, 100000 };
+static int rates_n = 3;
+static int poisson = 1;
+
+// Period of the kwake scenario
+static int period_us    = 1000;
+
+// Senders skip the system call when the status page shows no receivers (-k)
+static int status_page  = 0;
+
+// Receivers busy-poll the level before sleeping (-b)
+static unsigned int spin_ns = 0;
+
+static int printed      = 0;
+static int dev_fd       = -1;
+
+
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Parse a comma separated list of integers, returns the number of elements
+static int parse_list(char* str, int* list, int max) {
+    char* token;
+    int n = 0;
+    for(token = strtok(str, ","); token != 0 && n < max; token = strtok(0, ","))
+        list[n++] = atoi(token);
+    return n;
+}
+
+// Fill the CPU list with the CPUs of the given NUMA nodes, one node after the other
+static int node_cpus(int* nodes, int nnodes) {
+
+    int node_cpu[MAX_CPUS][MAX_CPUS / 4];
+    int node_n[MAX_CPUS];
+    char path[64], line[1024];
+    char* token;
+    FILE* file;
+    int i, j, first, last, left;
+
+    for(i = 0; i < nnodes; i++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+        file = fopen(path, "r");
+        if(file == 0 || fgets(line, sizeof(line), file) == 0) {
+            printf("Error in reading %s\n", path);
+            if(file != 0) fclose(file);
+            return -1;
+        }
+        fclose(file);
+
+        // Format: "0-3,8-11"
+        node_n[i] = 0;
+        for(token = strtok(line, ",\n"); token != 0; token = strtok(0, ",\n")) {
+            if(sscanf(token, "%d-%d", &first, &last) != 2) last = first = atoi(token);
+            for(j = first; j <= last && node_n[i] < MAX_CPUS / 4; j++) node_cpu[i][node_n[i]++] = j;
+        }
+    }
+
+    ncpus = 0;
+    for(j = 0, left = 1; left && ncpus < MAX_CPUS; j++) {
+        left = 0;
+        for(i = 0; i < nnodes && ncpus < MAX_CPUS; i++) {
+            if(j >= node_n[i]) continue;
+            cpus[ncpus++] = node_cpu[i][j];
+            left = 1;
+        }
+    }
+    return 0;
+}
+
+// Pin the calling thread on the "index"-th CPU of the list given with -c or -N (round robin)
+static void pin(int index) {
+    cpu_set_t set;
+    if(ncpus == 0) return;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[index % ncpus], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// tag_send() until delivered (a send is discarded if the receiver is not waiting yet or the level is still busy)
+static int send_retry(int tag, int level, char* buffer, size_t size) {
+    int ret, tries;
+    tries = 0;
+    while((ret = tag_send(tag, level, buffer, size)) == 0) {
+        if(++tries % 64 == 0) sched_yield();
+        else __builtin_ia32_pause();
+    }
+    return ret;
+}
+
+// tag_receive(), busy-polling in the module before sleeping with -b
+static inline int bench_receive(int tag, int level, char* buffer, size_t size) {
+    if(spin_ns > 0) return tag_receive_spin(tag, level, buffer, size, spin_ns);
+    return tag_receive(tag, level, buffer, size);
+}
+
+// Wait until "n" receivers are waiting on the level (TAG_INFO_SNAPSHOT)
+static int wait_receivers(int tag, int level, int n) {
+    struct tag_info info;
+    struct tag_info_req req;
+    for(;;) {
+        req.start = tag;
+        req.count = 1;
+        req.buf = (uint64_t) (uintptr_t) &info;
+        if(ioctl(dev_fd, TAG_INFO_SNAPSHOT, &req) < 0) return -1;
+        if(req.count == 1 && info.tag == tag && info.level[level].waiting >= n) return 0;
+        sched_yield();
+    }
+}
+
+// Remove a Tag, waking up whoever is still waiting on it
+static void destroy_tag(int tag) {
+    while(tag_ctl(tag, TAG_DELETE) == 0) {
+        tag_ctl(tag, TAG_AWAKE_ALL);
+        sched_yield();
+    }
+}
+
+
+
+// ---------------- Results ----------------
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(uint64_t* sorted, long count, double p) {
+    long index;
+    if(count == 0) return 0;
+    index = (long) (p / 100.0 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void print_result(result_t* res) {
+
+    double mean, throughput, drop;
+    uint64_t p50, p90, p99, p999, min, max;
+    long i;
+
+    qsort(res -> samples, res -> count, sizeof(uint64_t), compare_u64);
+
+    mean = 0;
+    for(i = 0; i < res -> count; i++) mean += res -> samples[i];
+    if(res -> count > 0) mean /= res -> count;
+
+    min  = res -> count ? res -> samples[0] : 0;
+    max  = res -> count ? res -> samples[res -> count - 1] : 0;
+    p50  = percentile(res -> samples, res -> count, 50);
+    p90  = percentile(res -> samples, res -> count, 90);
+    p99  = percentile(res -> samples, res -> count, 99);
+    p999 = percentile(res -> samples, res -> count, 99.9);
+    throughput = res -> seconds > 0 ? (res -> ops ? res -> ops : res -> count) / res -> seconds : 0;
+    drop = res -> attempts > 0 ? 1.0 - (double) res -> delivered / res -> attempts : 0;
+
+    switch(output) {
+    case OUT_TEXT:
+        if(res -> senders > 0)
+            printf("S %2d R %2d L %2d T %3d | ", res -> senders, res -> receivers, res -> levels, res -> tags);
+        if(res -> rate > 0) printf("rate %10.0f | ", res -> rate);
+        printf("%-9s %-10s threads %3d size %5zu | n %8ld | ns min %8lu p50 %8lu p90 %8lu p99 %8lu p99.9 %8lu max %9lu mean %10.1f | %12.1f ops/s",
+            res -> scenario, res -> measure, res -> threads, res -> size, res -> count,
+            min, p50, p90, p99, p999, max, mean, throughput);
+        if(res -> attempts > 0) printf(" | drop %.4f", drop);
+        printf("\n");
+        break;
+    case OUT_CSV:
+        if(printed == 0)
+            printf("scenario,measure,threads,senders,receivers,levels,tags,rate,size,count,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,mean_ns,ops_per_sec,attempts,delivered,drop_rate\n");
+        printf("%s,%s,%d,%d,%d,%d,%d,%.1f,%zu,%ld,%lu,%lu,%lu,%lu,%lu,%lu,%.1f,%.1f,%ld,%ld,%.6f\n",
+            res -> scenario, res -> measure, res -> threads, res -> senders, res -> receivers, res -> levels, res -> tags,
+            res -> rate, res -> size, res -> count,
+            min, p50, p90, p99, p999, max, mean, throughput, res -> attempts, res -> delivered, drop);
+        break;
+    case OUT_JSON:
+        printf("%s\n  {\"scenario\": \"%s\", \"measure\": \"%s\", \"threads\": %d, \"senders\": %d, \"receivers\": %d, "
+               "\"levels\": %d, \"tags\": %d, \"rate\": %.1f, \"size\": %zu, \"count\": %ld, "
+               "\"min_ns\": %lu, \"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu, "
+               "\"mean_ns\": %.1f, \"ops_per_sec\": %.1f, \"attempts\": %ld, \"delivered\": %ld, \"drop_rate\": %.6f}",
+            printed == 0 ? "[" : ",", res -> scenario, res -> measure, res -> threads,
+            res -> senders, res -> receivers, res -> levels, res -> tags, res -> rate, res -> size, res -> count,
+            min, p50, p90, p99, p999, max, mean, throughput, res -> attempts, res -> delivered, drop);
+        break;
+    }
+    printed++;
+    fflush(stdout);
+}
+
+static result_t new_result(const char* scenario, const char* measure, int nthreads, long capacity) {
+    result_t res = { .scenario = scenario, .measure = measure, .threads = nthreads, .size = msg_size };
+    res.samples = malloc(sizeof(uint64_t) * (capacity > 0 ? capacity : 1));
+    if(res.samples == 0) {
+        printf("Error allocating samples\n");
+        exit(-1);
+    }
+    return res;
+}
+
+
+
+// ---------------- Ping-pong (and Multi-tag) ----------------
+
+typedef struct pp_arg {
+    int tag;
+    int index;
+    uint64_t* samples;      // Half round trip of every measured iteration
+    uint64_t start, end;
+} pp_arg_t;
+
+// Bounce every message from level 0 back on level 1
+static void* pong_thread(void* input) {
+    pp_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    int i;
+    pin(2 * arg -> index + 1);
+    for(i = 0; i < warmup + iterations; i++) {
+        if(bench_receive(arg -> tag, 0, buffer, msg_size) != 1) break;
+        if(send_retry(arg -> tag, 1, buffer, msg_size) < 0) break;
+    }
+    free(buffer);
+    return 0;
+}
+
+static void* ping_thread(void* input) {
+    pp_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    payload_t* msg = (payload_t*) buffer;
+    int i;
+    pin(2 * arg -> index);
+    for(i = 0; i < warmup + iterations; i++) {
+        if(i == warmup) arg -> start = now_ns();
+        msg -> timestamp = now_ns();
+        msg -> round = i;
+        if(send_retry(arg -> tag, 0, buffer, msg_size) < 0) break;
+        if(bench_receive(arg -> tag, 1, buffer, msg_size) != 1) break;
+        if(i >= warmup) arg -> samples[i - warmup] = (now_ns() - msg -> timestamp) / 2;
+    }
+    arg -> end = now_ns();
+    free(buffer);
+    return 0;
+}
+
+// "pairs" ping-pong pairs, each on its own Tag
+static int run_pingpong(const char* scenario, int pairs) {
+
+    pthread_t ping[MAX_THREADS], pong[MAX_THREADS];
+    pp_arg_t args[MAX_THREADS];
+    result_t res;
+    uint64_t start, end;
+    int i;
+
+    res = new_result(scenario, "half_rtt", pairs, (long) pairs * iterations);
+
+    for(i = 0; i < pairs; i++) {
+        args[i] = (pp_arg_t){ .index = i, .samples = res.samples + (long) i * iterations };
+        args[i].tag = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+        if(args[i].tag < 0) {
+            printf("Error in creating Tag: %d\n", args[i].tag);
+            return -1;
+        }
+    }
+    for(i = 0; i < pairs; i++) {
+        pthread_create(&pong[i], 0, pong_thread, &args[i]);
+        pthread_create(&ping[i], 0, ping_thread, &args[i]);
+    }
+    for(i = 0; i < pairs; i++) {
+        pthread_join(ping[i], 0);
+        pthread_join(pong[i], 0);
+        destroy_tag(args[i].tag);
+    }
+
+    start = args[0].start;
+    end = args[0].end;
+    for(i = 1; i < pairs; i++) {
+        if(args[i].start < start) start = args[i].start;
+        if(args[i].end > end) end = args[i].end;
+    }
+
+    res.count = (long) pairs * iterations;
+    res.seconds = (end - start) / 1e9;
+    print_result(&res);
+    free(res.samples);
+    return 0;
+}
+
+
+
+// ---------------- Fan-out ----------------
+
+typedef struct fo_arg {
+    int tag;
+    int index;
+    uint64_t* samples;      // Latency of this receiver for every round
+} fo_arg_t;
+
+static void* fanout_receiver(void* input) {
+    fo_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    payload_t* msg = (payload_t*) buffer;
+    pin(arg -> index + 1);
+    for(;;) {
+        if(bench_receive(arg -> tag, 0, buffer, msg_size) != 1) break;
+        if(msg -> round >= (uint64_t) warmup)
+            arg -> samples[msg -> round - warmup] = now_ns() - msg -> timestamp;
+    }
+    free(buffer);
+    return 0;
+}
+
+static int run_fanout(int receivers) {
+
+    pthread_t tid[MAX_THREADS];
+    fo_arg_t args[MAX_THREADS];
+    result_t all, last;
+    char* buffer;
+    payload_t* msg;
+    uint64_t start;
+    int tag, i, j;
+
+    if(dev_fd < 0) {
+        printf("fanout needs /dev/tag_info\n");
+        return -1;
+    }
+
+    tag = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+    if(tag < 0) {
+        printf("Error in creating Tag: %d\n", tag);
+        return -1;
+    }
+
+    all = new_result("fanout", "wake", receivers, (long) receivers * iterations);
+    last = new_result("fanout", "last_wake", receivers, iterations);
+    for(i = 0; i < receivers; i++) {
+        args[i] = (fo_arg_t){ .tag = tag, .index = i, .samples = all.samples + (long) i * iterations };
+        pthread_create(&tid[i], 0, fanout_receiver, &args[i]);
+    }
+
+    pin(0);
+    buffer = calloc(1, msg_size);
+    msg = (payload_t*) buffer;
+    start = 0;
+    for(i = 0; i < warmup + iterations; i++) {
+        // Every receiver must be back waiting, otherwise it would miss the message
+        if(wait_receivers(tag, 0, receivers) != 0) {
+            printf("Error in reading /dev/tag_info: %d\n", errno);
+            return -1;
+        }
+        if(i == warmup) start = now_ns();
+        msg -> timestamp = now_ns();
+        msg -> round = i;
+        send_retry(tag, 0, buffer, msg_size);
+    }
+    wait_receivers(tag, 0, receivers);
+    all.seconds = (now_ns() - start) / 1e9;
+
+    destroy_tag(tag);
+    for(i = 0; i < receivers; i++) pthread_join(tid[i], 0);
+
+    // Last receiver woken up on each round
+    for(i = 0; i < iterations; i++) {
+        last.samples[i] = 0;
+        for(j = 0; j < receivers; j++)
+            if(args[j].samples[i] > last.samples[i]) last.samples[i] = args[j].samples[i];
+    }
+
+    all.count = (long) receivers * iterations;
+    last.count = iterations;
+    last.seconds = all.seconds;
+    print_result(&all);
+    print_result(&last);
+    free(all.samples);
+    free(last.samples);
+    free(buffer);
+    return 0;
+}
+
+
+
+// ---------------- Fan-in ----------------
+
+typedef struct fi_arg {
+    int tag;
+    int index;
+    volatile int* stop;
+    long attempts;
+    long delivered;
+} fi_arg_t;
+
+static void* fanin_sender(void* input) {
+    fi_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    payload_t* msg = (payload_t*) buffer;
+    pin(arg -> index + 1);
+    while(!*(arg -> stop)) {
+        msg -> timestamp = now_ns();
+        arg -> attempts++;
+        if(tag_send(arg -> tag, 0, buffer, msg_size) == 1) arg -> delivered++;
+    }
+    free(buffer);
+    return 0;
+}
+
+typedef struct fi_recv {
+    int tag;
+    result_t* res;
+    long capacity;
+} fi_recv_t;
+
+static void* fanin_receiver(void* input) {
+    fi_recv_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    payload_t* msg = (payload_t*) buffer;
+    pin(0);
+    for(;;) {
+        if(bench_receive(arg -> tag, 0, buffer, msg_size) != 1) break;
+        if(arg -> res -> count < arg -> capacity)
+            arg -> res -> samples[arg -> res -> count++] = now_ns() - msg -> timestamp;
+    }
+    free(buffer);
+    return 0;
+}
+
+static int run_fanin(int senders) {
+
+    pthread_t tid[MAX_THREADS], recv;
+    fi_arg_t args[MAX_THREADS];
+    fi_recv_t recv_arg;
+    volatile int stop = 0;
+    result_t res;
+    uint64_t start;
+    int tag, i;
+
+    tag = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+    if(tag < 0) {
+        printf("Error in creating Tag: %d\n", tag);
+        return -1;
+    }
+
+    // Room for a receive every microsecond
+    recv_arg = (fi_recv_t){ .tag = tag, .capacity = (long) duration * 1000000 };
+    res = new_result("fanin", "wake", senders, recv_arg.capacity);
+    recv_arg.res = &res;
+    pthread_create(&recv, 0, fanin_receiver, &recv_arg);
+
+    for(i = 0; i < senders; i++) {
+        args[i] = (fi_arg_t){ .tag = tag, .index = i, .stop = &stop };
+        pthread_create(&tid[i], 0, fanin_sender, &args[i]);
+    }
+
+    start = now_ns();
+    sleep(duration);
+    stop = 1;
+    for(i = 0; i < senders; i++) {
+        pthread_join(tid[i], 0);
+        res.attempts += args[i].attempts;
+        res.delivered += args[i].delivered;
+    }
+    res.seconds = (now_ns() - start) / 1e9;
+
+    destroy_tag(tag);
+    pthread_join(recv, 0);
+
+    print_result(&res);
+    free(res.samples);
+    return 0;
+}
+
+
+
+// ---------------- Tag churn ----------------
+
+typedef struct ch_arg {
+    int index;
+    uint64_t* get_samples;
+    uint64_t* ctl_samples;
+    long count;
+    long failed;
+} ch_arg_t;
+
+static void* churn_thread(void* input) {
+    ch_arg_t* arg = input;
+    uint64_t t0, t1, t2;
+    int i, tag;
+    pin(arg -> index);
+    for(i = 0; i < warmup + iterations; i++) {
+        t0 = now_ns();
+        tag = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+        t1 = now_ns();
+        if(tag < 0) {
+            arg -> failed++;
+            continue;
+        }
+        if(tag_ctl(tag, TAG_DELETE) != 1) arg -> failed++;
+        t2 = now_ns();
+        if(i >= warmup) {
+            arg -> get_samples[arg -> count] = t1 - t0;
+            arg -> ctl_samples[arg -> count] = t2 - t1;
+            arg -> count++;
+        }
+    }
+    return 0;
+}
+
+static int run_churn(int nthreads) {
+
+    pthread_t tid[MAX_THREADS];
+    ch_arg_t args[MAX_THREADS];
+    result_t get, ctl;
+    uint64_t start;
+    long failed;
+    int i;
+
+    get = new_result("churn", "tag_get", nthreads, (long) nthreads * iterations);
+    ctl = new_result("churn", "tag_ctl", nthreads, (long) nthreads * iterations);
+
+    start = now_ns();
+    for(i = 0; i < nthreads; i++) {
+        args[i] = (ch_arg_t){ .index = i, .get_samples = get.samples + (long) i * iterations, .ctl_samples = ctl.samples + (long) i * iterations };
+        pthread_create(&tid[i], 0, churn_thread, &args[i]);
+    }
+    failed = 0;
+    for(i = 0; i < nthreads; i++) pthread_join(tid[i], 0);
+    get.seconds = ctl.seconds = (now_ns() - start) / 1e9;
+
+    // Compact the per-thread samples
+    for(i = 0; i < nthreads; i++) {
+        memmove(get.samples + get.count, args[i].get_samples, sizeof(uint64_t) * args[i].count);
+        memmove(ctl.samples + ctl.count, args[i].ctl_samples, sizeof(uint64_t) * args[i].count);
+        get.count += args[i].count;
+        ctl.count += args[i].count;
+        failed += args[i].failed;
+    }
+    if(failed > 0) printf("churn: %ld operations failed\n", failed);
+
+    print_result(&get);
+    print_result(&ctl);
+    free(get.samples);
+    free(ctl.samples);
+    return 0;
+}
+
+
+// ---------------- Scaling matrix ----------------
+
+typedef struct mx_arg {
+    int tag;
+    int level;              // Level of a receiver, number of levels cycled by a sender
+    int index;
+    volatile int* stop;
+    volatile int* measuring;
+    long attempts;
+    long delivered;
+    uint64_t* samples;      // Ring of the latest MATRIX_SAMPLES latencies (receivers)
+    long count;
+} mx_arg_t;
+
+static void* matrix_sender(void* input) {
+    mx_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    payload_t* msg = (payload_t*) buffer;
+    int level, ret;
+    pin(arg -> index);
+    for(level = 0; !*(arg -> stop); level = (level + 1) % arg -> level) {
+        msg -> timestamp = now_ns();
+        ret = tag_send(arg -> tag, level, buffer, msg_size);
+        if(*(arg -> measuring)) {
+            arg -> attempts++;
+            if(ret == 1) arg -> delivered++;
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+static void* matrix_receiver(void* input) {
+    mx_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    payload_t* msg = (payload_t*) buffer;
+    pin(arg -> index);
+    for(;;) {
+        if(bench_receive(arg -> tag, arg -> level, buffer, msg_size) != 1) break;
+        if(*(arg -> measuring)) {
+            arg -> samples[arg -> count % MATRIX_SAMPLES] = now_ns() - msg -> timestamp;
+            arg -> count++;
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+// One cell: "ntags" Tags, each one with "senders" senders cycling on "levels" levels and "receivers" receivers
+// spread on the same levels. Threads are pinned in creation order (receivers first)
+static int run_matrix_cell(int senders, int receivers, int levels, int ntags) {
+
+    pthread_t tid[MAX_THREADS];
+    mx_arg_t args[MAX_THREADS];
+    int tag_ids[MAX_THREADS];
+    volatile int stop = 0, measuring = 0;
+    result_t res;
+    uint64_t start;
+    long kept;
+    int nthreads, first_sender, i, j, k;
+
+    nthreads = ntags * (senders + receivers);
+    if(nthreads > MAX_THREADS || levels > TAG_INFO_LEVELS || ntags > TAG_INFO_TAGS) {
+        printf("matrix: skipped cell S %d R %d L %d T %d (too many threads, levels or tags)\n", senders, receivers, levels, ntags);
+        return 0;
+    }
+
+    res = new_result("matrix", "wake", nthreads, (long) ntags * receivers * MATRIX_SAMPLES);
+    res.senders = senders;
+    res.receivers = receivers;
+    res.levels = levels;
+    res.tags = ntags;
+
+    for(i = 0; i < ntags; i++) {
+        tag_ids[i] = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+        if(tag_ids[i] < 0) {
+            printf("Error in creating Tag: %d\n", tag_ids[i]);
+            while(--i >= 0) destroy_tag(tag_ids[i]);
+            free(res.samples);
+            return -1;
+        }
+    }
+
+    k = 0;
+    for(i = 0; i < ntags; i++)
+        for(j = 0; j < receivers; j++, k++) {
+            args[k] = (mx_arg_t){ .tag = tag_ids[i], .level = j % levels, .index = k, .stop = &stop, .measuring = &measuring,
+                                  .samples = res.samples + (long) k * MATRIX_SAMPLES };
+            pthread_create(&tid[k], 0, matrix_receiver, &args[k]);
+        }
+    first_sender = k;
+    for(i = 0; i < ntags; i++)
+        for(j = 0; j < senders; j++, k++) {
+            args[k] = (mx_arg_t){ .tag = tag_ids[i], .level = levels, .index = k, .stop = &stop, .measuring = &measuring };
+            pthread_create(&tid[k], 0, matrix_sender, &args[k]);
+        }
+
+    usleep(MATRIX_WARMUP_MS * 1000);
+    start = now_ns();
+    measuring = 1;
+    sleep(duration);
+    measuring = 0;
+    res.seconds = (now_ns() - start) / 1e9;
+
+    stop = 1;
+    for(k = first_sender; k < nthreads; k++) {
+        pthread_join(tid[k], 0);
+        res.attempts += args[k].attempts;
+        res.delivered += args[k].delivered;
+    }
+    for(i = 0; i < ntags; i++) destroy_tag(tag_ids[i]);
+    for(k = 0; k < first_sender; k++) pthread_join(tid[k], 0);
+
+    // Compact the receivers' rings
+    for(k = 0; k < first_sender; k++) {
+        kept = args[k].count < MATRIX_SAMPLES ? args[k].count : MATRIX_SAMPLES;
+        memmove(res.samples + res.count, args[k].samples, sizeof(uint64_t) * kept);
+        res.count += kept;
+        res.ops += args[k].count;
+    }
+
+    print_result(&res);
+    free(res.samples);
+    return 0;
+}
+
+static int run_matrix(void) {
+
+    int s, r, l, t, ret;
+
+    for(t = 0; t < tags_n; t++)
+        for(l = 0; l < levels_n; l++)
+            for(s = 0; s < senders_n; s++)
+                for(r = 0; r < receivers_n; r++) {
+                    ret = run_matrix_cell(senders_list[s], receivers_list[r], levels_list[l], tags_list[t]);
+                    if(ret != 0) return ret;
+                }
+
+    return 0;
+}
+
+
+
+// ---------------- Open loop ----------------
+
+typedef struct ol_arg {
+    int* tags;
+    int levels;
+    int targets;            // Tags * levels, sends go round robin on them
+    int index;
+    double rate;            // Of this generator
+    uint64_t start, end;
+    uint64_t* lag;          // Ring of the latest MATRIX_SAMPLES delays between intended and actual send time
+    long count;
+    long attempts;
+    long delivered;
+} ol_arg_t;
+
+// Time to the next arrival (ns)
+static uint64_t next_interval(double rate, unsigned int* seed) {
+    double u;
+    if(!poisson) return (uint64_t) (1e9 / rate);
+    u = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+    return (uint64_t) (-log(u) * 1e9 / rate);
+}
+
+// Sleep until (close to) "when", then spin
+static void wait_until(uint64_t when) {
+    struct timespec ts;
+    uint64_t now = now_ns();
+    if(when > now + 100000) {
+        when -= 50000;
+        ts.tv_sec = when / 1000000000ULL;
+        ts.tv_nsec = when % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0);
+        when += 50000;
+    }
+    while(now_ns() < when) __builtin_ia32_pause();
+}
+
+// Sends follow the schedule, not the completion of the previous send: a generator that falls behind sends
+// back to back (stamping the intended time) until it catches up
+static void* openloop_sender(void* input) {
+    ol_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    payload_t* msg = (payload_t*) buffer;
+    unsigned int seed = arg -> index + 1;
+    uint64_t intended;
+    int target;
+    pin(arg -> index);
+    intended = arg -> start;
+    for(target = 0; ; target = (target + 1) % arg -> targets) {
+        intended += next_interval(arg -> rate, &seed);
+        if(intended >= arg -> end) break;
+        wait_until(intended);
+        arg -> lag[arg -> count % MATRIX_SAMPLES] = now_ns() - intended;
+        arg -> count++;
+        msg -> timestamp = intended;
+        msg -> round = arg -> count;
+        arg -> attempts++;
+        if(tag_send(arg -> tags[target / arg -> levels], target % arg -> levels, buffer, msg_size) == 1) arg -> delivered++;
+    }
+    free(buffer);
+    return 0;
+}
+
+static int run_openloop_rate(double rate, int generators, int ntags, int levels) {
+
+    pthread_t tid[MAX_THREADS];
+    ol_arg_t args[MAX_THREADS];
+    mx_arg_t recv[MAX_THREADS];
+    int tag_ids[MAX_THREADS];
+    volatile int measuring = 1;
+    result_t res, lag;
+    uint64_t start, end;
+    long kept;
+    int targets, i, k;
+
+    targets = ntags * levels;
+    if(generators + targets > MAX_THREADS || levels > TAG_INFO_LEVELS || ntags > TAG_INFO_TAGS) {
+        printf("openloop: too many threads, levels or tags\n");
+        return -1;
+    }
+
+    res = new_result("openloop", "latency", generators + targets, (long) targets * MATRIX_SAMPLES);
+    lag = new_result("openloop", "send_lag", generators + targets, (long) generators * MATRIX_SAMPLES);
+    res.rate = lag.rate = rate;
+    res.senders = lag.senders = generators;
+    res.receivers = lag.receivers = targets;
+    res.levels = lag.levels = levels;
+    res.tags = lag.tags = ntags;
+
+    for(i = 0; i < ntags; i++) {
+        tag_ids[i] = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+        if(tag_ids[i] < 0) {
+            printf("Error in creating Tag: %d\n", tag_ids[i]);
+            while(--i >= 0) destroy_tag(tag_ids[i]);
+            free(res.samples);
+            free(lag.samples);
+            return -1;
+        }
+    }
+
+    // One receiver per (tag, level)
+    for(k = 0; k < targets; k++) {
+        recv[k] = (mx_arg_t){ .tag = tag_ids[k / levels], .level = k % levels, .index = generators + k, .measuring = &measuring,
+                              .samples = res.samples + (long) k * MATRIX_SAMPLES };
+        pthread_create(&tid[generators + k], 0, matrix_receiver, &recv[k]);
+    }
+
+    start = now_ns() + MATRIX_WARMUP_MS * 1000000ULL;
+    end = start + duration * 1000000000ULL;
+    for(i = 0; i < generators; i++) {
+        args[i] = (ol_arg_t){ .tags = tag_ids, .levels = levels, .targets = targets, .index = i, .rate = rate / generators,
+                              .start = start, .end = end, .lag = lag.samples + (long) i * MATRIX_SAMPLES };
+        pthread_create(&tid[i], 0, openloop_sender, &args[i]);
+    }
+
+    for(i = 0; i < generators; i++) {
+        pthread_join(tid[i], 0);
+        lag.attempts += args[i].attempts;
+        lag.delivered += args[i].delivered;
+        kept = args[i].count < MATRIX_SAMPLES ? args[i].count : MATRIX_SAMPLES;
+        memmove(lag.samples + lag.count, args[i].lag, sizeof(uint64_t) * kept);
+        lag.count += kept;
+        lag.ops += args[i].count;
+    }
+    lag.seconds = (now_ns() - start) / 1e9;
+
+    // Let the last messages be received
+    usleep(10000);
+    for(i = 0; i < ntags; i++) destroy_tag(tag_ids[i]);
+    for(k = 0; k < targets; k++) {
+        pthread_join(tid[generators + k], 0);
+        kept = recv[k].count < MATRIX_SAMPLES ? recv[k].count : MATRIX_SAMPLES;
+        memmove(res.samples + res.count, recv[k].samples, sizeof(uint64_t) * kept);
+        res.count += kept;
+        res.ops += recv[k].count;
+    }
+    res.seconds = lag.seconds;
+    res.attempts = lag.attempts;
+    res.delivered = lag.delivered;
+
+    print_result(&res);
+    print_result(&lag);
+    free(res.samples);
+    free(lag.samples);
+    return 0;
+}
+
+static int run_openloop(void) {
+
+    int i, ret;
+
+    for(i = 0; i < rates_n; i++) {
+        ret = run_openloop_rate(rates_list[i], threads, tags_list[0], levels_list[0]);
+        if(ret != 0) return ret;
+    }
+
+    return 0;
+}
+
+
+
+// ---------------- Memory footprint ----------------
+
+#define MEM_IDLE    0       // No receiver
+#define MEM_WAITING 1       // Receivers waiting on every level
+#define MEM_BURST   2       // A send, immediately followed by a second batch of receivers (new epochs)
+
+static const char* mem_patterns[] = { "idle", "waiting", "burst" };
+
+typedef struct mem_sample {
+    struct tag_info_memory module;
+    long slab, percpu, vmalloc;     // kB, from /proc/meminfo
+} mem_sample_t;
+
+static long meminfo(const char* key) {
+    char line[256];
+    long value = -1;
+    size_t len = strlen(key);
+    FILE* file = fopen("/proc/meminfo", "r");
+    if(file == 0) return -1;
+    while(fgets(line, sizeof(line), file) != 0) {
+        if(strncmp(line, key, len) == 0 && line[len] == ':') {
+            value = atol(line + len + 1);
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+static int mem_sample(mem_sample_t* sample) {
+    if(ioctl(dev_fd, TAG_INFO_MEMORY, &(sample -> module)) < 0) return -1;
+    sample -> slab = meminfo("Slab");
+    sample -> percpu = meminfo("Percpu");
+    sample -> vmalloc = meminfo("VmallocUsed");
+    return 0;
+}
+
+static void* memory_receiver(void* input) {
+    mx_arg_t* arg = input;
+    char* buffer = calloc(1, msg_size);
+    tag_receive(arg -> tag, arg -> level, buffer, msg_size);
+    free(buffer);
+    return 0;
+}
+
+// Wait for "n" receivers on the current epoch of the level: a newer epoch than "epoch", or the same one if the
+// previous receivers already left it (not ready anymore)
+static int wait_epoch(int tag, int level, int epoch, int n) {
+    struct tag_info info;
+    struct tag_info_req req;
+    for(;;) {
+        req.start = tag;
+        req.count = 1;
+        req.buf = (uint64_t) (uintptr_t) &info;
+        if(ioctl(dev_fd, TAG_INFO_SNAPSHOT, &req) < 0) return -1;
+        if(req.count == 1 && info.tag == tag && info.level[level].waiting >= n &&
+           (info.level[level].epoch > epoch || info.level[level].ready == 0)) return info.level[level].epoch;
+        sched_yield();
+    }
+}
+
+static int level_epoch(int tag, int level) {
+    struct tag_info info;
+    struct tag_info_req req = { .start = tag, .count = 1, .buf = (uint64_t) (uintptr_t) &info };
+    if(ioctl(dev_fd, TAG_INFO_SNAPSHOT, &req) < 0 || req.count != 1) return -1;
+    return info.level[level].epoch;
+}
+
+static void print_memory(const char* pattern, int ntags, int levels, int receivers,
+                         mem_sample_t* before, mem_sample_t* peak, mem_sample_t* after) {
+
+    long slab, percpu, vmalloc;
+    struct tag_info_memory* m = &(peak -> module);
+
+    slab = peak -> slab - before -> slab;
+    percpu = peak -> percpu - before -> percpu;
+    vmalloc = peak -> vmalloc - before -> vmalloc;
+
+    switch(output) {
+    case OUT_TEXT:
+        printf("memory    %-8s T %3d L %2d R %2d | tags %4llu levels %6llu epoch %5llu | tag %9llu level %9llu buffer %10llu B "
+               "| slab %+7ld percpu %+6ld vmalloc %+6ld kB | after delete: tags %llu levels %llu\n",
+            pattern, ntags, levels, receivers, m -> tags, m -> levels, m -> epoch_levels,
+            m -> tag_bytes, m -> level_bytes, m -> buffer_bytes, slab, percpu, vmalloc,
+            after -> module.tags, after -> module.levels);
+        break;
+    case OUT_CSV:
+        if(printed == 0)
+            printf("scenario,pattern,tags,levels,receivers,live_tags,live_levels,epoch_levels,tag_bytes,level_bytes,buffer_bytes,"
+                   "slab_kb,percpu_kb,vmalloc_kb,tags_after,levels_after\n");
+        printf("memory,%s,%d,%d,%d,%llu,%llu,%llu,%llu,%llu,%llu,%ld,%ld,%ld,%llu,%llu\n",
+            pattern, ntags, levels, receivers, m -> tags, m -> levels, m -> epoch_levels,
+            m -> tag_bytes, m -> level_bytes, m -> buffer_bytes, slab, percpu, vmalloc,
+            after -> module.tags, after -> module.levels);
+        break;
+    case OUT_JSON:
+        printf("%s\n  {\"scenario\": \"memory\", \"pattern\": \"%s\", \"tags\": %d, \"levels\": %d, \"receivers\": %d, "
+               "\"live_tags\": %llu, \"live_levels\": %llu, \"epoch_levels\": %llu, \"tag_bytes\": %llu, \"level_bytes\": %llu, "
+               "\"buffer_bytes\": %llu, \"slab_kb\": %ld, \"percpu_kb\": %ld, \"vmalloc_kb\": %ld, \"tags_after\": %llu, \"levels_after\": %llu}",
+            printed == 0 ? "[" : ",", pattern, ntags, levels, receivers, m -> tags, m -> levels, m -> epoch_levels,
+            m -> tag_bytes, m -> level_bytes, m -> buffer_bytes, slab, percpu, vmalloc,
+            after -> module.tags, after -> module.levels);
+        break;
+    }
+    printed++;
+    fflush(stdout);
+}
+
+static int run_memory_cell(int pattern, int ntags, int levels, int receivers) {
+
+    mem_sample_t before, peak, after;
+    pthread_t* tid;
+    mx_arg_t* args;
+    int tag_ids[TAG_INFO_TAGS];
+    char* buffer;
+    int nthreads, epoch, i, j, k, r;
+
+    nthreads = pattern == MEM_IDLE ? 0 : ntags * levels * receivers * (pattern == MEM_BURST ? 2 : 1);
+    tid = malloc(sizeof(pthread_t) * (nthreads + 1));
+    args = malloc(sizeof(mx_arg_t) * (nthreads + 1));
+    buffer = calloc(1, msg_size);
+    if(tid == 0 || args == 0 || buffer == 0) {
+        printf("Error allocating threads\n");
+        exit(-1);
+    }
+
+    // Let the frees of the previous cell go through RCU
+    usleep(100000);
+    if(mem_sample(&before) != 0) {
+        printf("Error in reading /dev/tag_info: %d\n", errno);
+        return -1;
+    }
+
+    for(i = 0; i < ntags; i++) {
+        tag_ids[i] = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+        if(tag_ids[i] < 0) {
+            printf("Error in creating Tag: %d\n", tag_ids[i]);
+            while(--i >= 0) destroy_tag(tag_ids[i]);
+            return -1;
+        }
+    }
+
+    k = 0;
+    if(pattern != MEM_IDLE) {
+        for(i = 0; i < ntags; i++)
+            for(j = 0; j < levels; j++) {
+                for(r = 0; r < receivers; r++, k++) {
+                    args[k] = (mx_arg_t){ .tag = tag_ids[i], .level = j };
+                    pthread_create(&tid[k], 0, memory_receiver, &args[k]);
+                }
+                wait_receivers(tag_ids[i], j, receivers);
+            }
+    }
+
+    if(pattern == MEM_BURST) {
+        for(i = 0; i < ntags; i++)
+            for(j = 0; j < levels; j++) {
+                epoch = level_epoch(tag_ids[i], j);
+                send_retry(tag_ids[i], j, buffer, msg_size);
+                for(r = 0; r < receivers; r++, k++) {
+                    args[k] = (mx_arg_t){ .tag = tag_ids[i], .level = j };
+                    pthread_create(&tid[k], 0, memory_receiver, &args[k]);
+                }
+                wait_epoch(tag_ids[i], j, epoch, receivers);
+            }
+    }
+
+    mem_sample(&peak);
+
+    for(i = 0; i < ntags; i++) destroy_tag(tag_ids[i]);
+    for(k = 0; k < nthreads; k++) pthread_join(tid[k], 0);
+
+    usleep(100000);
+    mem_sample(&after);
+    after.module.tags -= before.module.tags;
+    after.module.levels -= before.module.levels;
+
+    print_memory(mem_patterns[pattern], ntags, levels, receivers, &before, &peak, &after);
+
+    free(tid);
+    free(args);
+    free(buffer);
+    return 0;
+}
+
+static int run_memory(void) {
+
+    int t, pattern, ret;
+
+    if(dev_fd < 0) {
+        printf("memory needs /dev/tag_info\n");
+        return -1;
+    }
+
+    for(t = 0; t < tags_n; t++)
+        for(pattern = MEM_IDLE; pattern <= MEM_BURST; pattern++) {
+            if(tags_list[t] > TAG_INFO_TAGS || levels_list[0] > TAG_INFO_LEVELS) {
+                printf("memory: at most %d Tags and %d levels\n", TAG_INFO_TAGS, TAG_INFO_LEVELS);
+                return -1;
+            }
+            ret = run_memory_cell(pattern, tags_list[t], levels_list[0], receivers_list[0]);
+            if(ret != 0) return ret;
+        }
+
+    return 0;
+}
+
+
+
+// ---------------- Kernel publisher wake latency ----------------
+
+typedef struct kw_arg {
+    int tag;
+    int index;
+    uint64_t* wake;         // From the kernel publication to the receiver running
+    uint64_t* timer;        // From the publisher deadline to the receiver running
+} kw_arg_t;
+
+static void* kwake_receiver(void* input) {
+    kw_arg_t* arg = input;
+    struct tag_publish_msg msg;
+    uint64_t now;
+    int i;
+    pin(arg -> index + 1);
+    for(i = 0; i < warmup + iterations; ) {
+        if(tag_receive(arg -> tag, 0, (char*) &msg, sizeof(msg)) != 1) continue;
+        now = now_ns();
+        if(i >= warmup) {
+            arg -> wake[i - warmup] = now - msg.publish_ns;
+            arg -> timer[i - warmup] = now - msg.expected_ns;
+        }
+        i++;
+    }
+    return 0;
+}
+
+static int run_kwake(int receivers) {
+
+    pthread_t tid[MAX_THREADS];
+    kw_arg_t args[MAX_THREADS];
+    struct tag_publisher pub;
+    struct tag_publisher_stats stats;
+    result_t wake, timer;
+    uint64_t start;
+    int tag, i;
+
+    if(dev_fd < 0) {
+        printf("kwake needs /dev/tag_info\n");
+        return -1;
+    }
+
+    tag = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+    if(tag < 0) {
+        printf("Error in creating Tag: %d\n", tag);
+        return -1;
+    }
+
+    wake = new_result("kwake", "wake", receivers, (long) receivers * iterations);
+    timer = new_result("kwake", "timer_wake", receivers, (long) receivers * iterations);
+    for(i = 0; i < receivers; i++) {
+        args[i] = (kw_arg_t){ .tag = tag, .index = i,
+                              .wake = wake.samples + (long) i * iterations, .timer = timer.samples + (long) i * iterations };
+        pthread_create(&tid[i], 0, kwake_receiver, &args[i]);
+    }
+
+    // The publisher runs on the first CPU of the list (the receivers on the following ones)
+    pub = (struct tag_publisher){ .tag = tag, .level = 0, .period_ns = (uint64_t) period_us * 1000, .count = 0,
+                                  .cpu = ncpus > 0 ? cpus[0] : -1 };
+    start = now_ns();
+    if(ioctl(dev_fd, TAG_INFO_PUBLISH_START, &pub) != 0) {
+        printf("Error in starting the publisher: %d\n", errno);
+        destroy_tag(tag);
+        return -1;
+    }
+
+    for(i = 0; i < receivers; i++) pthread_join(tid[i], 0);
+    wake.seconds = timer.seconds = (now_ns() - start) / 1e9;
+
+    memset(&stats, 0, sizeof(stats));
+    ioctl(dev_fd, TAG_INFO_PUBLISH_STOP, &stats);
+    destroy_tag(tag);
+
+    if(stats.error != 0) printf("Publisher stopped with error %d\n", stats.error);
+    if(stats.overruns > 0) printf("Publisher overruns: %llu (max timer delay %llu ns)\n",
+                                  (unsigned long long) stats.overruns, (unsigned long long) stats.timer_max_ns);
+
+    wake.count = timer.count = (long) receivers * iterations;
+    wake.attempts = timer.attempts = stats.ticks;
+    wake.delivered = timer.delivered = stats.delivered;
+    wake.size = timer.size = sizeof(struct tag_publish_msg);
+    print_result(&wake);
+    print_result(&timer);
+    free(wake.samples);
+    free(timer.samples);
+    return 0;
+}
+
+
+
+static void usage(char* name) {
+    printf("Usage: %s [-s pingpong|fanout|fanin|churn|multitag|matrix|openloop|memory|kwake|all] [-n iterations] [-w warmup] [-r threads]\n"
+           "          [-m msg size] [-d seconds] [-c cpu,cpu,...] [-N node,node,...] [-o text|csv|json]\n"
+           "          [-S senders,...] [-R receivers,...] [-L levels,...] [-T tags,...]\n"
+           "          [-Q rate,...] [-P constant|poisson] [-p period us] [-k] [-b spin us]\n"
+           "  -k: map the status page, tag_send() skips the system call when nobody waits\n"
+           "  -b: receivers busy-poll the level up to \"spin us\" before sleeping\n", name);
+}
+
+int main(int argc, char** argv) {
+
+    char* scenario = "all";
+    int nodes[MAX_CPUS];
+    char* token;
+    int opt, ret, all, i;
+
+    while((opt = getopt(argc, argv, "s:n:w:r:m:d:c:N:o:S:R:L:T:Q:P:p:kb:h")) != -1) {
+        switch(opt) {
+        case 's': scenario = optarg; break;
+        case 'n': iterations = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        case 'r': threads = atoi(optarg); break;
+        case 'm': msg_size = atol(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        case 'c': ncpus = parse_list(optarg, cpus, MAX_CPUS); break;
+        case 'N':
+            if(node_cpus(nodes, parse_list(optarg, nodes, MAX_CPUS)) != 0) return -1;
+            break;
+        case 'S': senders_n = parse_list(optarg, senders_list, MAX_CPUS); break;
+        case 'R': receivers_n = parse_list(optarg, receivers_list, MAX_CPUS); break;
+        case 'L': levels_n = parse_list(optarg, levels_list, MAX_CPUS); break;
+        case 'T': tags_n = parse_list(optarg, tags_list, MAX_CPUS); break;
+        case 'Q':
+            for(rates_n = 0, token = strtok(optarg, ","); token != 0 && rates_n < MAX_CPUS; token = strtok(0, ","))
+                rates_list[rates_n++] = atof(token);
+            break;
+        case 'P': poisson = strcmp(optarg, "constant") != 0; break;
+        case 'p': period_us = atoi(optarg); break;
+        case 'k': status_page = 1; break;
+        case 'b': spin_ns = (unsigned int) atoi(optarg) * 1000; break;
+        case 'o':
+            if(strcmp(optarg, "csv") == 0) output = OUT_CSV;
+            else if(strcmp(optarg, "json") == 0) output = OUT_JSON;
+            else output = OUT_TEXT;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(iterations <= 0 || warmup < 0 || threads <= 0 || threads > MAX_THREADS / 2 || duration <= 0 || period_us <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    for(i = 0; i < MAX_CPUS; i++) {
+        if((i < senders_n && senders_list[i] <= 0) || (i < receivers_n && receivers_list[i] <= 0) ||
+           (i < levels_n && levels_list[i] <= 0) || (i < tags_n && tags_list[i] <= 0) || (i < rates_n && rates_list[i] <= 0)) {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if(msg_size < sizeof(payload_t)) msg_size = sizeof(payload_t);
+    if(msg_size > 4096) msg_size = 4096;
+
+    dev_fd = open("/dev/tag_info", O_RDONLY);
+
+    if(status_page && tag_status_map() != 0) {
+        printf("Error in mapping the status page: %d\n", errno);
+        return -1;
+    }
+
+    all = strcmp(scenario, "all") == 0;
+    ret = 0;
+    if(ret == 0 && (all || strcmp(scenario, "pingpong") == 0)) ret = run_pingpong("pingpong", 1);
+    if(ret == 0 && (all || strcmp(scenario, "fanout") == 0))   ret = run_fanout(threads);
+    if(ret == 0 && (all || strcmp(scenario, "fanin") == 0))    ret = run_fanin(threads);
+    if(ret == 0 && (all || strcmp(scenario, "churn") == 0))    ret = run_churn(threads);
+    if(ret == 0 && (all || strcmp(scenario, "multitag") == 0)) ret = run_pingpong("multitag", threads);
+    if(ret == 0 && strcmp(scenario, "matrix") == 0)            ret = run_matrix();
+    if(ret == 0 && strcmp(scenario, "openloop") == 0)          ret = run_openloop();
+    if(ret == 0 && strcmp(scenario, "memory") == 0)            ret = run_memory();
+    if(ret == 0 && strcmp(scenario, "kwake") == 0)             ret = run_kwake(threads);
+
+    if(output == OUT_JSON && printed > 0) printf("\n]\n");
+
+    if(printed == 0 && ret == 0) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if(dev_fd >= 0) close(dev_fd);
+    return ret;
+}
@@ -6,6 +6,10 @@
 #include <errno.h>
 #include <signal.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "../tag-module/include/tag.h"
 
 extern int errno;
 static FILE* file;
@@ -17,13 +21,183 @@ void interrupt_handler(int sig){
     exit(fclose(file));
 }
 
+// Read the Tags with the TAG_INFO_SNAPSHOT ioctl, 64 at a time
+int read_snapshot(void) {
+
+    struct tag_info info[64];
+    struct tag_info_req req;
+    int i, j, ret;
+
+    req.start = 0;
+    do {
+        req.count = 64;
+        req.buf = (uint64_t) (uintptr_t) info;
+
+        ret = ioctl(fileno(file), TAG_INFO_SNAPSHOT, &req);
+        if(ret < 0) {
+            printf("Error in ioctl: %d\n", errno);
+            return -1;
+        }
+
+        for(i = 0; i < ret; i++) {
+            printf("Tag %d (key %d, euid %u, perm %d, ready %d)\n", info[i].tag, info[i].key, info[i].euid, info[i].permission, info[i].ready);
+            for(j = 0; j < TAG_INFO_LEVELS; j++) {
+                if(info[i].levels & (1U << j))
+                    printf("\tLevel %2d: waiting %d, epoch %d, ready %d\n", j, info[i].level[j].waiting, info[i].level[j].epoch, info[i].level[j].ready);
+            }
+        }
+    } while(ret != 0);
+
+    return 0;
+}
+
+// Read the statistics page (mapped once) with the seqcount protocol
+int read_stats(void) {
+
+    static struct tag_stats_page* page = 0;
+    struct tag_stats_entry entry;
+    unsigned int seq;
+    int i, j;
+
+    if(page == 0) {
+        page = mmap(0, TAG_STATS_SIZE, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if(page == MAP_FAILED) {
+            page = 0;
+            printf("Error in mmap: %d\n", errno);
+            return -1;
+        }
+    }
+
+    printf("Refreshes: %llu (every %llu us)\n", (unsigned long long) page -> refreshes, (unsigned long long) page -> period_us);
+
+    for(i = 0; i < TAG_INFO_TAGS; i++) {
+        do {
+            seq = __atomic_load_n(&(page -> tag[i].seq), __ATOMIC_ACQUIRE);
+            memcpy(&entry, &(page -> tag[i]), sizeof(entry));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while((seq & 1) || __atomic_load_n(&(page -> tag[i].seq), __ATOMIC_RELAXED) != seq);
+
+        if(entry.tag == -1) continue;
+
+        printf("Tag %d: awake_all %llu\n", entry.tag, (unsigned long long) entry.awake_alls);
+        for(j = 0; j < TAG_INFO_LEVELS; j++) {
+            struct tag_stats_level* l = &(entry.level[j]);
+            if(l -> sends == 0 && l -> dropped == 0 && l -> receives == 0 && l -> wakeups == 0) continue;
+            printf("\tLevel %2d: sends %llu, dropped %llu, receives %llu, wakeups %llu, bytes %llu, rollovers %llu\n", j,
+                (unsigned long long) l -> sends, (unsigned long long) l -> dropped, (unsigned long long) l -> receives,
+                (unsigned long long) l -> wakeups, (unsigned long long) l -> bytes, (unsigned long long) l -> rollovers);
+        }
+    }
+
+    return 0;
+}
+
+// Print the latency histograms of every Tag, then reset them
+int read_latency(void) {
+
+    static struct tag_latency lat;
+    int i, j, k;
+
+    for(i = 0; i < TAG_INFO_TAGS; i++) {
+        lat.tag = i;
+        if(ioctl(fileno(file), TAG_INFO_LATENCY, &lat) < 0) {
+            if(errno == ENODATA) continue;
+            printf("Error in ioctl: %d\n", errno);
+            return -1;
+        }
+
+        for(j = 0; j < TAG_INFO_LEVELS; j++) {
+            unsigned long long wakes = 0;
+            for(k = 0; k < TAG_LAT_BUCKETS; k++) wakes += lat.level[j].blocked[k];
+            if(wakes == 0) continue;
+
+            printf("Tag %d, Level %d (%llu wakeups)\n", i, j, wakes);
+            for(k = 0; k < TAG_LAT_BUCKETS; k++) {
+                if(lat.level[j].wake[k] == 0 && lat.level[j].blocked[k] == 0) continue;
+                printf("\t%s %10llu ns: wake %llu, blocked %llu\n", k == TAG_LAT_BUCKETS - 1 ? ">=" : "< ",
+                    k == TAG_LAT_BUCKETS - 1 ? 1ULL << (k + 7) : 1ULL << (k + 8),
+                    (unsigned long long) lat.level[j].wake[k], (unsigned long long) lat.level[j].blocked[k]);
+            }
+        }
+    }
+
+    if(ioctl(fileno(file), TAG_INFO_LATENCY_RESET, -1) < 0) {
+        printf("Error in ioctl: %d\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Print where tag_send/tag_receive spend their cycles, then reset the counters
+int read_profile(void) {
+
+    static const char* names[TAG_PROF_PHASES] = {
+        "send total", "send tag_lock", "send level_lock", "send rcu_lock", "send w_mutex", "send copy", "send wake",
+        "recv total", "recv tag_lock", "recv level_lock", "recv rcu_lock", "recv epoch", "recv wait", "recv copy", "recv release"
+    };
+    struct tag_profile prof;
+    int i;
+
+    if(ioctl(fileno(file), TAG_INFO_PROFILE, &prof) < 0) {
+        printf("Error in ioctl: %d (is the module built with MOD_PROFILE=1?)\n", errno);
+        return -1;
+    }
+
+    printf("%-16s %12s %16s %12s %12s\n", "PHASE", "COUNT", "CYCLES", "AVG", "MAX");
+    for(i = 0; i < TAG_PROF_PHASES; i++) {
+        printf("%-16s %12llu %16llu %12llu %12llu\n", names[i],
+            (unsigned long long) prof.phase[i].count, (unsigned long long) prof.phase[i].cycles,
+            prof.phase[i].count ? (unsigned long long) (prof.phase[i].cycles / prof.phase[i].count) : 0ULL,
+            (unsigned long long) prof.phase[i].max);
+    }
+
+    if(ioctl(fileno(file), TAG_INFO_PROFILE_RESET) < 0) {
+        printf("Error in ioctl: %d\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Print the memory held by the module
+int read_memory(void) {
+
+    struct tag_info_memory mem;
+
+    if(ioctl(fileno(file), TAG_INFO_MEMORY, &mem) < 0) {
+        printf("Error in ioctl: %d\n", errno);
+        return -1;
+    }
+
+    printf("Tags: %llu, Levels: %llu (epoch > 0: %llu)\n", (unsigned long long) mem.tags,
+        (unsigned long long) mem.levels, (unsigned long long) mem.epoch_levels);
+    printf("Bytes: tags %llu, levels %llu, buffers %llu, retained %llu, total %llu\n", (unsigned long long) mem.tag_bytes,
+        (unsigned long long) mem.level_bytes, (unsigned long long) mem.buffer_bytes, (unsigned long long) mem.retained_bytes,
+        (unsigned long long) (mem.tag_bytes + mem.level_bytes + mem.buffer_bytes + mem.retained_bytes));
+
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
 
     size_t size; 
+    int binary, stats, latency, profile, memory;
     
 
     signal(SIGINT, interrupt_handler);
 
+    // "-b" reads the binary snapshot instead of the text table
+    binary = argc > 1 && strcmp(argv[1], "-b") == 0;
+    // "-s" reads the statistics page
+    stats = argc > 1 && strcmp(argv[1], "-s") == 0;
+    // "-l" reads (and resets) the latency histograms
+    latency = argc > 1 && strcmp(argv[1], "-l") == 0;
+    // "-p" reads (and resets) the per-phase cycles
+    profile = argc > 1 && strcmp(argv[1], "-p") == 0;
+    // "-m" reads the memory held by the module
+    memory = argc > 1 && strcmp(argv[1], "-m") == 0;
+
     file = fopen("/dev/tag_info", "r");
     if(file == 0) {
         printf("Error opening file: %d\n", errno);
@@ -49,6 +223,15 @@ int main(int argc, char* argv[]) {
         printf("\nPress Enter to start reading from the Char Device or Ctrl + C to End\n");
         getchar();
 
+        if(binary || stats || latency || profile || memory) {
+            if((binary ? read_snapshot() : stats ? read_stats() : latency ? read_latency() :
+                profile ? read_profile() : read_memory()) == -1) {
+                if(buffer != 0) free(buffer);
+                exit(fclose(file));
+            }
+            continue;
+        }
+
         char_read = 0;
 
         rewind(file);
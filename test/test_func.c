@@ -3,6 +3,9 @@
  *  @brief  Source code for testing the basic functionalities of the two struct used: Hashmap and Bitmask.
  *          This routine gets is independent from the modules developed
  *          It contains functionality tests on the Hashmap and Bitmask, containing also a basic performance measurement
+ *          and a multi-threaded benchmark of the concurrent Hashmap against the Hashmap guarded by a rwlock.
+ *          The Tag services are also tested in their userspace build (tag-module/tag-engine.h): functional test,
+ *          random operations from concurrent threads (fuzz) and a basic performance measurement
  *              [NOTE] this routine is not involved in any manner in the project requirement: it has been developed only for "internal use"
  *              to check wether the structures work as intended and if no unexpected behaviour comes from using them,
  *              so the routine has not been developed with particular care regarding code style and shape.
@@ -17,9 +20,16 @@
 #include <string.h>
 #include <x86intrin.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
 #include "../utils/include/bitmask.h"
 #include "../utils/include/common.h"
-#include "backup_hash/hashmap.h"
+#include "../utils/include/hashmap.h"
+#include "../utils/include/chashmap.h"
+#include "../tag-module/tag-engine.h"
+#include <sys/ipc.h>
 
 
 #define SEED0 401861
@@ -28,6 +38,8 @@
 
 int test_bitmask(void);
 int test_hashmap(void);
+int test_chashmap(void);
+int test_tag_engine(void);
 
 
 int main(int argc, void** argv) {
@@ -43,6 +55,16 @@ int main(int argc, void** argv) {
 
     if(test_hashmap() == -1) return -1;
 
+
+    printf("\n\n[TEST_FUNC] Concurrent Hashmap Testing\n");
+
+    if(test_chashmap() == -1) return -1;
+
+
+    printf("\n\n[TEST_FUNC] Tag services (userspace build) Testing\n");
+
+    if(test_tag_engine() == -1) return -1;
+
     printf("\n\n[TEST_FUNC] All test executed correctly!\n");
 
 }
@@ -638,6 +660,20 @@ uint64_t custom_hash(const void *item, uint64_t seed0, uint64_t seed1 ) {
     return hashmap_sip(&(entry->key), sizeof(int), seed0, seed1);
 }
 
+uint64_t clustered_hash(const void *item, uint64_t seed0, uint64_t seed1 ) {
+
+    const data* entry = item;
+    if(entry -> key < 1000) return entry -> key & 0x7f;
+    return hashmap_sip(&(entry->key), sizeof(int), seed0, seed1);
+}
+
+static int malloc_count = 0;
+
+void* counting_malloc(size_t size) {
+    malloc_count++;
+    return malloc(size);
+}
+
 int test_hashmap(void) {
 
     // Initialize hashmap which stores "data" object type
@@ -819,10 +855,1061 @@ int test_hashmap(void) {
         
     }
 
-    hashmap_free(map);    
+    hashmap_free(map);
+
+
+
+
+    // Churn test: interleaved set/delete on a small map, checked against a plain array.
+    // It forces tombstones, in-place rehashes, grow and shrink of the control byte groups
+
+    printf("[TEST_FUNC] Churn test\n");
+
+    map = hashmap_new_with_allocator(
+        malloc, 0, free, sizeof(data),
+        16, SEED0, SEED1,
+        custom_hash, compare_hash, 0);
+    if(map == 0) {
+        printf("[TEST_FUNC] Hashamp non initalized!\n");
+        return -1;
+    }
+
+    int allocations;
+    int keys = 512;
+    char present[keys];
+    size_t expected = 0;
+    memset(present, 0, keys);
+    srand(SEED0);
+
+    for(i = 0; i < 200000; i++) {
+        int key = rand() % keys;
+        if(rand() % 2) {
+            data_ret = hashmap_set(map, &(data){ .key=key, .buffer=0});
+            if((data_ret != 0) != present[key]) { printf("[TEST_FUNC] Wrong set result for key %d\n", key); return -1; }
+            if(!present[key]) expected++;
+            present[key] = 1;
+        } else {
+            data_ret = hashmap_delete(map, &key);
+            if((data_ret != 0) != present[key]) { printf("[TEST_FUNC] Wrong delete result for key %d\n", key); return -1; }
+            if(present[key]) expected--;
+            present[key] = 0;
+        }
+        if(hashmap_count(map) != expected) { printf("[TEST_FUNC] Wrong count %ld (expected %ld)\n", hashmap_count(map), expected); return -1; }
+    }
+
+    for(i = 0; i < keys; i++) {
+        data_ret = hashmap_get(map, &i);
+        if((data_ret != 0) != present[i] || (data_ret != 0 && data_ret -> key != i)) {
+            printf("[TEST_FUNC] Wrong get result for key %d\n", i);
+            return -1;
+        }
+    }
+
+    hashmap_free(map);
+
+    printf("[TEST_FUNC] Churn test correct (%ld items left)\n", expected);
+
+
+
+
+    // Tombstone test: keys < 1000 use a degenerate hash, so they all share the same probe sequence and fill
+    // whole groups. Deleting them leaves tombstones, which the deletes must drop in place (so the next inserts,
+    // with a good hash, find EMPTY slots) instead of growing the map
+
+    printf("[TEST_FUNC] Tombstone test\n");
+
+    map = hashmap_new_with_allocator(
+        counting_malloc, 0, free, sizeof(data),
+        512, SEED0, SEED1,
+        clustered_hash, compare_hash, 0);
+    if(map == 0) {
+        printf("[TEST_FUNC] Hashamp non initalized!\n");
+        return -1;
+    }
+    allocations = malloc_count;
+
+    for(i = 0; i < 448; i++) {
+        if(hashmap_set(map, &(data){ .key=i, .buffer=0}) != 0 || hashmap_oom(map)) { printf("[TEST_FUNC] Error in setting element %d\n", i); return -1; }
+    }
+    for(i = 0; i < 448; i++) {
+        if(hashmap_delete(map, &i) == 0) { printf("[TEST_FUNC] Error in deleting element %d\n", i); return -1; }
+    }
+
+    for(i = 1000; i < 1100; i++) {
+        if(hashmap_set(map, &(data){ .key=i, .buffer=0}) != 0 || hashmap_oom(map)) { printf("[TEST_FUNC] Error in setting element %d\n", i); return -1; }
+    }
+    for(i = 1000; i < 1100; i++) {
+        if(hashmap_get(map, &i) == 0) { printf("[TEST_FUNC] Element %d lost\n", i); return -1; }
+    }
+
+    if(malloc_count != allocations) {
+        printf("[TEST_FUNC] Tombstones dropped by growing the map instead of in place\n");
+        return -1;
+    }
+
+    hashmap_free(map);
+
+    printf("[TEST_FUNC] Tombstone test correct\n");
+
+
+
+
+    // Fixed capacity test: the map must take exactly "fixed_cap" items, fail fast on the next one
+    // and never allocate after creation, even under set/delete churn
+
+    printf("[TEST_FUNC] Fixed capacity test\n");
+
+    int fixed_cap = 256;
+    map = hashmap_new_with_flags(
+        counting_malloc, 0, free, sizeof(data),
+        fixed_cap, SEED0, SEED1,
+        custom_hash, compare_hash, 0, HASHMAP_FIXED_CAP);
+    if(map == 0) {
+        printf("[TEST_FUNC] Hashamp non initalized!\n");
+        return -1;
+    }
+    allocations = malloc_count;
+
+    for(i = 0; i < fixed_cap; i++) {
+        if(hashmap_set(map, &(data){ .key=i, .buffer=0}) != 0 || hashmap_oom(map)) {
+            printf("[TEST_FUNC] Error in setting element %d\n", i);
+            return -1;
+        }
+    }
+
+    if(hashmap_set(map, &(data){ .key=fixed_cap, .buffer=0}) != 0 || !hashmap_oom(map)) {
+        printf("[TEST_FUNC] Set over the fixed capacity succeeded!\n");
+        return -1;
+    }
+    printf("[TEST_FUNC] Set over the fixed capacity failed, Correct!\n");
+
+    for(i = 0; i < 200000; i++) {
+        // Replace a key with a new one and then put it back
+        int key = rand() % fixed_cap;
+        int new_key = key + fixed_cap * (1 + rand() % 64);
+        if(hashmap_delete(map, &key) == 0) { printf("[TEST_FUNC] Error in deleting element %d\n", key); return -1; }
+        if(hashmap_set(map, &(data){ .key=new_key, .buffer=0}) != 0 || hashmap_oom(map)) {
+            printf("[TEST_FUNC] Error in setting element %d\n", new_key);
+            return -1;
+        }
+        if(hashmap_delete(map, &new_key) == 0) { printf("[TEST_FUNC] Error in deleting element %d\n", new_key); return -1; }
+        if(hashmap_set(map, &(data){ .key=key, .buffer=0}) != 0 || hashmap_oom(map)) {
+            printf("[TEST_FUNC] Error in setting element %d\n", key);
+            return -1;
+        }
+    }
+
+    for(i = 0; i < fixed_cap; i++) {
+        if(hashmap_get(map, &i) == 0) { printf("[TEST_FUNC] Element %d lost\n", i); return -1; }
+    }
+
+    if(malloc_count != allocations) {
+        printf("[TEST_FUNC] Fixed capacity map allocated %d times after creation!\n", malloc_count - allocations);
+        return -1;
+    }
+
+    hashmap_free(map);
+
+    printf("[TEST_FUNC] Fixed capacity test correct\n");
 
     printf("[TEST_FUNC] Test Hashmap executed correctly!\n");
 
     return 0;
 
-}
\ No newline at end of file
+}
+
+
+
+// Concurrent Hashmap. The buffer pointer of each item carries a checksum of its key
+// so that readers can detect torn reads
+
+#define CHECKSUM(key)       ((char *)(uintptr_t)((key) ^ 0x5a5a5a5a))
+#define BENCH_KEYS          4096
+#define BENCH_OPS           400000
+#define BENCH_MAX_THREADS   8
+
+struct bench_arg {
+    struct chashmap *cmap;
+    struct hashmap *map;
+    pthread_rwlock_t *lock;
+    int id;
+    int writer;
+    volatile int *stop;
+    long errors;
+};
+
+// Readers check that every item found is consistent, writer "id" keeps setting
+// and deleting its own keys (key % 4 == id)
+static void *stress_worker(void *a) {
+
+    struct bench_arg *arg = a;
+    unsigned int state = arg -> id + 1;
+    data item;
+
+    while(!*(arg -> stop)) {
+        int key = rand_r(&state) % BENCH_KEYS;
+        if(arg -> writer) {
+            key = (key & ~3) | arg -> id;
+            if(rand_r(&state) & 1) chashmap_set(arg -> cmap, &(data){ .key=key, .buffer=CHECKSUM(key)}, 0);
+            else chashmap_delete(arg -> cmap, &key, 0);
+        }
+        else if(chashmap_get(arg -> cmap, &key, &item) && (item.key != key || item.buffer != CHECKSUM(key))) {
+            arg -> errors++;
+        }
+    }
+    return 0;
+}
+
+// 90% get, 10% set/delete on a random key
+static void *bench_worker(void *a) {
+
+    struct bench_arg *arg = a;
+    unsigned int state = arg -> id + 1;
+    data item;
+    int i;
+
+    for(i = 0; i < BENCH_OPS; i++) {
+        int key = rand_r(&state) % BENCH_KEYS;
+        int op = rand_r(&state) % 20;
+        if(arg -> cmap) {
+            if(op == 0) chashmap_set(arg -> cmap, &(data){ .key=key, .buffer=CHECKSUM(key)}, 0);
+            else if(op == 1) chashmap_delete(arg -> cmap, &key, 0);
+            else chashmap_get(arg -> cmap, &key, &item);
+        }
+        else {
+            if(op < 2) {
+                pthread_rwlock_wrlock(arg -> lock);
+                if(op == 0) hashmap_set(arg -> map, &(data){ .key=key, .buffer=CHECKSUM(key)});
+                else hashmap_delete(arg -> map, &key);
+                pthread_rwlock_unlock(arg -> lock);
+            }
+            else {
+                pthread_rwlock_rdlock(arg -> lock);
+                data *found = hashmap_get(arg -> map, &key);
+                if(found) item = *found;
+                pthread_rwlock_unlock(arg -> lock);
+            }
+        }
+    }
+    return 0;
+}
+
+static bool count_item(const void *item, void *udata) {
+    (*(size_t *) udata)++;
+    return true;
+}
+
+static double run_bench(struct chashmap *cmap, struct hashmap *map, pthread_rwlock_t *lock, int threads) {
+
+    pthread_t tid[BENCH_MAX_THREADS];
+    struct bench_arg args[BENCH_MAX_THREADS];
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < threads; i++) {
+        args[i] = (struct bench_arg){ .cmap=cmap, .map=map, .lock=lock, .id=i };
+        pthread_create(&tid[i], 0, bench_worker, &args[i]);
+    }
+    for(i = 0; i < threads; i++) pthread_join(tid[i], 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double) threads * BENCH_OPS / secs;
+}
+
+int test_chashmap(void) {
+
+    int i;
+    data item;
+
+    // Small capacity so that every stripe has to grow a few times
+
+    struct chashmap* cmap = chashmap_new(sizeof(data), 16, SEED0, SEED1, custom_hash, compare_hash, 0);
+    if(cmap == 0) {
+        printf("[TEST_FUNC] Concurrent Hashmap non initalized!\n");
+        return -1;
+    }
+
+    for(i = 0; i < 10000; i++) {
+        if(chashmap_set(cmap, &(data){ .key=i, .buffer=CHECKSUM(i)}, 0) != 0) { printf("[TEST_FUNC] Error in setting element %d\n", i); return -1; }
+    }
+    if(chashmap_count(cmap) != 10000) {
+        printf("[TEST_FUNC] Number of entries should be 10000, is %ld\n", chashmap_count(cmap));
+        return -1;
+    }
+    for(i = 0; i < 10000; i++) {
+        if(!chashmap_get(cmap, &i, &item) || item.key != i || item.buffer != CHECKSUM(i)) { printf("[TEST_FUNC] Element %d lost\n", i); return -1; }
+    }
+
+    if(chashmap_set(cmap, &(data){ .key=7, .buffer="chiave7"}, &item) != 1 || item.buffer != CHECKSUM(7)) {
+        printf("[TEST_FUNC] Replace did not return the old item\n");
+        return -1;
+    }
+    if(!chashmap_get(cmap, &(int){7}, &item) || strcmp(item.buffer, "chiave7") != 0) {
+        printf("[TEST_FUNC] Replace did not update the item\n");
+        return -1;
+    }
+
+    for(i = 0; i < 10000; i += 2) {
+        if(!chashmap_delete(cmap, &i, &item) || item.key != i) { printf("[TEST_FUNC] Error in deleting element %d\n", i); return -1; }
+    }
+    for(i = 0; i < 10000; i++) {
+        if(chashmap_get(cmap, &i, &item) != (i % 2 == 1)) { printf("[TEST_FUNC] Wrong presence of element %d\n", i); return -1; }
+    }
+    if(chashmap_delete(cmap, &(int){0}, 0)) {
+        printf("[TEST_FUNC] Deleted a non present element\n");
+        return -1;
+    }
+
+    // Stripes still migrating are scanned in both tables, each item once
+    size_t scanned = 0;
+    if(!chashmap_scan(cmap, count_item, &scanned) || scanned != 5000 || chashmap_count(cmap) != 5000) {
+        printf("[TEST_FUNC] Scan found %ld entries instead of 5000\n", scanned);
+        return -1;
+    }
+
+    chashmap_free(cmap);
+
+    printf("[TEST_FUNC] Concurrent Hashmap functional test correct\n");
+
+
+    // Stress test: 4 writers churning disjoint keys while 4 readers check every item they find
+
+    cmap = chashmap_new(sizeof(data), 16, SEED0, SEED1, custom_hash, compare_hash, 0);
+    if(cmap == 0) {
+        printf("[TEST_FUNC] Concurrent Hashmap non initalized!\n");
+        return -1;
+    }
+
+    pthread_t tid[BENCH_MAX_THREADS];
+    struct bench_arg args[BENCH_MAX_THREADS];
+    volatile int stop = 0;
+    long errors = 0;
+
+    for(i = 0; i < BENCH_MAX_THREADS; i++) {
+        args[i] = (struct bench_arg){ .cmap=cmap, .id=i % 4, .writer=i < 4, .stop=&stop };
+        pthread_create(&tid[i], 0, stress_worker, &args[i]);
+    }
+    sleep(1);
+    stop = 1;
+    for(i = 0; i < BENCH_MAX_THREADS; i++) {
+        pthread_join(tid[i], 0);
+        errors += args[i].errors;
+    }
+
+    if(errors != 0) {
+        printf("[TEST_FUNC] Readers found %ld inconsistent items\n", errors);
+        return -1;
+    }
+
+    chashmap_free(cmap);
+
+    printf("[TEST_FUNC] Concurrent Hashmap stress test correct\n");
+
+
+    // Benchmark: 90% get / 10% set-delete mix, Concurrent Hashmap against Hashmap + rwlock
+
+    int threads;
+    for(threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+
+        cmap = chashmap_new(sizeof(data), BENCH_KEYS, SEED0, SEED1, custom_hash, compare_hash, 0);
+        struct hashmap* map = hashmap_new(sizeof(data), BENCH_KEYS, SEED0, SEED1, custom_hash, compare_hash, 0);
+        pthread_rwlock_t lock;
+        pthread_rwlock_init(&lock, 0);
+        if(cmap == 0 || map == 0) {
+            printf("[TEST_FUNC] Hashamp non initalized!\n");
+            return -1;
+        }
+        for(i = 0; i < BENCH_KEYS; i += 2) {
+            chashmap_set(cmap, &(data){ .key=i, .buffer=CHECKSUM(i)}, 0);
+            hashmap_set(map, &(data){ .key=i, .buffer=CHECKSUM(i)});
+        }
+
+        double concurrent = run_bench(cmap, 0, 0, threads);
+        double locked = run_bench(0, map, &lock, threads);
+
+        printf("[TEST_FUNC] %d thread(s): chashmap %.2f Mops/s, hashmap+rwlock %.2f Mops/s\n",
+            threads, concurrent / 1e6, locked / 1e6);
+
+        pthread_rwlock_destroy(&lock);
+        hashmap_free(map);
+        chashmap_free(cmap);
+    }
+
+    printf("[TEST_FUNC] Test Concurrent Hashmap executed correctly!\n");
+
+    return 0;
+}
+
+
+
+
+// Tag services, built in userspace (tag-engine.h). Messages carry a pattern (byte i = byte 0 + i) so that
+// receivers can detect torn or mixed messages
+
+#define ENGINE_BUFFER           4096
+#define ENGINE_FUZZ_THREADS     8
+#define ENGINE_FUZZ_KEYS        16
+#define ENGINE_PINGPONG         100000
+#define ENGINE_CHURN            100000
+
+struct engine_arg {
+    int tag;
+    int level;
+    int id;
+    volatile int *stop;
+    int ret;
+    long errors;
+    long ops;
+    unsigned long long seq;
+};
+
+static void fill_message(char *buffer, size_t size, char seed) {
+    size_t i;
+    for(i = 0; i < size; i++) buffer[i] = seed + i;
+}
+
+// A received buffer is either untouched (empty message) or a prefix of a pattern
+static int check_message(char *buffer, size_t size) {
+    size_t i;
+    for(i = 1; i < size && buffer[i] != 0; i++)
+        if(buffer[i] != (char) (buffer[0] + i)) return 0;
+    return 1;
+}
+
+static void *engine_receiver(void *a) {
+    struct engine_arg *arg = a;
+    char buffer[64] = { 0 };
+    int epoch;
+    arg -> ret = tag_receive(arg -> tag, arg -> level, buffer, sizeof(buffer), &epoch);
+    if(arg -> ret == 1 && (buffer[0] != 'x' || !check_message(buffer, sizeof(buffer)))) arg -> errors++;
+    return 0;
+}
+
+// As engine_receiver, busy-polling the level up to 1 s before sleeping
+static void *engine_spin_receiver(void *a) {
+    struct engine_arg *arg = a;
+    char buffer[64] = { 0 };
+    struct tag_args args = { .tag = arg -> tag, .level = arg -> level, .buffer = (uintptr_t) buffer, .size = sizeof(buffer),
+                             .spin_ns = 1000000000 };
+    arg -> ret = tag_op(TAG_OP_RECEIVE, &args);
+    if(arg -> ret == 1 && (buffer[0] != 'x' || !check_message(buffer, sizeof(buffer)))) arg -> errors++;
+    return 0;
+}
+
+// Receive the retained message newer than arg -> seq (TAG_RECV_LATEST), waiting for the next one if there's none
+static void *engine_latest_receiver(void *a) {
+    struct engine_arg *arg = a;
+    char buffer[64] = { 0 };
+    struct tag_args args = { .tag = arg -> tag, .level = arg -> level, .buffer = (uintptr_t) buffer, .size = sizeof(buffer),
+                             .command = TAG_RECV_LATEST, .seq = arg -> seq };
+    arg -> ret = tag_op(TAG_OP_RECEIVE, &args);
+    arg -> seq = args.seq;
+    if(arg -> ret == 1 && (buffer[0] != 'x' || !check_message(buffer, sizeof(buffer)))) arg -> errors++;
+    return 0;
+}
+
+// Receive from any of the levels in arg -> id (mask), arg -> level set to the one the message came from
+static void *engine_any_receiver(void *a) {
+    struct engine_arg *arg = a;
+    char buffer[64] = { 0 };
+    struct tag_args args = { .tag = arg -> tag, .level_mask = arg -> id, .buffer = (uintptr_t) buffer, .size = sizeof(buffer) };
+    arg -> ret = tag_op(TAG_OP_RECEIVE_ANY, &args);
+    arg -> level = args.level;
+    arg -> seq = args.seq;
+    if(arg -> ret == 1 && (buffer[0] != 'x' || !check_message(buffer, sizeof(buffer)))) arg -> errors++;
+    return 0;
+}
+
+// Wait on arg -> id pairs of wait_pairs, arg -> level set to the index of the pair that woke it up
+static struct tag_wait_pair wait_pairs[16];
+
+static void *engine_multi_receiver(void *a) {
+    struct engine_arg *arg = a;
+    char buffer[64] = { 0 };
+    struct tag_args args = { .pairs = (uintptr_t) wait_pairs, .count = arg -> id, .buffer = (uintptr_t) buffer, .size = sizeof(buffer) };
+    arg -> ret = tag_op(TAG_OP_WAIT_MULTI, &args);
+    arg -> level = args.index;
+    arg -> seq = args.seq;
+    if(arg -> ret == 1 && (buffer[0] != 'x' || !check_message(buffer, sizeof(buffer)))) arg -> errors++;
+    return 0;
+}
+
+// Send until a receiver gets the message
+static int engine_send_retry(int tag, int level, char *buffer, size_t size) {
+    int ret, outcome;
+    while((ret = tag_send(tag, level, buffer, size, &outcome)) == 0) sched_yield();
+    return ret;
+}
+
+// Random operations on random (also invalid) tags, levels and sizes. Only the documented return values are accepted
+static void *engine_fuzzer(void *a) {
+
+    struct engine_arg *arg = a;
+    unsigned int state = arg -> id + 1;
+    char *buffer = malloc(ENGINE_BUFFER + 64);
+    int ret, outcome, epoch;
+
+    while(!*(arg -> stop)) {
+        int tag = rand_r(&state) % (TAG_INFO_TAGS / 8 + 2) - 1;
+        int level = rand_r(&state) % (TAG_INFO_LEVELS / 8 + 2) - 1;
+        size_t size = rand_r(&state) % (ENGINE_BUFFER + 64);
+        char *buf = rand_r(&state) % 8 == 0 ? 0 : buffer;
+        int op = rand_r(&state) % 10;
+
+        if(op == 0) {
+            int key = rand_r(&state) % (ENGINE_FUZZ_KEYS + 1);
+            ret = tag_get(key == ENGINE_FUZZ_KEYS ? IPC_PRIVATE : key, rand_r(&state) % 3, rand_r(&state) % 2);
+            if(ret < 0 && ret != -EINVAL && ret != -EBUSY && ret != -EMAXTAG && ret != -ENODATA) arg -> errors++;
+        }
+        else if(op == 1) {
+            ret = tag_ctl(tag, rand_r(&state) % 2);
+            if(ret != 0 && ret != 1 && ret != -EINVAL && ret != -ENODATA) arg -> errors++;
+        }
+        else if(op < 6) {
+            if(buf != 0) fill_message(buf, size, 'a' + rand_r(&state) % 26);
+            ret = tag_send(tag, level, buf, size, &outcome);
+            if(ret != 0 && ret != 1 && ret != -EINVAL && ret != -ENODATA) arg -> errors++;
+        }
+        else {
+            if(buf != 0) memset(buf, 0, ENGINE_BUFFER + 64);
+            ret = tag_receive(tag, level, buf, size, &epoch);
+            if(ret != 0 && ret != 1 && ret != -EINVAL && ret != -ENODATA) arg -> errors++;
+            if(ret == 1 && buf != 0 && !check_message(buf, size < ENGINE_BUFFER ? size : ENGINE_BUFFER)) arg -> errors++;
+        }
+        if(ret < -1000 || ret > TAG_INFO_TAGS) arg -> errors++;
+        arg -> ops++;
+    }
+
+    free(buffer);
+    __atomic_store_n(&(arg -> ret), 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+static void *engine_pong(void *a) {
+    struct engine_arg *arg = a;
+    char buffer[64];
+    int i, epoch;
+    for(i = 0; i < ENGINE_PINGPONG; i++) {
+        if(tag_receive(arg -> tag, 0, buffer, sizeof(buffer), &epoch) != 1) { arg -> errors++; break; }
+        if(engine_send_retry(arg -> tag, 1, buffer, sizeof(buffer)) != 1) { arg -> errors++; break; }
+    }
+    return 0;
+}
+
+int test_tag_engine(void) {
+
+    struct tag_info_memory mem;
+    struct engine_arg arg;
+    pthread_t tid[ENGINE_FUZZ_THREADS + 1];
+    struct engine_arg args[ENGINE_FUZZ_THREADS];
+    struct timespec start, end;
+    volatile int stop = 0;
+    char buffer[64];
+    int tag, tags_created[TAG_INFO_TAGS];
+    int i, ret, outcome, epoch;
+    long errors, ops;
+
+    if(tag_engine_init() != 0) {
+        printf("[TEST_FUNC] Tag engine non initalized!\n");
+        return -1;
+    }
+
+
+    // tag_get()
+
+    if(tag_get(-1, TAG_CREAT, TAG_PERM_ALL) != -EINVAL || tag_get(IPC_PRIVATE, TAG_OPEN, TAG_PERM_ALL) != -EINVAL ||
+       tag_get(42, TAG_CREAT, 5) != -EINVAL || tag_get(42, 7, TAG_PERM_ALL) != -EINVAL) {
+        printf("[TEST_FUNC] Invalid tag_get() parameters not detected\n");
+        return -1;
+    }
+    if(tag_get(42, TAG_OPEN, TAG_PERM_ALL) != -ENODATA) {
+        printf("[TEST_FUNC] Opened a non existing Tag\n");
+        return -1;
+    }
+    tag = tag_get(42, TAG_CREAT, TAG_PERM_ALL);
+    if(tag < 0 || tag_get(42, TAG_CREAT, TAG_PERM_ALL) != -EBUSY || tag_get(42, TAG_OPEN, TAG_PERM_ALL) != tag) {
+        printf("[TEST_FUNC] Error in creating and opening key 42 (tag %d)\n", tag);
+        return -1;
+    }
+
+    tag_engine_memory(&mem);
+    if(mem.tags != 1 || mem.levels != TAG_INFO_LEVELS || mem.epoch_levels != 0) {
+        printf("[TEST_FUNC] Memory counters: %llu tags, %llu levels\n", (unsigned long long) mem.tags, (unsigned long long) mem.levels);
+        return -1;
+    }
+
+    printf("[TEST_FUNC] tag_get() test correct\n");
+
+
+    // tag_send() / tag_receive()
+
+    if(tag_send(tag, 0, "x", 1, &outcome) != 0 || outcome != TAG_SEND_NO_RECEIVERS) {
+        printf("[TEST_FUNC] Message delivered without receivers\n");
+        return -1;
+    }
+    if(tag_send(tag, TAG_INFO_LEVELS, "x", 1, &outcome) != -EINVAL || tag_send(tag, 0, "x", ENGINE_BUFFER + 1, &outcome) != -EINVAL ||
+       tag_send(tag + 1, 0, "x", 1, &outcome) != -ENODATA || tag_receive(tag + 1, 0, buffer, 1, &epoch) != -ENODATA) {
+        printf("[TEST_FUNC] Invalid tag_send()/tag_receive() parameters not detected\n");
+        return -1;
+    }
+
+    arg = (struct engine_arg){ .tag = tag, .level = 3 };
+    pthread_create(&tid[0], 0, engine_receiver, &arg);
+    fill_message(buffer, sizeof(buffer), 'x');
+    if(engine_send_retry(tag, 3, buffer, 20) != 1) {
+        printf("[TEST_FUNC] Error in sending\n");
+        return -1;
+    }
+    pthread_join(tid[0], 0);
+    if(arg.ret != 1 || arg.errors != 0) {
+        printf("[TEST_FUNC] Message not received correctly (%d)\n", arg.ret);
+        return -1;
+    }
+
+    printf("[TEST_FUNC] tag_send()/tag_receive() test correct\n");
+
+
+    // tag_ctl()
+
+    // The delete must fail while the receiver is waiting
+    arg = (struct engine_arg){ .tag = tag, .level = 5 };
+    pthread_create(&tid[0], 0, engine_receiver, &arg);
+    usleep(100000);
+    if(tag_ctl(tag, TAG_DELETE) != 0) {
+        printf("[TEST_FUNC] Deleted a Tag in use\n");
+        return -1;
+    }
+    engine_send_retry(tag, 5, 0, 0);
+    pthread_join(tid[0], 0);
+    if(arg.ret != 1) {
+        printf("[TEST_FUNC] Empty message not received (%d)\n", arg.ret);
+        return -1;
+    }
+
+    arg = (struct engine_arg){ .tag = tag, .level = 7 };
+    pthread_create(&tid[0], 0, engine_receiver, &arg);
+    while(tag_ctl(tag, TAG_AWAKE_ALL) != 1) sched_yield();
+    pthread_join(tid[0], 0);
+    if(arg.ret != 0) {
+        printf("[TEST_FUNC] Awake All not received (%d)\n", arg.ret);
+        return -1;
+    }
+
+    if(tag_ctl(tag, 3) != -EINVAL || tag_ctl(tag, TAG_DELETE) != 1 || tag_ctl(tag, TAG_DELETE) != -ENODATA ||
+       tag_get(42, TAG_OPEN, TAG_PERM_ALL) != -ENODATA) {
+        printf("[TEST_FUNC] Error in deleting Tag %d\n", tag);
+        return -1;
+    }
+
+    for(i = 0; i < TAG_INFO_TAGS; i++) {
+        tags_created[i] = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_USR);
+        if(tags_created[i] < 0) {
+            printf("[TEST_FUNC] Error in creating Tag %d: %d\n", i, tags_created[i]);
+            return -1;
+        }
+    }
+    if(tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL) != -EMAXTAG) {
+        printf("[TEST_FUNC] Created more than %d Tags\n", TAG_INFO_TAGS);
+        return -1;
+    }
+    for(i = 0; i < TAG_INFO_TAGS; i++) {
+        if(tag_ctl(tags_created[i], TAG_DELETE) != 1) {
+            printf("[TEST_FUNC] Error in deleting Tag %d\n", tags_created[i]);
+            return -1;
+        }
+    }
+
+    tag_engine_memory(&mem);
+    if(mem.tags != 0 || mem.levels != 0) {
+        printf("[TEST_FUNC] Memory leaked: %llu tags, %llu levels\n", (unsigned long long) mem.tags, (unsigned long long) mem.levels);
+        return -1;
+    }
+
+    printf("[TEST_FUNC] tag_ctl() test correct\n");
+
+
+    // tag_op(): same results of the direct calls, invalid opcodes rejected
+
+    {
+        struct tag_args op_args = { .key = 43, .command = TAG_CREAT, .permission = TAG_PERM_ALL };
+
+        tag = tag_op(TAG_OP_GET, &op_args);
+        op_args = (struct tag_args){ .key = 43, .command = TAG_OPEN, .permission = TAG_PERM_ALL };
+        if(tag < 0 || tag_op(TAG_OP_GET, &op_args) != tag) {
+            printf("[TEST_FUNC] Error in creating and opening key 43 through tag_op (tag %d)\n", tag);
+            return -1;
+        }
+
+        op_args = (struct tag_args){ .tag = tag, .level = 0, .buffer = (uintptr_t) "x", .size = 1 };
+        if(tag_op(TAG_OP_SEND, &op_args) != 0 || tag_op(TAG_OPS, &op_args) != -EINVAL || tag_op(-1, &op_args) != -EINVAL) {
+            printf("[TEST_FUNC] Wrong tag_op() dispatch\n");
+            return -1;
+        }
+
+        arg = (struct engine_arg){ .tag = tag, .level = 2 };
+        pthread_create(&tid[0], 0, engine_receiver, &arg);
+        fill_message(buffer, sizeof(buffer), 'x');
+        op_args = (struct tag_args){ .tag = tag, .level = 2, .buffer = (uintptr_t) buffer, .size = 20 };
+        while((ret = tag_op(TAG_OP_SEND, &op_args)) == 0) sched_yield();
+        pthread_join(tid[0], 0);
+        if(ret != 1 || arg.ret != 1 || arg.errors != 0) {
+            printf("[TEST_FUNC] Message not delivered through tag_op (%d, %d)\n", ret, arg.ret);
+            return -1;
+        }
+
+        op_args = (struct tag_args){ .tag = tag, .command = TAG_DELETE };
+        if(tag_op(TAG_OP_CTL, &op_args) != 1) {
+            printf("[TEST_FUNC] Error in deleting Tag %d through tag_op\n", tag);
+            return -1;
+        }
+    }
+
+    printf("[TEST_FUNC] tag_op() test correct\n");
+
+
+    // Status page: mirrors the Tag existence and the waiting receivers
+
+    tag = tag_get(44, TAG_CREAT, TAG_PERM_ALL);
+    if(tag < 0 || tag_status -> tag[tag].exists != 1 || tag_status -> tag[tag].permission != TAG_PERM_ALL ||
+       tag_status -> tag[tag].waiting != 0) {
+        printf("[TEST_FUNC] Status of the new Tag %d not published\n", tag);
+        return -1;
+    }
+
+    arg = (struct engine_arg){ .tag = tag, .level = 4 };
+    pthread_create(&tid[0], 0, engine_receiver, &arg);
+    while(__atomic_load_n(&(tag_status -> tag[tag].level_waiting[4]), __ATOMIC_SEQ_CST) != 1) sched_yield();
+    if(tag_status -> tag[tag].waiting != 1 || tag_status -> tag[tag].level_waiting[3] != 0) {
+        printf("[TEST_FUNC] Wrong waiting receivers in the status of Tag %d\n", tag);
+        return -1;
+    }
+    fill_message(buffer, sizeof(buffer), 'x');
+    if(engine_send_retry(tag, 4, buffer, 20) != 1) {
+        printf("[TEST_FUNC] Error in sending\n");
+        return -1;
+    }
+    pthread_join(tid[0], 0);
+    if(arg.ret != 1 || tag_status -> tag[tag].waiting != 0 || tag_status -> tag[tag].level_waiting[4] != 0 ||
+       tag_status -> tag[tag].level_seq[4] != 1 || tag_status -> tag[tag].level_seq[3] != 0 ||
+       tag_status -> tag[tag].level_ready[4] != 0 || tag_status -> tag[tag].ready != 0) {
+        printf("[TEST_FUNC] Status of Tag %d not cleared after the receive\n", tag);
+        return -1;
+    }
+
+    // Busy-polling receiver: same delivery, one more message in the sequence of the level
+    arg = (struct engine_arg){ .tag = tag, .level = 4 };
+    pthread_create(&tid[0], 0, engine_spin_receiver, &arg);
+    if(engine_send_retry(tag, 4, buffer, 20) != 1) {
+        printf("[TEST_FUNC] Error in sending\n");
+        return -1;
+    }
+    pthread_join(tid[0], 0);
+    if(arg.ret != 1 || arg.errors != 0 || tag_status -> tag[tag].level_seq[4] != 2 || tag_status -> tag[tag].waiting != 0) {
+        printf("[TEST_FUNC] Message not received by the busy-polling receiver (%d)\n", arg.ret);
+        return -1;
+    }
+
+    if(tag_ctl(tag, TAG_DELETE) != 1 || tag_status -> tag[tag].exists != 0) {
+        printf("[TEST_FUNC] Status of the deleted Tag %d still published\n", tag);
+        return -1;
+    }
+
+    printf("[TEST_FUNC] Status page test correct\n");
+
+
+    // Retained messages: kept without receivers, returned at once to a TAG_RECV_LATEST receiver that hasn't seen them
+
+    if(tag_get(45, TAG_OPEN | TAG_RETAIN, TAG_PERM_ALL) != -EINVAL) {
+        printf("[TEST_FUNC] TAG_RETAIN accepted with TAG_OPEN\n");
+        return -1;
+    }
+    tag = tag_get(45, TAG_CREAT | TAG_RETAIN, TAG_PERM_ALL);
+    if(tag < 0 || tag_status -> tag[tag].retain != 1) {
+        printf("[TEST_FUNC] Error in creating the retained Tag 45 (tag %d)\n", tag);
+        return -1;
+    }
+
+    fill_message(buffer, sizeof(buffer), 'x');
+    if(tag_send(tag, 6, buffer, 20, &outcome) != 0 || outcome != TAG_SEND_NO_RECEIVERS || tag_status -> tag[tag].level_seq[6] != 1) {
+        printf("[TEST_FUNC] Message not retained without receivers\n");
+        return -1;
+    }
+
+    arg = (struct engine_arg){ .tag = tag, .level = 6, .seq = 0 };
+    engine_latest_receiver(&arg);
+    if(arg.ret != 1 || arg.errors != 0 || arg.seq != 1) {
+        printf("[TEST_FUNC] Retained message not received (%d, seq %llu)\n", arg.ret, arg.seq);
+        return -1;
+    }
+
+    // Already seen: waits for the next message, which is both delivered and retained
+    pthread_create(&tid[0], 0, engine_latest_receiver, &arg);
+    while(__atomic_load_n(&(tag_status -> tag[tag].level_waiting[6]), __ATOMIC_SEQ_CST) != 1) sched_yield();
+    if(tag_send(tag, 6, buffer, 20, &outcome) != 1) {
+        printf("[TEST_FUNC] Message not delivered on the retained Tag\n");
+        return -1;
+    }
+    pthread_join(tid[0], 0);
+    if(arg.ret != 1 || arg.errors != 0 || arg.seq != 2 || tag_status -> tag[tag].level_seq[6] != 2) {
+        printf("[TEST_FUNC] Next message not received on the retained Tag (%d, seq %llu)\n", arg.ret, arg.seq);
+        return -1;
+    }
+
+    tag_engine_memory(&mem);
+    if(mem.retained_bytes != ENGINE_BUFFER || tag_ctl(tag, TAG_DELETE) != 1) {
+        printf("[TEST_FUNC] Retained messages: %llu bytes\n", (unsigned long long) mem.retained_bytes);
+        return -1;
+    }
+    tag_engine_memory(&mem);
+    if(mem.retained_bytes != 0) {
+        printf("[TEST_FUNC] Retained messages leaked: %llu bytes\n", (unsigned long long) mem.retained_bytes);
+        return -1;
+    }
+
+    printf("[TEST_FUNC] Retained messages test correct\n");
+
+
+    // Receive on several levels: waiting on all of them, the message comes from the level sent to
+
+    tag = tag_get(46, TAG_CREAT, TAG_PERM_ALL);
+    {
+        struct tag_args any_args = { .tag = tag, .level_mask = 0 };
+        if(tag < 0 || tag_op(TAG_OP_RECEIVE_ANY, &any_args) != -EINVAL) {
+            printf("[TEST_FUNC] Empty level mask not detected (tag %d)\n", tag);
+            return -1;
+        }
+    }
+
+    arg = (struct engine_arg){ .tag = tag, .id = (1 << 8) | (1 << 9) | (1 << 31) };
+    pthread_create(&tid[0], 0, engine_any_receiver, &arg);
+    while(__atomic_load_n(&(tag_status -> tag[tag].level_waiting[31]), __ATOMIC_SEQ_CST) != 1) sched_yield();
+    if(tag_status -> tag[tag].waiting != 1 || tag_status -> tag[tag].level_waiting[8] != 1 ||
+       tag_status -> tag[tag].level_waiting[9] != 1 || tag_status -> tag[tag].level_waiting[10] != 0) {
+        printf("[TEST_FUNC] Receiver not waiting on every level of the mask\n");
+        return -1;
+    }
+    fill_message(buffer, sizeof(buffer), 'x');
+    if(tag_send(tag, 10, buffer, 20, &outcome) != 0 || tag_send(tag, 9, buffer, 20, &outcome) != 1) {
+        printf("[TEST_FUNC] Wrong delivery to a receiver on several levels\n");
+        return -1;
+    }
+    pthread_join(tid[0], 0);
+    if(arg.ret != 1 || arg.errors != 0 || arg.level != 9 || arg.seq != 1 || tag_status -> tag[tag].waiting != 0 ||
+       tag_status -> tag[tag].level_waiting[8] != 0 || tag_status -> tag[tag].level_waiting[9] != 0 ||
+       tag_status -> tag[tag].level_waiting[31] != 0) {
+        printf("[TEST_FUNC] Message not received from level 9 (%d, level %d)\n", arg.ret, arg.level);
+        return -1;
+    }
+
+    arg = (struct engine_arg){ .tag = tag, .id = (1 << 0) | (1 << 1) };
+    pthread_create(&tid[0], 0, engine_any_receiver, &arg);
+    while(tag_ctl(tag, TAG_AWAKE_ALL) != 1) sched_yield();
+    pthread_join(tid[0], 0);
+    if(arg.ret != 0 || tag_ctl(tag, TAG_DELETE) != 1) {
+        printf("[TEST_FUNC] Awake All not received on several levels (%d)\n", arg.ret);
+        return -1;
+    }
+
+    printf("[TEST_FUNC] Receive on several levels test correct\n");
+
+
+    // Wait on pairs of different Tags: the message comes from the pair sent to, bad pairs leave nothing behind
+
+    {
+        int tag_a, tag_b, tag_gone;
+        struct tag_args multi_args = { .pairs = (uintptr_t) wait_pairs, .count = 0 };
+
+        tag_a = tag_get(47, TAG_CREAT, TAG_PERM_ALL);
+        tag_b = tag_get(48, TAG_CREAT, TAG_PERM_ALL);
+        tag_gone = tag_get(49, TAG_CREAT, TAG_PERM_ALL);
+        if(tag_a < 0 || tag_b < 0 || tag_gone < 0 || tag_ctl(tag_gone, TAG_DELETE) != 1) {
+            printf("[TEST_FUNC] Could not create the Tags of the multi-Tag wait test\n");
+            return -1;
+        }
+
+        wait_pairs[0] = (struct tag_wait_pair){ tag_b, 3 };
+        wait_pairs[1] = (struct tag_wait_pair){ tag_a, 40 };
+        if(tag_op(TAG_OP_WAIT_MULTI, &multi_args) != -EINVAL) {
+            printf("[TEST_FUNC] Empty pair array not detected\n");
+            return -1;
+        }
+        multi_args.count = 2;
+        if(tag_op(TAG_OP_WAIT_MULTI, &multi_args) != -EINVAL) {
+            printf("[TEST_FUNC] Wrong level of a pair not detected\n");
+            return -1;
+        }
+        wait_pairs[1] = (struct tag_wait_pair){ tag_b, 3 };
+        if(tag_op(TAG_OP_WAIT_MULTI, &multi_args) != -EINVAL) {
+            printf("[TEST_FUNC] Repeated pair not detected\n");
+            return -1;
+        }
+        multi_args.count = TAG_WAIT_MAX + 1;
+        if(tag_op(TAG_OP_WAIT_MULTI, &multi_args) != -EINVAL) {
+            printf("[TEST_FUNC] Too many pairs not detected\n");
+            return -1;
+        }
+        multi_args.count = 2;
+        wait_pairs[0] = (struct tag_wait_pair){ tag_b, 3 };
+        wait_pairs[1] = (struct tag_wait_pair){ tag_gone, 1 };
+        if(tag_op(TAG_OP_WAIT_MULTI, &multi_args) != -ENODATA || tag_status -> tag[tag_b].waiting != 0 ||
+           tag_status -> tag[tag_b].level_waiting[3] != 0) {
+            printf("[TEST_FUNC] Missing Tag of a pair not detected\n");
+            return -1;
+        }
+
+        wait_pairs[0] = (struct tag_wait_pair){ tag_b, 3 };
+        wait_pairs[1] = (struct tag_wait_pair){ tag_a, 7 };
+        wait_pairs[2] = (struct tag_wait_pair){ tag_b, 7 };
+        wait_pairs[3] = (struct tag_wait_pair){ tag_a, 3 };
+        arg = (struct engine_arg){ .id = 4 };
+        pthread_create(&tid[0], 0, engine_multi_receiver, &arg);
+        while(__atomic_load_n(&(tag_status -> tag[tag_b].level_waiting[7]), __ATOMIC_SEQ_CST) != 1) sched_yield();
+        if(tag_status -> tag[tag_a].waiting != 1 || tag_status -> tag[tag_b].waiting != 1 ||
+           tag_status -> tag[tag_a].level_waiting[3] != 1 || tag_status -> tag[tag_a].level_waiting[7] != 1 ||
+           tag_status -> tag[tag_b].level_waiting[3] != 1) {
+            printf("[TEST_FUNC] Receiver not waiting on every pair\n");
+            return -1;
+        }
+        fill_message(buffer, sizeof(buffer), 'x');
+        if(tag_send(tag_b, 7, buffer, 20, &outcome) != 1) {
+            printf("[TEST_FUNC] Wrong delivery to a receiver on several Tags\n");
+            return -1;
+        }
+        pthread_join(tid[0], 0);
+        if(arg.ret != 1 || arg.errors != 0 || arg.level != 2 || arg.seq != 1 ||
+           tag_status -> tag[tag_a].waiting != 0 || tag_status -> tag[tag_b].waiting != 0 ||
+           tag_status -> tag[tag_a].level_waiting[3] != 0 || tag_status -> tag[tag_b].level_waiting[7] != 0) {
+            printf("[TEST_FUNC] Message not received from the third pair (%d, index %d)\n", arg.ret, arg.level);
+            return -1;
+        }
+
+        arg = (struct engine_arg){ .id = 2 };
+        pthread_create(&tid[0], 0, engine_multi_receiver, &arg);
+        while(tag_ctl(tag_a, TAG_AWAKE_ALL) != 1) sched_yield();
+        pthread_join(tid[0], 0);
+        if(arg.ret != 0 || arg.level != 1 || tag_ctl(tag_a, TAG_DELETE) != 1 || tag_ctl(tag_b, TAG_DELETE) != 1) {
+            printf("[TEST_FUNC] Awake All not received on several Tags (%d, index %d)\n", arg.ret, arg.level);
+            return -1;
+        }
+    }
+
+    // Wait on 16 Tags: no lock is held while waiting, but the Tags can't be deleted until the receiver leaves
+
+    {
+        int many[16];
+
+        for(i = 0; i < 16; i++) {
+            many[i] = tag_get(60 + i, TAG_CREAT, TAG_PERM_ALL);
+            if(many[i] < 0) {
+                printf("[TEST_FUNC] Could not create the Tags of the many Tags wait test\n");
+                return -1;
+            }
+            wait_pairs[i] = (struct tag_wait_pair){ many[i], 5 };
+        }
+
+        arg = (struct engine_arg){ .id = 16 };
+        pthread_create(&tid[0], 0, engine_multi_receiver, &arg);
+        while(__atomic_load_n(&(tag_status -> tag[many[15]].level_waiting[5]), __ATOMIC_SEQ_CST) != 1) sched_yield();
+        if(tag_ctl(many[0], TAG_DELETE) != 0 || tag_ctl(many[15], TAG_DELETE) != 0) {
+            printf("[TEST_FUNC] Tag deleted while a receiver waits on it\n");
+            return -1;
+        }
+        fill_message(buffer, sizeof(buffer), 'x');
+        if(tag_send(many[12], 5, buffer, 20, &outcome) != 1) {
+            printf("[TEST_FUNC] Wrong delivery to a receiver on many Tags\n");
+            return -1;
+        }
+        pthread_join(tid[0], 0);
+        if(arg.ret != 1 || arg.errors != 0 || arg.level != 12) {
+            printf("[TEST_FUNC] Message not received from the 13th Tag (%d, index %d)\n", arg.ret, arg.level);
+            return -1;
+        }
+        for(i = 0; i < 16; i++) {
+            if(tag_status -> tag[many[i]].waiting != 0 || tag_ctl(many[i], TAG_DELETE) != 1) {
+                printf("[TEST_FUNC] Tag %d of the many Tags wait test left busy\n", many[i]);
+                return -1;
+            }
+        }
+    }
+
+    printf("[TEST_FUNC] Wait on several Tags test correct\n");
+
+
+    // Fuzz: random operations from concurrent threads, the main thread keeps waking up the receivers
+
+    for(i = 0; i < ENGINE_FUZZ_THREADS; i++) {
+        args[i] = (struct engine_arg){ .id = i, .stop = &stop };
+        pthread_create(&tid[i], 0, engine_fuzzer, &args[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for(i = 0; i < TAG_INFO_TAGS; i++) tag_ctl(i, TAG_AWAKE_ALL);
+        usleep(1000);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+    } while(end.tv_sec - start.tv_sec < 2);
+    stop = 1;
+
+    // Release the receivers still waiting
+    errors = ops = 0;
+    for(i = 0; i < ENGINE_FUZZ_THREADS; i++) {
+        while(__atomic_load_n(&(args[i].ret), __ATOMIC_SEQ_CST) == 0) {
+            for(ret = 0; ret < TAG_INFO_TAGS; ret++) tag_ctl(ret, TAG_AWAKE_ALL);
+            usleep(100);
+        }
+        pthread_join(tid[i], 0);
+        errors += args[i].errors;
+        ops += args[i].ops;
+    }
+    for(i = 0; i < TAG_INFO_TAGS; i++) tag_ctl(i, TAG_DELETE);
+
+    tag_engine_memory(&mem);
+    if(errors != 0 || mem.tags != 0 || mem.levels != 0) {
+        printf("[TEST_FUNC] Fuzz: %ld unexpected results, %llu tags and %llu levels left\n", errors,
+            (unsigned long long) mem.tags, (unsigned long long) mem.levels);
+        return -1;
+    }
+
+    printf("[TEST_FUNC] Fuzz test correct (%ld operations)\n", ops);
+
+
+    // Benchmark: ping-pong round trips and tag_get/tag_ctl churn
+
+    tag = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+    arg = (struct engine_arg){ .tag = tag };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&tid[0], 0, engine_pong, &arg);
+    for(i = 0; i < ENGINE_PINGPONG; i++) {
+        if(engine_send_retry(tag, 0, buffer, sizeof(buffer)) != 1 || tag_receive(tag, 1, buffer, sizeof(buffer), &epoch) != 1) {
+            printf("[TEST_FUNC] Error in ping-pong round %d\n", i);
+            return -1;
+        }
+    }
+    pthread_join(tid[0], 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if(arg.errors != 0 || tag_ctl(tag, TAG_DELETE) != 1) {
+        printf("[TEST_FUNC] Error in ping-pong\n");
+        return -1;
+    }
+    printf("[TEST_FUNC] Ping-pong: %.0f round trips/s\n",
+        ENGINE_PINGPONG / ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < ENGINE_CHURN; i++) {
+        tag = tag_get(IPC_PRIVATE, TAG_CREAT, TAG_PERM_ALL);
+        if(tag < 0 || tag_ctl(tag, TAG_DELETE) != 1) {
+            printf("[TEST_FUNC] Error in churn round %d\n", i);
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[TEST_FUNC] Churn: %.0f tag_get + tag_ctl(DELETE)/s\n",
+        ENGINE_CHURN / ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9));
+
+    tag_engine_exit();
+
+    printf("[TEST_FUNC] Test Tag services executed correctly!\n");
+
+    return 0;
+}
@@ -924,7 +924,7 @@ int test_stress(int tags, int levels, int senders, int receivers, int iterations
     for(i = 0; i < tags; i++) {
         ret_val = tag_ctl(i, TAG_DELETE);
         if(ret_val <= 0) {
-            printf("Error in Deleting Tag %d and level %d (Probably occupied by the read on Char Device)\n", i, j);
+            printf("Error in Deleting Tag %d and level %d (Probably still in use by a system call)\n", i, j);
         }
     }
 
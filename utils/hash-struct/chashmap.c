@@ -0,0 +1,690 @@
+// Concurrent variant of hashmap.c, using the same control byte groups.
+//
+// The map is split in STRIPES independent tables, selected by the top bits
+// of the hash. Each stripe has a lock, taken only by writers, and a seqcount:
+// readers never lock, they copy the item out and retry if a writer touched
+// the stripe in the meantime. A stripe grows on its own, and incrementally:
+// a grow only publishes an empty table twice as large, the items of the old
+// table are then moved a few groups at a time by the writers of the stripe
+// (MIGRATE_SLOTS per set/delete), and lookups search both tables until the
+// old one is empty. The old table is then freed once no reader can still be
+// walking it: after an RCU grace period in the kernel, when the stripe has
+// no reader in userspace (readers are counted per stripe there).
+//
+// Since readers may look at a slot while it's being written, `compare` is
+// always called on a private copy of the item, and must not follow pointers
+// stored in the item.
+
+#ifdef TEST_FUNC
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#else
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/preempt.h>
+#include <linux/compiler.h>
+#include <linux/rcupdate.h>
+#include <asm/barrier.h>
+#endif
+
+
+#include "../include/chashmap.h"
+
+#ifdef TEST_FUNC
+static __always_inline void *alloc(size_t size) { return calloc(1, size); }
+static __always_inline void dealloc(void* obj) { free(obj); }
+#else
+static __always_inline void *alloc(size_t size) { return kzalloc(size, GFP_KERNEL); }
+static __always_inline void dealloc(void* obj) { kfree(obj); }
+#endif
+
+
+#ifdef TEST_FUNC
+
+// Userspace counterparts of the kernel primitives used below
+
+typedef pthread_mutex_t stripe_lock_t;
+#define stripe_lock_init(lock)      pthread_mutex_init(lock, 0)
+#define stripe_lock_destroy(lock)   pthread_mutex_destroy(lock)
+#define stripe_lock(lock)           pthread_mutex_lock(lock)
+#define stripe_unlock(lock)         pthread_mutex_unlock(lock)
+
+#define READ_ONCE(x)                __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define smp_load_acquire(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define cpu_relax()                 __builtin_ia32_pause()
+#define preempt_disable()
+#define preempt_enable()
+
+typedef struct seqcount {
+    unsigned sequence;
+} seqcount_t;
+
+static __always_inline void seqcount_init(seqcount_t *s) {
+    s->sequence = 0;
+}
+
+static __always_inline unsigned read_seqcount_begin(const seqcount_t *s) {
+    unsigned seq;
+    while ((seq = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE)) & 1) {
+        cpu_relax();
+    }
+    return seq;
+}
+
+static __always_inline int read_seqcount_retry(const seqcount_t *s, unsigned start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->sequence, __ATOMIC_RELAXED) != start;
+}
+
+static __always_inline void write_seqcount_begin(seqcount_t *s) {
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static __always_inline void write_seqcount_end(seqcount_t *s) {
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+typedef struct mutex stripe_lock_t;
+#define stripe_lock_init(lock)      mutex_init(lock)
+#define stripe_lock_destroy(lock)   mutex_destroy(lock)
+#define stripe_lock(lock)           mutex_lock(lock)
+#define stripe_unlock(lock)         mutex_unlock(lock)
+
+#endif
+
+
+#include "group.h"
+
+
+#define STRIPE_BITS     4
+#define STRIPES         (1 << STRIPE_BITS)
+
+// Slots of the old table moved by each write while a stripe is migrating. A
+// grow doubles the table, so the migration is over long before the next one
+#define MIGRATE_SLOTS   (4*GROUP_WIDTH)
+
+
+// A table never changes geometry: a grow allocates a new one
+struct table {
+#ifdef TEST_FUNC
+    struct table *next;     // Next retired table
+#else
+    struct rcu_head rcu;    // Frees the table after the readers are gone
+    struct chashmap *map;
+#endif
+    size_t nslots;
+    size_t gmask;
+    uint8_t *ctrl;
+    void *slots;
+};
+
+struct stripe {
+    stripe_lock_t lock;     // Taken by writers only
+    seqcount_t seq;         // Odd while a writer modifies the tables
+    struct table *table;    // Live table, new items go here
+    struct table *old;      // Table being migrated to the live one (or NULL)
+    size_t migrated;        // Slots of the old table already moved
+    size_t count;           // Items in both tables
+    size_t growth_left;     // EMPTY slots of the live table, minus the ones
+                            // reserved for the items still in the old table
+    void *spare;
+#ifdef TEST_FUNC
+    int readers;            // Readers in chashmap_get()
+    struct table *retired;  // Migrated tables waiting for the readers to leave
+#endif
+} __attribute__((aligned(64)));
+
+struct chashmap {
+    void *(*malloc)(size_t);
+    void *(*realloc)(void *, size_t);
+    void (*free)(void *);
+    size_t elsize;
+    size_t slotsz;
+    uint64_t seed0;
+    uint64_t seed1;
+    uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1);
+    int (*compare)(const void *a, const void *b, void *udata);
+    void *udata;
+    struct stripe stripes[STRIPES];
+};
+
+static __always_inline void *slot_at(struct chashmap *map, struct table *table, size_t index) {
+    return ((char*)table->slots)+(map->slotsz*index);
+}
+
+static __always_inline uint64_t get_hash(struct chashmap *map, const void *key) {
+    return map->hash(key, map->seed0, map->seed1);
+}
+
+static __always_inline struct stripe *stripe_of(struct chashmap *map, uint64_t hash) {
+    return &map->stripes[hash >> (64 - STRIPE_BITS)];
+}
+
+// Maximum load factor is 7/8
+static __always_inline size_t max_load(size_t nslots) {
+    return nslots - nslots/8;
+}
+
+// Writers mark the stripe as being modified. In the kernel this runs with
+// preemption disabled, so readers never spin on a writer that got scheduled out
+static __always_inline void write_begin(struct stripe *stripe) {
+    preempt_disable();
+    write_seqcount_begin(&stripe->seq);
+}
+
+static __always_inline void write_end(struct stripe *stripe) {
+    write_seqcount_end(&stripe->seq);
+    preempt_enable();
+}
+
+// A reader may still walk a table after it stopped being reachable from the
+// stripe, so migrated tables are freed only once such readers are gone
+#ifdef TEST_FUNC
+
+static __always_inline void read_enter(struct stripe *stripe) {
+    __atomic_add_fetch(&stripe->readers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static __always_inline void read_exit(struct stripe *stripe) {
+    __atomic_sub_fetch(&stripe->readers, 1, __ATOMIC_RELEASE);
+}
+
+// Frees the retired tables if no reader is in the stripe. A reader entering
+// later can't reach them, since they were unpublished before the check.
+// Stripe lock held.
+static void reclaim(struct chashmap *map, struct stripe *stripe) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&stripe->readers, __ATOMIC_ACQUIRE) != 0) {
+        return;
+    }
+    while (stripe->retired) {
+        struct table *next = stripe->retired->next;
+        map->free(stripe->retired);
+        stripe->retired = next;
+    }
+}
+
+static void retire(struct chashmap *map, struct stripe *stripe, struct table *table) {
+    table->next = stripe->retired;
+    stripe->retired = table;
+    reclaim(map, stripe);
+}
+
+#else
+
+#define read_enter(stripe)  rcu_read_lock()
+#define read_exit(stripe)   rcu_read_unlock()
+#define reclaim(map, stripe)
+
+static void free_table_rcu(struct rcu_head *head) {
+    struct table *table = container_of(head, struct table, rcu);
+    table->map->free(table);
+}
+
+static void retire(struct chashmap *map, struct stripe *stripe, struct table *table) {
+    table->map = map;
+    call_rcu(&table->rcu, free_table_rcu);
+}
+
+#endif
+
+// new_table allocates the table header, the control bytes and the slots in a
+// single block and marks every control byte as EMPTY
+static struct table *new_table(struct chashmap *map, size_t nslots) {
+    size_t hdrsz = (sizeof(struct table) + GROUP_WIDTH-1) & ~(size_t)(GROUP_WIDTH-1);
+    struct table *table = map->malloc(hdrsz + nslots + map->slotsz*nslots);
+    if (!table) {
+        return NULL;
+    }
+    table->nslots = nslots;
+    table->gmask = nslots/GROUP_WIDTH - 1;
+    table->ctrl = ((uint8_t*)table) + hdrsz;
+    table->slots = table->ctrl + nslots;
+    memset(table->ctrl, CTRL_EMPTY, nslots);
+    return table;
+}
+
+// find_in returns the slot of table holding key, or -1 if not present.
+// Only for writers (stripe lock held).
+static size_t find_in(struct chashmap *map, struct table *table,
+                      const void *key, uint64_t hash)
+{
+    uint8_t tag = h2(hash);
+    size_t g = h1(hash) & table->gmask;
+    size_t step = 0;
+    for (;;) {
+        group_t group = group_load(table->ctrl + g*GROUP_WIDTH);
+        uint32_t match = group_match(group, tag);
+        while (match) {
+            size_t i = g*GROUP_WIDTH + __builtin_ctz(match);
+            if (map->compare(key, slot_at(map, table, i), map->udata) == 0) {
+                return i;
+            }
+            match &= match - 1;
+        }
+        if (group_match_empty(group)) {
+            return (size_t)-1;
+        }
+        step++;
+        g = (g + step) & table->gmask;
+    }
+}
+
+// find_free returns the first EMPTY or DELETED slot in the probe sequence
+static size_t find_free(struct table *table, uint64_t hash) {
+    size_t g = h1(hash) & table->gmask;
+    size_t step = 0;
+    for (;;) {
+        uint32_t match = group_match_free(group_load(table->ctrl + g*GROUP_WIDTH));
+        if (match) {
+            return g*GROUP_WIDTH + __builtin_ctz(match);
+        }
+        step++;
+        g = (g + step) & table->gmask;
+    }
+}
+
+// find_index returns the slot holding key, or -1 if not present, setting
+// *table to the table of the slot (the live or the old one).
+// Only for writers (stripe lock held).
+static size_t find_index(struct chashmap *map, struct stripe *stripe,
+                         const void *key, uint64_t hash, struct table **table)
+{
+    *table = stripe->table;
+    size_t i = find_in(map, *table, key, hash);
+    if (i == (size_t)-1 && stripe->old) {
+        *table = stripe->old;
+        i = find_in(map, *table, key, hash);
+    }
+    return i;
+}
+
+// migrate moves up to `nslots` slots of the old table in the live one, and
+// retires the old table once it's empty. The moved slots become tombstones,
+// so probes on the old table stay valid. Stripe lock held.
+static void migrate(struct chashmap *map, struct stripe *stripe, size_t nslots) {
+    struct table *old = stripe->old;
+    struct table *table = stripe->table;
+    size_t end = stripe->migrated + nslots;
+    if (end > old->nslots) {
+        end = old->nslots;
+    }
+    write_begin(stripe);
+    for (; stripe->migrated < end; stripe->migrated++) {
+        size_t i = stripe->migrated;
+        if (!IS_FULL(old->ctrl[i])) {
+            continue;
+        }
+        void *item = slot_at(map, old, i);
+        uint64_t hash = get_hash(map, item);
+        size_t j = find_free(table, hash);
+        memcpy(slot_at(map, table, j), item, map->elsize);
+        table->ctrl[j] = h2(hash);
+        old->ctrl[i] = CTRL_DELETED;
+    }
+    if (stripe->migrated == old->nslots) {
+        smp_store_release(&stripe->old, NULL);
+    }
+    write_end(stripe);
+    if (!stripe->old) {
+        retire(map, stripe, old);
+    }
+}
+
+// grow publishes an empty table twice as large as the live one, which
+// becomes the old table: its items are moved by the next writes (see
+// migrate). The old table of the previous grow must be empty.
+static bool grow(struct chashmap *map, struct stripe *stripe) {
+    struct table *table = new_table(map, stripe->table->nslots*2);
+    if (!table) {
+        return false;
+    }
+    write_begin(stripe);
+    smp_store_release(&stripe->old, stripe->table);
+    smp_store_release(&stripe->table, table);
+    stripe->migrated = 0;
+    write_end(stripe);
+    // Room for the items still to migrate is kept aside
+    stripe->growth_left = max_load(table->nslots) - stripe->count;
+    return true;
+}
+
+// drop_deletes rehashes the live table in place, turning every tombstone
+// back into an EMPTY slot (see drop_deletes in hashmap.c). Must be called
+// inside write_begin/write_end.
+static void drop_deletes(struct chashmap *map, struct stripe *stripe) {
+    struct table *table = stripe->table;
+    size_t i;
+    for (i = 0; i < table->nslots; i++) {
+        table->ctrl[i] = IS_FULL(table->ctrl[i]) ? CTRL_DELETED : CTRL_EMPTY;
+    }
+    for (i = 0; i < table->nslots; i++) {
+        if (table->ctrl[i] != CTRL_DELETED) {
+            continue;
+        }
+        uint64_t hash = get_hash(map, slot_at(map, table, i));
+        size_t j = find_free(table, hash);
+        if (j/GROUP_WIDTH == i/GROUP_WIDTH) {
+            table->ctrl[i] = h2(hash);
+            continue;
+        }
+        if (table->ctrl[j] == CTRL_EMPTY) {
+            memcpy(slot_at(map, table, j), slot_at(map, table, i), map->elsize);
+            table->ctrl[j] = h2(hash);
+            table->ctrl[i] = CTRL_EMPTY;
+            continue;
+        }
+        memcpy(stripe->spare, slot_at(map, table, j), map->elsize);
+        memcpy(slot_at(map, table, j), slot_at(map, table, i), map->elsize);
+        memcpy(slot_at(map, table, i), stripe->spare, map->elsize);
+        table->ctrl[j] = h2(hash);
+        i--;
+    }
+    stripe->growth_left = max_load(table->nslots) - stripe->count;
+}
+
+// write_prepare runs at the start of every write of a stripe: moves the next
+// slots of the old table (if any) and frees what's left to free
+static __always_inline void write_prepare(struct chashmap *map, struct stripe *stripe) {
+    if (stripe->old) {
+        migrate(map, stripe, MIGRATE_SLOTS);
+    }
+    reclaim(map, stripe);
+}
+
+// chashmap_new_with_allocator returns a new concurrent hash map using a
+// custom allocator. Param `cap` is the expected number of items, spread over
+// the stripes. See hashmap_new for more information on the other params.
+struct chashmap *chashmap_new_with_allocator(
+                              void *(*_malloc)(size_t),
+                              void *(*_realloc)(void*, size_t),
+                              void (*_free)(void*),
+                              size_t elsize, size_t cap,
+                              uint64_t seed0, uint64_t seed1,
+                              uint64_t (*hash)(const void *item,
+                                               uint64_t seed0, uint64_t seed1),
+                              int (*compare)(const void *a, const void *b,
+                                             void *udata),
+                              void *udata)
+{
+    _malloc = _malloc ? _malloc : alloc;
+    _free = _free ? _free : dealloc;
+    size_t nslots = GROUP_WIDTH;
+    while (nslots < cap/STRIPES) {
+        nslots *= 2;
+    }
+    size_t slotsz = elsize;
+    while (slotsz & (sizeof(uintptr_t)-1)) {
+        slotsz++;
+    }
+    // chashmap + one spare per stripe
+    struct chashmap *map = _malloc(sizeof(struct chashmap)+slotsz*STRIPES);
+    if (!map) {
+        return NULL;
+    }
+    memset(map, 0, sizeof(struct chashmap));
+    map->malloc = _malloc;
+    map->realloc = _realloc;
+    map->free = _free;
+    map->elsize = elsize;
+    map->slotsz = slotsz;
+    map->seed0 = seed0;
+    map->seed1 = seed1;
+    map->hash = hash;
+    map->compare = compare;
+    map->udata = udata;
+    int i;
+    for (i = 0; i < STRIPES; i++) {
+        struct stripe *stripe = &map->stripes[i];
+        stripe_lock_init(&stripe->lock);
+        seqcount_init(&stripe->seq);
+        stripe->spare = ((char*)map)+sizeof(struct chashmap)+slotsz*i;
+        stripe->table = new_table(map, nslots);
+        if (!stripe->table) {
+            chashmap_free(map);
+            return NULL;
+        }
+        stripe->growth_left = max_load(nslots);
+    }
+    return map;
+}
+
+// chashmap_new returns a new concurrent hash map using the default allocator.
+struct chashmap *chashmap_new(size_t elsize, size_t cap,
+                              uint64_t seed0, uint64_t seed1,
+                              uint64_t (*hash)(const void *item,
+                                               uint64_t seed0, uint64_t seed1),
+                              int (*compare)(const void *a, const void *b,
+                                             void *udata),
+                              void *udata)
+{
+    return chashmap_new_with_allocator(alloc, 0, dealloc,
+        elsize, cap, seed0, seed1, hash, compare, udata
+    );
+}
+
+// chashmap_free frees the map. No other operation may be running.
+void chashmap_free(struct chashmap *map) {
+    if (!map) return;
+    int i;
+#ifndef TEST_FUNC
+    // The tables retired by the last migrations are freed by RCU callbacks
+    rcu_barrier();
+#endif
+    for (i = 0; i < STRIPES; i++) {
+        struct stripe *stripe = &map->stripes[i];
+#ifdef TEST_FUNC
+        struct table *table = stripe->retired;
+        while (table) {
+            struct table *next = table->next;
+            map->free(table);
+            table = next;
+        }
+#endif
+        if (stripe->old) {
+            map->free(stripe->old);
+        }
+        if (stripe->table) {
+            map->free(stripe->table);
+        }
+        stripe_lock_destroy(&stripe->lock);
+    }
+    map->free(map);
+}
+
+// chashmap_count returns the number of items in the map. With concurrent
+// writers the value is only a snapshot.
+size_t chashmap_count(struct chashmap *map) {
+    size_t count = 0;
+    int i;
+    for (i = 0; i < STRIPES; i++) {
+        count += READ_ONCE(map->stripes[i].count);
+    }
+    return count;
+}
+
+// probe copies the item of table matching key in `item` and returns true,
+// or returns false if not found. Reader side: the table may be modified
+// meanwhile, the caller checks the seqcount.
+static bool probe(struct chashmap *map, struct table *table, const void *key,
+                  uint64_t hash, void *item)
+{
+    uint8_t tag = h2(hash);
+    size_t g = h1(hash) & table->gmask;
+    size_t step;
+    // The probe is bounded since a torn read may never see an EMPTY byte
+    for (step = 0; step <= table->gmask; ) {
+        group_t group = group_load(table->ctrl + g*GROUP_WIDTH);
+        uint32_t match = group_match(group, tag);
+        while (match) {
+            size_t i = g*GROUP_WIDTH + __builtin_ctz(match);
+            memcpy(item, slot_at(map, table, i), map->elsize);
+            if (map->compare(key, item, map->udata) == 0) {
+                return true;
+            }
+            match &= match - 1;
+        }
+        if (group_match_empty(group)) {
+            return false;
+        }
+        step++;
+        g = (g + step) & table->gmask;
+    }
+    return false;
+}
+
+// chashmap_get copies the item matching key in `item` and returns true, or
+// returns false if not found (leaving `item` undefined). Lock-free: the
+// lookup is retried if a writer modified the stripe meanwhile. While the
+// stripe is migrating, the old table is searched after the live one.
+// `item` must not overlap `key`.
+bool chashmap_get(struct chashmap *map, const void *key, void *item) {
+    uint64_t hash = get_hash(map, key);
+    struct stripe *stripe = stripe_of(map, hash);
+    bool found;
+    read_enter(stripe);
+    for (;;) {
+        unsigned seq = read_seqcount_begin(&stripe->seq);
+        struct table *table = smp_load_acquire(&stripe->table);
+        struct table *old = smp_load_acquire(&stripe->old);
+        found = probe(map, table, key, hash, item) ||
+                (old && probe(map, old, key, hash, item));
+        if (!read_seqcount_retry(&stripe->seq, seq)) {
+            break;
+        }
+    }
+    read_exit(stripe);
+    return found;
+}
+
+// chashmap_set inserts or replaces an item. Returns 1 if an item has been
+// replaced (copied in `old` if not NULL), 0 if inserted, -1 if the stripe
+// could not grow for lack of memory.
+int chashmap_set(struct chashmap *map, const void *item, void *old) {
+    uint64_t hash = get_hash(map, item);
+    struct stripe *stripe = stripe_of(map, hash);
+
+    stripe_lock(&stripe->lock);
+    write_prepare(map, stripe);
+    struct table *table;
+    size_t i = find_index(map, stripe, item, hash, &table);
+    if (i != (size_t)-1) {
+        if (old) {
+            memcpy(old, slot_at(map, table, i), map->elsize);
+        }
+        write_begin(stripe);
+        memcpy(slot_at(map, table, i), item, map->elsize);
+        write_end(stripe);
+        stripe_unlock(&stripe->lock);
+        return 1;
+    }
+
+    table = stripe->table;
+    i = find_free(table, hash);
+    if (table->ctrl[i] == CTRL_EMPTY && stripe->growth_left == 0) {
+        // Not expected: a migration ends long before the live table fills up
+        while (stripe->old) {
+            migrate(map, stripe, MIGRATE_SLOTS);
+        }
+        if (stripe->count >= max_load(table->nslots)/2) {
+            if (!grow(map, stripe)) {
+                stripe_unlock(&stripe->lock);
+                return -1;
+            }
+        } else {
+            write_begin(stripe);
+            drop_deletes(map, stripe);
+            write_end(stripe);
+        }
+        table = stripe->table;
+        i = find_free(table, hash);
+    }
+
+    write_begin(stripe);
+    if (table->ctrl[i] == CTRL_EMPTY) {
+        stripe->growth_left--;
+    }
+    memcpy(slot_at(map, table, i), item, map->elsize);
+    table->ctrl[i] = h2(hash);
+    stripe->count++;
+    write_end(stripe);
+    stripe_unlock(&stripe->lock);
+    return 0;
+}
+
+// chashmap_delete removes the item matching key. Returns true and copies the
+// removed item in `item` (if not NULL), false if not found.
+bool chashmap_delete(struct chashmap *map, const void *key, void *item) {
+    uint64_t hash = get_hash(map, key);
+    struct stripe *stripe = stripe_of(map, hash);
+
+    stripe_lock(&stripe->lock);
+    write_prepare(map, stripe);
+    struct table *table;
+    size_t i = find_index(map, stripe, key, hash, &table);
+    if (i == (size_t)-1) {
+        stripe_unlock(&stripe->lock);
+        return false;
+    }
+    if (item) {
+        memcpy(item, slot_at(map, table, i), map->elsize);
+    }
+    group_t group = group_load(table->ctrl + (i & ~(size_t)(GROUP_WIDTH-1)));
+    write_begin(stripe);
+    if (table == stripe->old) {
+        // The old table only gets tombstones, it's never inserted into
+        table->ctrl[i] = CTRL_DELETED;
+    } else if (group_match_empty(group)) {
+        table->ctrl[i] = CTRL_EMPTY;
+        stripe->growth_left++;
+    } else {
+        table->ctrl[i] = CTRL_DELETED;
+    }
+    stripe->count--;
+    write_end(stripe);
+    stripe_unlock(&stripe->lock);
+    return true;
+}
+
+// chashmap_scan iterates over all items, one stripe at a time with the
+// stripe locked (so `iter` must not modify the map).
+// Param `iter` can return false to stop iteration early.
+// Returns false if the iteration has been stopped early.
+bool chashmap_scan(struct chashmap *map,
+                   bool (*iter)(const void *item, void *udata), void *udata)
+{
+    int s;
+    for (s = 0; s < STRIPES; s++) {
+        struct stripe *stripe = &map->stripes[s];
+        stripe_lock(&stripe->lock);
+        // The moved slots of the old table are tombstones, so no item is seen twice
+        struct table *tables[2] = { stripe->table, stripe->old };
+        int t;
+        for (t = 0; t < 2 && tables[t]; t++) {
+            struct table *table = tables[t];
+            size_t i;
+            for (i = 0; i < table->nslots; i++) {
+                if (IS_FULL(table->ctrl[i]) && !iter(slot_at(map, table, i), udata)) {
+                    stripe_unlock(&stripe->lock);
+                    return false;
+                }
+            }
+        }
+        stripe_unlock(&stripe->lock);
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+// Control bytes and group matching shared by hashmap.c and chashmap.c
+// (included after the userspace/kernel headers of the including file)
+
+// Every slot has a control byte. Control bytes are grouped by GROUP_WIDTH
+// and a probe compares a whole group against the 7 bit tag (h2) of the hash
+// at once, so the items are touched only on a tag match.
+//      EMPTY   1000 0000   never used since the last rehash
+//      DELETED 1111 1110   tombstone, keeps probe chains intact
+//      FULL    0xxx xxxx   h2 of the item stored in the slot
+#define GROUP_WIDTH     16
+#define CTRL_EMPTY      ((uint8_t) 0x80)
+#define CTRL_DELETED    ((uint8_t) 0xFE)
+
+#define IS_FULL(ctrl)   (((ctrl) & 0x80) == 0)
+
+// h1 selects the first group of the probe sequence, h2 is the control byte tag
+static __always_inline size_t h1(uint64_t hash) { return (size_t)(hash >> 7); }
+static __always_inline uint8_t h2(uint64_t hash) { return (uint8_t)(hash & 0x7f); }
+
+
+// Group matching returns a bitmask with bit i set if the i-th control byte of
+// the group matches. The userspace build uses SSE2, the kernel build (where
+// SIMD registers can't be used without kernel_fpu_begin()) works on two
+// 64 bit words at a time.
+#if defined(TEST_FUNC) && defined(__SSE2__)
+
+#include <emmintrin.h>
+
+typedef __m128i group_t;
+
+static __always_inline group_t group_load(const uint8_t *ctrl) {
+    return _mm_loadu_si128((const __m128i *) ctrl);
+}
+
+static __always_inline uint32_t group_match(group_t group, uint8_t h2) {
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) h2)));
+}
+
+static __always_inline uint32_t group_match_empty(group_t group) {
+    return group_match(group, CTRL_EMPTY);
+}
+
+// EMPTY and DELETED are the only control bytes with the high bit set
+static __always_inline uint32_t group_match_free(group_t group) {
+    return (uint32_t) _mm_movemask_epi8(group);
+}
+
+#else
+
+#define LSBS ((uint64_t) 0x0101010101010101ULL)
+#define MSBS ((uint64_t) 0x8080808080808080ULL)
+
+typedef struct group_struct {
+    uint64_t lo;
+    uint64_t hi;
+} group_t;
+
+static __always_inline group_t group_load(const uint8_t *ctrl) {
+    group_t group;
+    memcpy(&group, ctrl, sizeof(group_t));
+    return group;
+}
+
+// Gather the high bit of each byte of the word in the low 8 bits
+static __always_inline uint32_t word_movemask(uint64_t word) {
+    return (uint32_t) (((word & MSBS) * 0x0002040810204081ULL) >> 56);
+}
+
+// Bytes equal to h2 become zero, then the classic "has zero byte" trick
+// finds them. It can report false positives (never false negatives) which
+// are filtered out by the key compare
+static __always_inline uint64_t word_match(uint64_t word, uint8_t h2) {
+    uint64_t x = word ^ (LSBS * h2);
+    return (x - LSBS) & ~x & MSBS;
+}
+
+// EMPTY is the only control byte with the high bit set and bit 1 clear
+static __always_inline uint64_t word_match_empty(uint64_t word) {
+    return word & ~(word << 6) & MSBS;
+}
+
+static __always_inline uint32_t group_match(group_t group, uint8_t h2) {
+    return word_movemask(word_match(group.lo, h2)) |
+           (word_movemask(word_match(group.hi, h2)) << 8);
+}
+
+static __always_inline uint32_t group_match_empty(group_t group) {
+    return word_movemask(word_match_empty(group.lo)) |
+           (word_movemask(word_match_empty(group.hi)) << 8);
+}
+
+static __always_inline uint32_t group_match_free(group_t group) {
+    return word_movemask(group.lo) | (word_movemask(group.hi) << 8);
+}
+
+#endif
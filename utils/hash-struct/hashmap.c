@@ -2,17 +2,31 @@
 // Use of this source code is governed by an MIT-style
 // license that can be found in the LICENSE file.
 
+#ifdef TEST_FUNC
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#else
 #include <linux/string.h>
 #include <linux/printk.h>
 #include <linux/gfp.h>
 #include <linux/types.h>
 #include <linux/slab.h>
+#endif
 
 
 #include "../include/hashmap.h"
 
+#ifdef TEST_FUNC
+static __always_inline void *alloc(size_t size) { return calloc(1, size); }
+static __always_inline void dealloc(void* obj) { free(obj); }
+#else
 static __always_inline void *alloc(size_t size) { return kzalloc(size, GFP_KERNEL); }
 static __always_inline void dealloc(void* obj) { kfree(obj); }
+#endif
 
 
 static void *(*_malloc)(size_t) = NULL;
@@ -20,16 +34,24 @@ static void *(*_realloc)(void *, size_t) = NULL;
 static void (*_free)(void *) = NULL;
 
 
+#ifdef TEST_FUNC
+#define U64_C(c) UINT64_C(c)
+#define panic(_msg_) { \
+    fprintf(stderr, "panic: %s (%s:%d)\n", (_msg_), __FILE__, __LINE__); \
+    exit(1); \
+}
+#else
 #define panic(_msg_) { \
     printk("Panic Hashmap: %s\n", _msg_); \
 }
+#endif
 
-struct bucket {
-    uint64_t hash:48;
-    uint64_t dib:16;
-};
 
-// hashmap is an open addressed hash map using robinhood hashing.
+#include "group.h"
+
+
+// hashmap is an open addressed hash map using SwissTable-like control bytes
+// probed one group at a time.
 struct hashmap {
     void *(*malloc)(size_t);
     void *(*realloc)(void *, size_t);
@@ -42,114 +64,239 @@ struct hashmap {
     uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1);
     int (*compare)(const void *a, const void *b, void *udata);
     void *udata;
-    size_t bucketsz;
-    size_t nbuckets;
+    int flags;
+    size_t slotsz;
+    size_t nslots;
+    size_t gmask;
     size_t count;
-    size_t mask;
-    size_t growat;
+    size_t growth_left;
+    size_t deleted;
     size_t shrinkat;
-    void *buckets;
+    uint8_t *ctrl;
+    void *slots;
     void *spare;
-    void *edata;
 };
 
-static struct bucket *bucket_at(struct hashmap *map, size_t index) {
-    return (struct bucket*)(((char*)map->buckets)+(map->bucketsz*index));
+static __always_inline void *slot_at(struct hashmap *map, size_t index) {
+    return ((char*)map->slots)+(map->slotsz*index);
 }
 
-static void *bucket_item(struct bucket *entry) {
-    return ((char*)entry)+sizeof(struct bucket);
+static __always_inline uint64_t get_hash(struct hashmap *map, const void *key) {
+    return map->hash(key, map->seed0, map->seed1);
 }
 
-static uint64_t get_hash(struct hashmap *map, const void *key) {
+// Maximum load factor is 7/8
+static __always_inline size_t max_load(size_t nslots) {
+    return nslots - nslots/8;
+}
 
-    return map->hash(key, map->seed0, map->seed1) << 16 >> 16;
+// alloc_slots allocates the control bytes followed by the slots in a single
+// block and marks every control byte as EMPTY
+static bool alloc_slots(struct hashmap *map, size_t nslots) {
+    uint8_t *ctrl = map->malloc(nslots + map->slotsz*nslots);
+    if (!ctrl) {
+        return false;
+    }
+    memset(ctrl, CTRL_EMPTY, nslots);
+    map->ctrl = ctrl;
+    map->slots = ctrl + nslots;
+    map->nslots = nslots;
+    map->gmask = nslots/GROUP_WIDTH - 1;
+    map->growth_left = max_load(nslots);
+    map->deleted = 0;
+    map->shrinkat = nslots/10;
+    return true;
 }
 
-// hashmap_new_with_allocator returns a new hash map using a custom allocator.
-// See hashmap_new for more information information
-struct hashmap *hashmap_new_with_allocator(
-                            void *(*_malloc)(size_t), 
-                            void *(*_realloc)(void*, size_t), 
+// find_index returns the slot holding key, or -1 if not present. Probing
+// visits groups in triangular order, which covers all the groups since their
+// number is a power of two, and stops at the first group with an EMPTY byte.
+static size_t find_index(struct hashmap *map, const void *key, uint64_t hash) {
+    uint8_t tag = h2(hash);
+    size_t g = h1(hash) & map->gmask;
+    size_t step = 0;
+    for (;;) {
+        group_t group = group_load(map->ctrl + g*GROUP_WIDTH);
+        uint32_t match = group_match(group, tag);
+        while (match) {
+            size_t i = g*GROUP_WIDTH + __builtin_ctz(match);
+            if (map->compare(key, slot_at(map, i), map->udata) == 0) {
+                return i;
+            }
+            match &= match - 1;
+        }
+        if (group_match_empty(group)) {
+            return (size_t)-1;
+        }
+        step++;
+        g = (g + step) & map->gmask;
+    }
+}
+
+// find_free returns the first EMPTY or DELETED slot in the probe sequence
+static size_t find_free(struct hashmap *map, uint64_t hash) {
+    size_t g = h1(hash) & map->gmask;
+    size_t step = 0;
+    for (;;) {
+        uint32_t match = group_match_free(group_load(map->ctrl + g*GROUP_WIDTH));
+        if (match) {
+            return g*GROUP_WIDTH + __builtin_ctz(match);
+        }
+        step++;
+        g = (g + step) & map->gmask;
+    }
+}
+
+// drop_deletes rehashes the map in place, turning every tombstone back into
+// an EMPTY slot without allocating. FULL slots are first marked DELETED and
+// then moved, one at a time, to the first free slot of their probe sequence
+// (swapping through the spare slot when that one still has to be placed).
+static void drop_deletes(struct hashmap *map) {
+    size_t i;
+    for (i = 0; i < map->nslots; i++) {
+        map->ctrl[i] = IS_FULL(map->ctrl[i]) ? CTRL_DELETED : CTRL_EMPTY;
+    }
+    for (i = 0; i < map->nslots; i++) {
+        if (map->ctrl[i] != CTRL_DELETED) {
+            continue;
+        }
+        uint64_t hash = get_hash(map, slot_at(map, i));
+        size_t j = find_free(map, hash);
+        if (j/GROUP_WIDTH == i/GROUP_WIDTH) {
+            // Already in the first free group of its probe sequence
+            map->ctrl[i] = h2(hash);
+            continue;
+        }
+        if (map->ctrl[j] == CTRL_EMPTY) {
+            memcpy(slot_at(map, j), slot_at(map, i), map->elsize);
+            map->ctrl[j] = h2(hash);
+            map->ctrl[i] = CTRL_EMPTY;
+            continue;
+        }
+        // j holds an item still to be placed: swap and reprocess slot i
+        memcpy(map->spare, slot_at(map, j), map->elsize);
+        memcpy(slot_at(map, j), slot_at(map, i), map->elsize);
+        memcpy(slot_at(map, i), map->spare, map->elsize);
+        map->ctrl[j] = h2(hash);
+        i--;
+    }
+    map->growth_left = max_load(map->nslots) - map->count;
+    map->deleted = 0;
+}
+
+// hashmap_new_with_flags returns a new hash map using a custom allocator and
+// the creation flags in `flags`.
+// With HASHMAP_FIXED_CAP the param `cap` is the maximum number of items the
+// map will ever hold: all the memory is allocated here for a 50% load and
+// the map never grows nor shrinks, so hashmap_set and hashmap_delete never
+// allocate. hashmap_set fails (returning NULL with hashmap_oom() true) once
+// `cap` items are stored.
+// See hashmap_new for more information on the other params.
+struct hashmap *hashmap_new_with_flags(
+                            void *(*_malloc)(size_t),
+                            void *(*_realloc)(void*, size_t),
                             void (*_free)(void*),
-                            size_t elsize, size_t cap, 
+                            size_t elsize, size_t cap,
                             uint64_t seed0, uint64_t seed1,
-                            uint64_t (*hash)(const void *item, 
+                            uint64_t (*hash)(const void *item,
                                              uint64_t seed0, uint64_t seed1),
-                            int (*compare)(const void *a, const void *b, 
+                            int (*compare)(const void *a, const void *b,
                                            void *udata),
-                            void *udata)
+                            void *udata, int flags)
 {
     _malloc = _malloc ? _malloc : alloc;
     _realloc = _realloc ? _realloc : 0;
     _free = _free ? _free : dealloc;
-    int ncap = 16;
-    if (cap < ncap) {
-        cap = ncap;
+    size_t nslots = cap;
+    if (flags & HASHMAP_FIXED_CAP) {
+        if (cap == 0) {
+            return NULL;
+        }
+        nslots = cap*2;
+    }
+    size_t ncap = GROUP_WIDTH;
+    if (nslots < ncap) {
+        nslots = ncap;
     } else {
-        while (ncap < cap) {
+        while (ncap < nslots) {
             ncap *= 2;
         }
-        cap = ncap;
+        nslots = ncap;
     }
-    size_t bucketsz = sizeof(struct bucket) + elsize;
-    while (bucketsz & (sizeof(uintptr_t)-1)) {
-        bucketsz++;
+    if (!(flags & HASHMAP_FIXED_CAP)) {
+        cap = nslots;
     }
-    // hashmap + spare + edata
-    size_t size = sizeof(struct hashmap)+bucketsz*2;
+    size_t slotsz = elsize;
+    while (slotsz & (sizeof(uintptr_t)-1)) {
+        slotsz++;
+    }
+    // hashmap + spare
+    size_t size = sizeof(struct hashmap)+slotsz;
     struct hashmap *map = _malloc(size);
     if (!map) {
         return NULL;
     }
     memset(map, 0, sizeof(struct hashmap));
     map->elsize = elsize;
-    map->bucketsz = bucketsz;
+    map->slotsz = slotsz;
     map->seed0 = seed0;
     map->seed1 = seed1;
     map->hash = hash;
     map->compare = compare;
     map->udata = udata;
+    map->flags = flags;
     map->spare = ((char*)map)+sizeof(struct hashmap);
-    map->edata = (char*)map->spare+bucketsz;
     map->cap = cap;
-    map->nbuckets = cap;
-    map->mask = map->nbuckets-1;
-    map->buckets = _malloc(map->bucketsz*map->nbuckets);
-    if (!map->buckets) {
-        _free(map);
-        return NULL;
-    }
-    memset(map->buckets, 0, map->bucketsz*map->nbuckets);
-    map->growat = map->nbuckets*3/4;
-    map->shrinkat = map->nbuckets/10;
     map->malloc = _malloc;
     map->realloc = _realloc;
     map->free = _free;
-    return map;  
+    if (!alloc_slots(map, nslots)) {
+        _free(map);
+        return NULL;
+    }
+    return map;
+}
+
+// hashmap_new_with_allocator returns a new hash map using a custom allocator.
+// See hashmap_new for more information information
+struct hashmap *hashmap_new_with_allocator(
+                            void *(*_malloc)(size_t),
+                            void *(*_realloc)(void*, size_t),
+                            void (*_free)(void*),
+                            size_t elsize, size_t cap,
+                            uint64_t seed0, uint64_t seed1,
+                            uint64_t (*hash)(const void *item,
+                                             uint64_t seed0, uint64_t seed1),
+                            int (*compare)(const void *a, const void *b,
+                                           void *udata),
+                            void *udata)
+{
+    return hashmap_new_with_flags(_malloc, _realloc, _free,
+        elsize, cap, seed0, seed1, hash, compare, udata, 0
+    );
 }
 
 
-// hashmap_new returns a new hash map. 
+// hashmap_new returns a new hash map.
 // Param `elsize` is the size of each element in the tree. Every element that
 // is inserted, deleted, or retrieved will be this size.
 // Param `cap` is the default lower capacity of the hashmap. Setting this to
 // zero will default to 16.
-// Params `seed0` and `seed1` are optional seed values that are passed to the 
-// following `hash` function. These can be any value you wish but it's often 
+// Params `seed0` and `seed1` are optional seed values that are passed to the
+// following `hash` function. These can be any value you wish but it's often
 // best to use randomly generated values.
 // Param `hash` is a function that generates a hash value for an item. It's
 // important that you provide a good hash function, otherwise it will perform
 // poorly or be vulnerable to Denial-of-service attacks. This implementation
 // comes with two helper functions `hashmap_sip()` and `hashmap_murmur()`.
-// Param `compare` is a function that compares items in the tree. See the 
+// Param `compare` is a function that compares items in the tree. See the
 // qsort stdlib function for an example of how this function works.
-// The hashmap must be freed with hashmap_free(). 
-struct hashmap *hashmap_new(size_t elsize, size_t cap, 
+// The hashmap must be freed with hashmap_free().
+struct hashmap *hashmap_new(size_t elsize, size_t cap,
                             uint64_t seed0, uint64_t seed1,
-                            uint64_t (*hash)(const void *item, 
+                            uint64_t (*hash)(const void *item,
                                              uint64_t seed0, uint64_t seed1),
-                            int (*compare)(const void *a, const void *b, 
+                            int (*compare)(const void *a, const void *b,
                                            void *udata),
                             void *udata)
 {
@@ -161,66 +308,51 @@ struct hashmap *hashmap_new(size_t elsize, size_t cap,
     );
 }
 
-// hashmap_clear quickly clears the map. 
+// hashmap_clear quickly clears the map.
 // When the update_cap is provided, the map's capacity will be updated to match
 // the currently number of allocated buckets. This is an optimization to ensure
 // that this operation does not perform any allocations.
 void hashmap_clear(struct hashmap *map, bool update_cap) {
     map->count = 0;
-    if (update_cap) {
-        map->cap = map->nbuckets;
-    } else if (map->nbuckets != map->cap) {
-        void *new_buckets = map->malloc(map->bucketsz*map->cap);
-        if (new_buckets) {
-            map->free(map->buckets);
-            map->buckets = new_buckets;
+    if (map->flags & HASHMAP_FIXED_CAP) {
+        // never reallocate a fixed capacity map
+    } else if (update_cap) {
+        map->cap = map->nslots;
+    } else if (map->nslots != map->cap) {
+        uint8_t *old_ctrl = map->ctrl;
+        if (alloc_slots(map, map->cap)) {
+            map->free(old_ctrl);
+            return;
         }
-        map->nbuckets = map->cap;
     }
-    memset(map->buckets, 0, map->bucketsz*map->nbuckets);
-    map->mask = map->nbuckets-1;
-    map->growat = map->nbuckets*3/4;
-    map->shrinkat = map->nbuckets/10;
+    memset(map->ctrl, CTRL_EMPTY, map->nslots);
+    map->growth_left = max_load(map->nslots);
+    map->deleted = 0;
+    map->shrinkat = map->nslots/10;
 }
 
 
+// resize moves every item into a new slot array of new_cap slots.
 static bool resize(struct hashmap *map, size_t new_cap) {
-    struct hashmap *map2 = hashmap_new_with_allocator(alloc, 0, dealloc, map->elsize, new_cap, map->seed1, 
-                                       map->seed1, map->hash, map->compare,
-                                       map->udata);
-    if (!map2) {
+    uint8_t *old_ctrl = map->ctrl;
+    void *old_slots = map->slots;
+    size_t old_nslots = map->nslots;
+    if (!alloc_slots(map, new_cap)) {
         return false;
     }
     size_t i;
-    for (i = 0; i < map->nbuckets; i++) {
-        struct bucket *entry = bucket_at(map, i);
-        if (!entry->dib) {
+    for (i = 0; i < old_nslots; i++) {
+        if (!IS_FULL(old_ctrl[i])) {
             continue;
         }
-        entry->dib = 1;
-        size_t j = entry->hash & map2->mask;
-        for (;;) {
-            struct bucket *bucket = bucket_at(map2, j);
-            if (bucket->dib == 0) {
-                memcpy(bucket, entry, map->bucketsz);
-                break;
-            }
-            if (bucket->dib < entry->dib) {
-                memcpy(map2->spare, bucket, map->bucketsz);
-                memcpy(bucket, entry, map->bucketsz);
-                memcpy(entry, map2->spare, map->bucketsz);
-            }
-            j = (j + 1) & map2->mask;
-            entry->dib += 1;
-        }
-	}
-    map->free(map->buckets);
-    map->buckets = map2->buckets;
-    map->nbuckets = map2->nbuckets;
-    map->mask = map2->mask;
-    map->growat = map2->growat;
-    map->shrinkat = map2->shrinkat;
-    map->free(map2);
+        void *item = ((char*)old_slots)+(map->slotsz*i);
+        uint64_t hash = get_hash(map, item);
+        size_t j = find_free(map, hash);
+        map->ctrl[j] = h2(hash);
+        memcpy(slot_at(map, j), item, map->elsize);
+    }
+    map->growth_left -= map->count;
+    map->free(old_ctrl);
     return true;
 }
 
@@ -233,45 +365,41 @@ void *hashmap_set(struct hashmap *map, void *item) {
         panic("item is null");
     }
     map->oom = false;
-    if (map->count == map->growat) {
-        if (!resize(map, map->nbuckets*2)) {
+
+    uint64_t hash = get_hash(map, item);
+    size_t i = find_index(map, item, hash);
+    if (i != (size_t)-1) {
+        memcpy(map->spare, slot_at(map, i), map->elsize);
+        memcpy(slot_at(map, i), item, map->elsize);
+        return map->spare;
+    }
+
+    if ((map->flags & HASHMAP_FIXED_CAP) && map->count >= map->cap) {
+        map->oom = true;
+        return NULL;
+    }
+
+    i = find_free(map, hash);
+    if (map->ctrl[i] == CTRL_EMPTY && map->growth_left == 0) {
+        // Out of EMPTY slots. hashmap_delete keeps the tombstones under
+        // nslots/16, so the map is really full and has to grow. A fixed
+        // capacity map is at most half full and never gets here
+        if (!resize(map, map->nslots*2)) {
             map->oom = true;
             return NULL;
         }
+        i = find_free(map, hash);
     }
 
-    struct bucket *entry = map->edata;
-
-    entry->hash = get_hash(map, item);
-
-    entry->dib = 1;
-
-    memcpy(bucket_item(entry), item, map->elsize);
-    
-    size_t i = entry->hash & map->mask;
-	for (;;) {
-        struct bucket *bucket = bucket_at(map, i);
-        if (bucket->dib == 0) {
-            memcpy(bucket, entry, map->bucketsz);
-            map->count++;
-			return NULL;
-		}
-        if (entry->hash == bucket->hash && 
-            map->compare(bucket_item(entry), bucket_item(bucket), 
-                         map->udata) == 0)
-        {
-            memcpy(map->spare, bucket_item(bucket), map->elsize);
-            memcpy(bucket_item(bucket), bucket_item(entry), map->elsize);
-            return map->spare;
-		}
-        if (bucket->dib < entry->dib) {
-            memcpy(map->spare, bucket, map->bucketsz);
-            memcpy(bucket, entry, map->bucketsz);
-            memcpy(entry, map->spare, map->bucketsz);
-		}
-		i = (i + 1) & map->mask;
-        entry->dib += 1;
-	}
+    if (map->ctrl[i] == CTRL_EMPTY) {
+        map->growth_left--;
+    } else {
+        map->deleted--;
+    }
+    map->ctrl[i] = h2(hash);
+    memcpy(slot_at(map, i), item, map->elsize);
+    map->count++;
+    return NULL;
 }
 
 // hashmap_get returns the item based on the provided key. If the item is not
@@ -280,32 +408,22 @@ void *hashmap_get(struct hashmap *map, const void *key) {
     if (!key) {
         panic("key is null");
     }
-    uint64_t hash = get_hash(map, key);
-	size_t i = hash & map->mask;
-	for (;;) {
-        struct bucket *bucket = bucket_at(map, i);
-		if (!bucket->dib) {
-			return NULL;
-		}
-		if (bucket->hash == hash && 
-            map->compare(key, bucket_item(bucket), map->udata) == 0)
-        {
-            return bucket_item(bucket);
-		}
-		i = (i + 1) & map->mask;
-	}
+    size_t i = find_index(map, key, get_hash(map, key));
+    if (i == (size_t)-1) {
+        return NULL;
+    }
+    return slot_at(map, i);
 }
 
 // hashmap_probe returns the item in the bucket at position or NULL if an item
-// is not set for that bucket. The position is 'moduloed' by the number of 
+// is not set for that bucket. The position is 'moduloed' by the number of
 // buckets in the hashmap.
 void *hashmap_probe(struct hashmap *map, uint64_t position) {
-    size_t i = position & map->mask;
-    struct bucket *bucket = bucket_at(map, i);
-    if (!bucket->dib) {
+    size_t i = position & (map->nslots-1);
+    if (!IS_FULL(map->ctrl[i])) {
 		return NULL;
 	}
-    return bucket_item(bucket);
+    return slot_at(map, i);
 }
 
 
@@ -316,40 +434,38 @@ void *hashmap_delete(struct hashmap *map, void *key) {
         panic("key is null");
     }
     map->oom = false;
-    uint64_t hash = get_hash(map, key);
-	size_t i = hash & map->mask;
-	for (;;) {
-        struct bucket *bucket = bucket_at(map, i);
-		if (!bucket->dib) {
-			return NULL;
-		}
-		if (bucket->hash == hash && 
-            map->compare(key, bucket_item(bucket), map->udata) == 0)
-        {
-            memcpy(map->spare, bucket_item(bucket), map->elsize);
-            bucket->dib = 0;
-            for (;;) {
-                struct bucket *prev = bucket;
-                i = (i + 1) & map->mask;
-                bucket = bucket_at(map, i);
-                if (bucket->dib <= 1) {
-                    prev->dib = 0;
-                    break;
-                }
-                memcpy(prev, bucket, map->bucketsz);
-                prev->dib--;
-            }
-            map->count--;
-            if (map->nbuckets > map->cap && map->count <= map->shrinkat) {
-                // Ignore the return value. It's ok for the resize operation to
-                // fail to allocate enough memory because a shrink operation
-                // does not change the integrity of the data.
-                resize(map, map->nbuckets/2);
-            }
-			return map->spare;
-		}
-		i = (i + 1) & map->mask;
-	}
+    size_t i = find_index(map, key, get_hash(map, key));
+    if (i == (size_t)-1) {
+        return NULL;
+    }
+    memcpy(map->spare, slot_at(map, i), map->elsize);
+
+    // A group that still has an EMPTY byte has never been full, so no probe
+    // sequence went past it and the slot can go back to EMPTY. Otherwise a
+    // tombstone is needed to keep the longer probe chains reachable.
+    group_t group = group_load(map->ctrl + (i & ~(size_t)(GROUP_WIDTH-1)));
+    if (group_match_empty(group)) {
+        map->ctrl[i] = CTRL_EMPTY;
+        map->growth_left++;
+    } else {
+        map->ctrl[i] = CTRL_DELETED;
+        map->deleted++;
+    }
+    map->count--;
+    if (!(map->flags & HASHMAP_FIXED_CAP) &&
+        map->nslots > map->cap && map->count <= map->shrinkat) {
+        // Ignore the return value. It's ok for the resize operation to
+        // fail to allocate enough memory because a shrink operation
+        // does not change the integrity of the data.
+        resize(map, map->nslots/2);
+    }
+    if (map->deleted > map->nslots/16) {
+        // Drop the tombstones in place once they are too many, so the
+        // O(nslots) rehash is paid once every nslots/16 deletes and
+        // hashmap_set never has to do it
+        drop_deletes(map);
+    }
+    return map->spare;
 }
 
 // hashmap_count returns the number of items in the hash map.
@@ -360,11 +476,11 @@ size_t hashmap_count(struct hashmap *map) {
 // hashmap_free frees the hash map
 void hashmap_free(struct hashmap *map) {
     if (!map) return;
-    map->free(map->buckets);
+    map->free(map->ctrl);
     map->free(map);
 }
 
-// hashmap_oom returns true if the last hashmap_set() call failed due to the 
+// hashmap_oom returns true if the last hashmap_set() call failed due to the
 // system being out of memory.
 bool hashmap_oom(struct hashmap *map) {
     return map->oom;
@@ -373,14 +489,13 @@ bool hashmap_oom(struct hashmap *map) {
 // hashmap_scan iterates over all items in the hash map
 // Param `iter` can return false to stop iteration early.
 // Returns false if the iteration has been stopped early.
-bool hashmap_scan(struct hashmap *map, 
+bool hashmap_scan(struct hashmap *map,
                   bool (*iter)(const void *item, void *udata), void *udata)
-{   
+{
     size_t i;
-    for (i = 0; i < map->nbuckets; i++) {
-        struct bucket *bucket = bucket_at(map, i);
-        if (bucket->dib) {
-            if (!iter(bucket_item(bucket), udata)) {
+    for (i = 0; i < map->nslots; i++) {
+        if (IS_FULL(map->ctrl[i])) {
+            if (!iter(slot_at(map, i), udata)) {
                 return false;
             }
         }
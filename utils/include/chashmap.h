@@ -0,0 +1,37 @@
+#ifdef TEST_FUNC
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+// Concurrent variant of hashmap: readers never lock, writers only lock the
+// stripe the key hashes to. Items are copied in and out of the map since a
+// pointer to a slot could be reused by a concurrent writer.
+struct chashmap;
+typedef struct chashmap chashmap_t;
+
+struct chashmap *chashmap_new(size_t elsize, size_t cap,
+                              uint64_t seed0, uint64_t seed1,
+                              uint64_t (*hash)(const void *item,
+                                               uint64_t seed0, uint64_t seed1),
+                              int (*compare)(const void *a, const void *b,
+                                             void *udata),
+                              void *udata);
+struct chashmap *chashmap_new_with_allocator(
+                              void *(*malloc)(size_t),
+                              void *(*realloc)(void *, size_t),
+                              void (*free)(void*),
+                              size_t elsize, size_t cap,
+                              uint64_t seed0, uint64_t seed1,
+                              uint64_t (*hash)(const void *item,
+                                               uint64_t seed0, uint64_t seed1),
+                              int (*compare)(const void *a, const void *b,
+                                             void *udata),
+                              void *udata);
+void chashmap_free(struct chashmap *map);
+size_t chashmap_count(struct chashmap *map);
+bool chashmap_get(struct chashmap *map, const void *key, void *item);
+int chashmap_set(struct chashmap *map, const void *item, void *old);
+bool chashmap_delete(struct chashmap *map, const void *key, void *item);
+bool chashmap_scan(struct chashmap *map,
+                   bool (*iter)(const void *item, void *udata), void *udata);
@@ -1,6 +1,15 @@
+#ifdef TEST_FUNC
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
 struct hashmap;
 typedef struct hashmap hashmap_t;
 
+// Creation flags for hashmap_new_with_flags()
+#define HASHMAP_FIXED_CAP   0x1     // Preallocate for `cap` items, never resize
+
 struct hashmap *hashmap_new(size_t elsize, size_t cap, 
                             uint64_t seed0, uint64_t seed1,
                             uint64_t (*hash)(const void *item, 
@@ -19,6 +28,17 @@ struct hashmap *hashmap_new_with_allocator(
                             int (*compare)(const void *a, const void *b, 
                                            void *udata),
                             void *udata);
+struct hashmap *hashmap_new_with_flags(
+                            void *(*malloc)(size_t), 
+                            void *(*realloc)(void *, size_t), 
+                            void (*free)(void*),
+                            size_t elsize, size_t cap, 
+                            uint64_t seed0, uint64_t seed1,
+                            uint64_t (*hash)(const void *item, 
+                                             uint64_t seed0, uint64_t seed1),
+                            int (*compare)(const void *a, const void *b, 
+                                           void *udata),
+                            void *udata, int flags);
 void hashmap_free(struct hashmap *map);
 void hashmap_clear(struct hashmap *map, bool update_cap);
 size_t hashmap_count(struct hashmap *map);
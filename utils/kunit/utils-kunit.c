@@ -0,0 +1,490 @@
+/**
+ *  @file   utils-kunit.c
+ *  @brief  KUnit performance suite of the Bitmask and the Hashmap used by the modules, built as a separate test module
+ *          (UTILSPERF.ko, needs CONFIG_KUNIT). Every test case is a cell of a parameter table:
+ *              - bitmask : get_avail_number() and clear_number() at various fill levels, with the set bits packed at the
+ *                          start of the mask (as the Tag descriptors are assigned) or scattered
+ *              - hashmap : get (hit and miss), set (replace), delete and insert at various load factors and key distributions.
+ *                          The map is fixed capacity, so the load factor is at most 50% (see hashmap_new_with_flags)
+ *          The concurrent Hashmap (chashmap) has functional cases instead, since its kernel code (seqcount readers, RCU
+ *          freeing of the migrated tables) is built only here: a single threaded one, and one with a reader thread
+ *          per online CPU (up to CHASHMAP_READERS) doing lookups while the test grows and shrinks the map
+ *          Each operation is timed on its own (rdtsc, preemption disabled) for "trials" trials of "ops" operations, and
+ *          reported as a single line in the KTAP output:
+ *              # <case>: PERF suite=... op=... <params> trials=... ops=... p50=... p90=... p99=... p999=... max=...
+ *                        trial_mean_min=... trial_mean_max=... unit=cycles
+ *          so that the results can be read with "dmesg | grep PERF" or from /sys/kernel/debug/kunit/utils-perf/results
+ *  @author Andrea Paci
+ */
+
+
+#include <kunit/test.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/preempt.h>
+#include <linux/version.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+
+#include "../include/bitmask.h"
+#include "../include/hashmap.h"
+#include "../include/chashmap.h"
+#include "../include/common.h"
+
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Andrea Paci <andrea.paci1998@gmail.com");
+MODULE_DESCRIPTION("KUnit performance suite of the Bitmask and the Hashmap, functional tests of the concurrent Hashmap");
+
+
+#define SEED0 401861
+#define SEED1 879023
+
+#define HASHMAP_SLOTS   4096        // Slots of the maps under test (capacity HASHMAP_SLOTS / 2)
+
+static unsigned int trials = 5;
+module_param(trials, uint, S_IRUGO);
+MODULE_PARM_DESC(trials, "Trials of every test case");
+
+static unsigned int ops = 10000;
+module_param(ops, uint, S_IRUGO);
+MODULE_PARM_DESC(ops, "Operations timed in each trial");
+
+
+
+// ---------------- Measures ----------------
+
+typedef struct perf_samples {
+    u64* cycles;
+    u64* trial_sum;
+    size_t count;
+} perf_samples_t;
+
+static int cmp_u64(const void* a, const void* b) {
+    u64 x = *(const u64*) a, y = *(const u64*) b;
+    return x < y ? -1 : x > y;
+}
+
+static void perf_init(struct kunit* test, perf_samples_t* perf) {
+    perf -> cycles = kunit_kmalloc_array(test, (size_t) trials * ops, sizeof(u64), GFP_KERNEL);
+    perf -> trial_sum = kunit_kzalloc(test, sizeof(u64) * trials, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, perf -> cycles);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, perf -> trial_sum);
+    perf -> count = 0;
+}
+
+static __always_inline void perf_add(perf_samples_t* perf, unsigned int trial, u64 cycles) {
+    perf -> cycles[perf -> count++] = cycles;
+    perf -> trial_sum[trial] += cycles;
+}
+
+static u64 percentile(u64* sorted, size_t count, unsigned int per_mille) {
+    if(count == 0) return 0;
+    return sorted[(count - 1) * per_mille / 1000];
+}
+
+static void perf_report(struct kunit* test, const char* suite, const char* op, const char* params, perf_samples_t* perf) {
+
+    u64 mean, mean_min, mean_max;
+    unsigned int i;
+
+    mean_min = U64_MAX;
+    mean_max = 0;
+    for(i = 0; i < trials; i++) {
+        mean = perf -> trial_sum[i] / ops;
+        mean_min = min(mean_min, mean);
+        mean_max = max(mean_max, mean);
+    }
+
+    sort(perf -> cycles, perf -> count, sizeof(u64), cmp_u64, NULL);
+
+    kunit_info(test, "PERF suite=%s op=%s %s trials=%u ops=%u p50=%llu p90=%llu p99=%llu p999=%llu max=%llu "
+                     "trial_mean_min=%llu trial_mean_max=%llu unit=cycles\n",
+        suite, op, params, trials, ops,
+        percentile(perf -> cycles, perf -> count, 500), percentile(perf -> cycles, perf -> count, 900),
+        percentile(perf -> cycles, perf -> count, 990), percentile(perf -> cycles, perf -> count, 999),
+        perf -> cycles[perf -> count - 1], mean_min, mean_max);
+}
+
+// Reproducible pseudo random numbers
+static __always_inline u64 xorshift64(u64* state) {
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+
+
+// ---------------- Bitmask ----------------
+
+typedef struct bitmask_param {
+    int bits;
+    int fill;           // Percentage of bits set
+    bool scattered;     // Set bits spread over the whole mask instead of packed at the start
+} bitmask_param_t;
+
+static const bitmask_param_t bitmask_params[] = {
+    { 256,  0,  false }, { 256,  50, false }, { 256,  90, false }, { 256,  99, false },
+    { 256,  50, true  }, { 256,  90, true  }, { 256,  99, true  },
+    { 4096, 0,  false }, { 4096, 50, false }, { 4096, 90, false }, { 4096, 99, false },
+    { 4096, 50, true  }, { 4096, 90, true  }, { 4096, 99, true  },
+};
+
+static void bitmask_param_desc(const bitmask_param_t* param, char* desc) {
+    snprintf(desc, KUNIT_PARAM_DESC_SIZE, "bits=%d fill=%d pattern=%s",
+        param -> bits, param -> fill, param -> scattered ? "scattered" : "packed");
+}
+
+KUNIT_ARRAY_PARAM(bitmask, bitmask_params, bitmask_param_desc);
+
+static void bitmask_perf_test(struct kunit* test) {
+
+    const bitmask_param_t* param = test -> param_value;
+    perf_samples_t get, clear;
+    char desc[KUNIT_PARAM_DESC_SIZE];
+    bitmask_t* mask;
+    u64 state, start, mid;
+    unsigned int trial, i;
+    int number = 0, n = 1, set;
+
+    mask = initialize_bitmask(param -> bits);
+    KUNIT_ASSERT_NOT_NULL(test, mask);
+
+    // Packed: the lowest "fill" numbers. Scattered: every number, then clear a random (100 - fill)%
+    set = param -> bits * param -> fill / 100;
+    if(set == param -> bits) set--;
+    if(!param -> scattered) {
+        for(n = 0; n < set; n++) KUNIT_ASSERT_EQ(test, get_avail_number(mask), n);
+    }
+    else {
+        for(n = 0; n < param -> bits; n++) KUNIT_ASSERT_EQ(test, get_avail_number(mask), n);
+        state = 0x9e3779b97f4a7c15ULL;
+        for(n = param -> bits; n > set; ) {
+            number = xorshift64(&state) % param -> bits;
+            if(clear_number(mask, number) == 1) n--;
+        }
+    }
+
+    perf_init(test, &get);
+    perf_init(test, &clear);
+
+    // A get followed by the clear of the same number keeps the fill level constant
+    for(trial = 0; trial < trials; trial++) {
+        preempt_disable();
+        for(i = 0; i < ops; i++) {
+            start = rdtsc_fenced();
+            number = get_avail_number(mask);
+            mid = rdtsc_fenced();
+            n = clear_number(mask, number);
+            perf_add(&clear, trial, rdtsc_fenced() - mid);
+            perf_add(&get, trial, mid - start);
+            if(unlikely(number < 0 || n != 1)) break;
+        }
+        preempt_enable();
+        KUNIT_ASSERT_GE(test, number, 0);
+        KUNIT_ASSERT_EQ(test, n, 1);
+    }
+
+    bitmask_param_desc(param, desc);
+    perf_report(test, "bitmask", "get_avail_number", desc, &get);
+    perf_report(test, "bitmask", "clear_number", desc, &clear);
+
+    free_bitmask(mask);
+}
+
+
+
+// ---------------- Hashmap ----------------
+
+#define DIST_SEQUENTIAL 0       // 0, 1, 2, ...
+#define DIST_STRIDED    1       // Multiples of 4096 (same low bits)
+#define DIST_RANDOM     2       // Random (distinct) keys
+
+static const char* dist_names[] = { "sequential", "strided", "random" };
+
+typedef struct hashmap_param {
+    int load;           // Percentage of the slots used (at most 50)
+    int dist;
+} hashmap_param_t;
+
+static const hashmap_param_t hashmap_params[] = {
+    { 10, DIST_SEQUENTIAL }, { 25, DIST_SEQUENTIAL }, { 40, DIST_SEQUENTIAL }, { 50, DIST_SEQUENTIAL },
+    { 10, DIST_STRIDED },    { 25, DIST_STRIDED },    { 40, DIST_STRIDED },    { 50, DIST_STRIDED },
+    { 10, DIST_RANDOM },     { 25, DIST_RANDOM },     { 40, DIST_RANDOM },     { 50, DIST_RANDOM },
+};
+
+static void hashmap_param_desc(const hashmap_param_t* param, char* desc) {
+    snprintf(desc, KUNIT_PARAM_DESC_SIZE, "load=%d keys=%s", param -> load, dist_names[param -> dist]);
+}
+
+KUNIT_ARRAY_PARAM(hashmap, hashmap_params, hashmap_param_desc);
+
+typedef struct perf_entry {
+    int key;
+    int value;
+} perf_entry_t;
+
+static int perf_compare(const void* a, const void* b, void* udata) {
+    return ((perf_entry_t *) a) -> key != ((perf_entry_t *) b) -> key;
+}
+
+static uint64_t perf_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+    const perf_entry_t* entry = item;
+    return hashmap_sip(&(entry -> key), sizeof(int), seed0, seed1);
+}
+
+// i-th key of the distribution (the multiplication by an odd constant is a bijection, so random keys are distinct)
+static __always_inline int key_of(int dist, u32 i) {
+    if(dist == DIST_STRIDED) return (int) (i << 12);
+    if(dist == DIST_RANDOM) return (int) (i * 2654435761U);
+    return (int) i;
+}
+
+static void hashmap_perf_test(struct kunit* test) {
+
+    const hashmap_param_t* param = test -> param_value;
+    perf_samples_t get_hit, get_miss, replace, del, insert;
+    char desc[KUNIT_PARAM_DESC_SIZE];
+    struct hashmap* map;
+    perf_entry_t entry;
+    void* found;
+    u64 state, start;
+    unsigned int trial, i;
+    int items, n, errors;
+
+    map = hashmap_new_with_flags(0, 0, 0, sizeof(perf_entry_t), HASHMAP_SLOTS / 2, SEED0, SEED1,
+                                 perf_hash, perf_compare, 0, HASHMAP_FIXED_CAP);
+    KUNIT_ASSERT_NOT_NULL(test, map);
+
+    items = HASHMAP_SLOTS * param -> load / 100;
+    for(n = 0; n < items; n++) {
+        entry = (perf_entry_t){ .key = key_of(param -> dist, n), .value = n };
+        KUNIT_ASSERT_NULL(test, hashmap_set(map, &entry));
+        KUNIT_ASSERT_FALSE(test, hashmap_oom(map));
+    }
+    KUNIT_ASSERT_EQ(test, (int) hashmap_count(map), items);
+
+    perf_init(test, &get_hit);
+    perf_init(test, &get_miss);
+    perf_init(test, &replace);
+    perf_init(test, &del);
+    perf_init(test, &insert);
+
+    state = 0x2545f4914f6cdd1dULL;
+    errors = 0;
+    for(trial = 0; trial < trials; trial++) {
+        preempt_disable();
+        for(i = 0; i < ops; i++) {
+            n = xorshift64(&state) % items;
+            entry = (perf_entry_t){ .key = key_of(param -> dist, n), .value = n };
+
+            start = rdtsc_fenced();
+            found = hashmap_get(map, &entry);
+            perf_add(&get_hit, trial, rdtsc_fenced() - start);
+            errors += found == 0;
+
+            start = rdtsc_fenced();
+            found = hashmap_set(map, &entry);
+            perf_add(&replace, trial, rdtsc_fenced() - start);
+            errors += found == 0;
+
+            start = rdtsc_fenced();
+            found = hashmap_delete(map, &entry);
+            perf_add(&del, trial, rdtsc_fenced() - start);
+            errors += found == 0;
+
+            start = rdtsc_fenced();
+            found = hashmap_set(map, &entry);
+            perf_add(&insert, trial, rdtsc_fenced() - start);
+            errors += found != 0 || hashmap_oom(map);
+
+            entry.key = key_of(param -> dist, items + n);
+            start = rdtsc_fenced();
+            found = hashmap_get(map, &entry);
+            perf_add(&get_miss, trial, rdtsc_fenced() - start);
+            errors += found != 0;
+        }
+        preempt_enable();
+        KUNIT_ASSERT_EQ(test, errors, 0);
+    }
+
+    KUNIT_EXPECT_EQ(test, (int) hashmap_count(map), items);
+
+    hashmap_param_desc(param, desc);
+    perf_report(test, "hashmap", "get_hit", desc, &get_hit);
+    perf_report(test, "hashmap", "get_miss", desc, &get_miss);
+    perf_report(test, "hashmap", "set_replace", desc, &replace);
+    perf_report(test, "hashmap", "delete", desc, &del);
+    perf_report(test, "hashmap", "insert", desc, &insert);
+
+    hashmap_free(map);
+}
+
+
+
+
+// ---------------- Concurrent Hashmap ----------------
+
+#define CHASHMAP_ITEMS      20000   // Enough for every stripe to grow (and migrate) a few times
+#define CHASHMAP_STABLE     1024    // Keys never deleted by the concurrent test
+#define CHASHMAP_ROUNDS     5       // Grow and shrink rounds of the concurrent test
+#define CHASHMAP_READERS    8
+
+static bool chashmap_count_item(const void* item, void* udata) {
+    (*(int *) udata)++;
+    return true;
+}
+
+static void chashmap_func_test(struct kunit* test) {
+
+    chashmap_t* map;
+    perf_entry_t entry, found;
+    int n, items;
+
+    // No capacity: every stripe starts from a single group and grows
+    map = chashmap_new(sizeof(perf_entry_t), 0, SEED0, SEED1, perf_hash, perf_compare, 0);
+    KUNIT_ASSERT_NOT_NULL(test, map);
+
+    for(n = 0; n < CHASHMAP_ITEMS; n++) {
+        entry = (perf_entry_t){ .key = key_of(DIST_RANDOM, n), .value = n };
+        KUNIT_ASSERT_EQ(test, chashmap_set(map, &entry, 0), 0);
+    }
+    KUNIT_ASSERT_EQ(test, (int) chashmap_count(map), CHASHMAP_ITEMS);
+
+    // Every item is found, and a replace returns the old one
+    for(n = 0; n < CHASHMAP_ITEMS; n++) {
+        entry = (perf_entry_t){ .key = key_of(DIST_RANDOM, n), .value = -n };
+        KUNIT_ASSERT_TRUE(test, chashmap_get(map, &entry, &found));
+        KUNIT_ASSERT_EQ(test, found.value, n);
+        KUNIT_ASSERT_EQ(test, chashmap_set(map, &entry, &found), 1);
+        KUNIT_ASSERT_EQ(test, found.value, n);
+    }
+
+    for(n = 0; n < CHASHMAP_ITEMS; n += 2) {
+        entry.key = key_of(DIST_RANDOM, n);
+        KUNIT_ASSERT_TRUE(test, chashmap_delete(map, &entry, &found));
+        KUNIT_ASSERT_EQ(test, found.value, -n);
+        KUNIT_ASSERT_FALSE(test, chashmap_delete(map, &entry, 0));
+    }
+
+    for(n = 0; n < CHASHMAP_ITEMS; n++) {
+        entry.key = key_of(DIST_RANDOM, n);
+        KUNIT_ASSERT_EQ(test, chashmap_get(map, &entry, &found), (bool) (n & 1));
+    }
+    KUNIT_EXPECT_EQ(test, (int) chashmap_count(map), CHASHMAP_ITEMS / 2);
+
+    items = 0;
+    KUNIT_EXPECT_TRUE(test, chashmap_scan(map, chashmap_count_item, &items));
+    KUNIT_EXPECT_EQ(test, items, CHASHMAP_ITEMS / 2);
+
+    chashmap_free(map);
+}
+
+typedef struct chashmap_reader {
+    chashmap_t* map;
+    struct task_struct* task;
+    u64 gets;
+    int errors;
+} chashmap_reader_t;
+
+// Look up the stable keys until stopped: each one must be found with its value, whatever the writer is doing
+static int chashmap_reader(void* data) {
+
+    chashmap_reader_t* reader = data;
+    perf_entry_t entry, found;
+    u64 state;
+    int n;
+
+    state = 0x9e3779b97f4a7c15ULL ^ (u64) (uintptr_t) reader;
+    while(!kthread_should_stop()) {
+        n = xorshift64(&state) % CHASHMAP_STABLE;
+        entry.key = key_of(DIST_SEQUENTIAL, n);
+        if(!chashmap_get(reader -> map, &entry, &found) || found.value != n) reader -> errors++;
+        if((++(reader -> gets) & 1023) == 0) cond_resched();
+    }
+
+    return 0;
+}
+
+static void chashmap_concurrent_test(struct kunit* test) {
+
+    chashmap_reader_t* readers;
+    chashmap_t* map;
+    perf_entry_t entry;
+    int n, round, nreaders, i;
+
+    map = chashmap_new(sizeof(perf_entry_t), 0, SEED0, SEED1, perf_hash, perf_compare, 0);
+    KUNIT_ASSERT_NOT_NULL(test, map);
+
+    for(n = 0; n < CHASHMAP_STABLE; n++) {
+        entry = (perf_entry_t){ .key = key_of(DIST_SEQUENTIAL, n), .value = n };
+        KUNIT_ASSERT_EQ(test, chashmap_set(map, &entry, 0), 0);
+    }
+
+    // One CPU is left to the writer
+    nreaders = clamp((int) num_online_cpus() - 1, 1, CHASHMAP_READERS);
+    readers = kunit_kzalloc(test, sizeof(chashmap_reader_t) * nreaders, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, readers);
+
+    for(i = 0; i < nreaders; i++) {
+        readers[i].map = map;
+        readers[i].task = kthread_run(chashmap_reader, &(readers[i]), "chashmap-rd/%d", i);
+        if(IS_ERR(readers[i].task)) {
+            while(--i >= 0) kthread_stop(readers[i].task);
+            chashmap_free(map);
+            KUNIT_FAIL(test, "Could not start the reader threads");
+            return;
+        }
+    }
+
+    // The churn keys share the stripes of the stable ones, so the readers run through every grow and migration
+    for(round = 0; round < CHASHMAP_ROUNDS; round++) {
+        for(n = CHASHMAP_STABLE; n < CHASHMAP_ITEMS; n++) {
+            entry = (perf_entry_t){ .key = key_of(DIST_SEQUENTIAL, n), .value = n };
+            if(chashmap_set(map, &entry, 0) != 0) break;
+        }
+        for(n = CHASHMAP_STABLE; n < CHASHMAP_ITEMS; n++) {
+            entry.key = key_of(DIST_SEQUENTIAL, n);
+            if(!chashmap_delete(map, &entry, 0)) break;
+        }
+        if(n != CHASHMAP_ITEMS) break;
+        cond_resched();
+    }
+
+    for(i = 0; i < nreaders; i++) kthread_stop(readers[i].task);
+
+    KUNIT_EXPECT_EQ(test, round, CHASHMAP_ROUNDS);
+    KUNIT_EXPECT_EQ(test, (int) chashmap_count(map), CHASHMAP_STABLE);
+    for(i = 0; i < nreaders; i++) {
+        KUNIT_EXPECT_EQ(test, readers[i].errors, 0);
+        kunit_info(test, "chashmap reader %d: %llu gets, %d errors\n", i, readers[i].gets, readers[i].errors);
+    }
+
+    chashmap_free(map);
+}
+
+
+
+static int utils_perf_init(struct kunit* test) {
+    if(trials == 0 || ops == 0) return -EINVAL;
+    return 0;
+}
+
+static struct kunit_case utils_perf_cases[] = {
+    KUNIT_CASE_PARAM(bitmask_perf_test, bitmask_gen_params),
+    KUNIT_CASE_PARAM(hashmap_perf_test, hashmap_gen_params),
+    KUNIT_CASE(chashmap_func_test),
+    KUNIT_CASE(chashmap_concurrent_test),
+    {}
+};
+
+static struct kunit_suite utils_perf_suite = {
+    .name = "utils-perf",
+    .init = utils_perf_init,
+    .test_cases = utils_perf_cases,
+};
+
+kunit_test_suites(&utils_perf_suite);